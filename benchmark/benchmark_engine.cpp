@@ -1,9 +1,14 @@
 #include <benchmark/benchmark.h>
+#include <atomic>
 #include <iostream>
+#include <random>
+#include <thread>
 #include <vector>
 #include <memory>
 #include "generate_orders.h"
 #include "engine.h"
+#include "price_level_order_book.h"
+#include "sharded_engine.h"
 #include "event_handler.h"
 
 using namespace QuantaTrader;
@@ -71,4 +76,150 @@ BENCHMARK(Benchmark)
     ->ArgNames({"symbols", "orders"})
     ->Iterations(1);
 
+// producers submit through a sharded engine while its rebalancer migrates books, another thread migrates
+// symbols at random and calls rebalance() by hand. response rings are kept small so producers have to poll
+// their acks while books move, and every command must come back acked
+static void ShardedRebalanceBenchmark(benchmark::State &state) {
+    const uint32_t num_symbols = state.range(0);
+    const uint32_t num_orders = state.range(1);
+    constexpr uint32_t NUM_SHARDS = 4;
+    constexpr uint32_t NUM_PRODUCERS = 3;
+    std::vector<Order> orders;
+    orders.reserve(num_orders);
+    generateOrders(orders, num_orders, num_symbols);
+
+    for (auto i : state) {
+        state.PauseTiming();
+        ShardedEngine engine{std::make_unique<EventHandler>(), NUM_SHARDS, Clock::defaultClock(), 1 << 12};
+        // every book starts on the first shard so the policy has work to do
+        for (uint32_t i = 1; i <= num_symbols; ++i) {
+            engine.addSymbol(i, "BNCH", 0);
+        }
+        engine.setRebalancePolicy(std::make_unique<QueueDepthPolicy>(), std::chrono::milliseconds(1));
+        std::vector<uint32_t> producer_ids;
+        for (uint32_t p = 0; p < NUM_PRODUCERS; ++p) {
+            producer_ids.push_back(engine.registerProducer(1 << 8));
+        }
+        engine.start();
+        state.ResumeTiming();
+
+        std::atomic<bool> done{false};
+        std::thread mover([&] {
+            std::mt19937 gen(7);
+            for (uint32_t step = 0; !done.load(std::memory_order_acquire); ++step) {
+                if (step % 2 == 0) {
+                    engine.migrateSymbol(1 + gen() % num_symbols, gen() % NUM_SHARDS);
+                } else {
+                    engine.rebalance();
+                }
+                std::this_thread::yield();
+            }
+        });
+        std::vector<uint64_t> acked(NUM_PRODUCERS, 0);
+        std::vector<std::thread> producers;
+        for (uint32_t p = 0; p < NUM_PRODUCERS; ++p) {
+            producers.emplace_back([&, p] {
+                CommandAck ack;
+                uint64_t submitted = 0;
+                for (size_t o = p; o < orders.size(); o += NUM_PRODUCERS) {
+                    while (!engine.submit(producer_ids[p], Command::addOrder(orders[o]))) {
+                        while (engine.pollAck(producer_ids[p], ack)) {
+                            ++acked[p];
+                        }
+                    }
+                    ++submitted;
+                    while (engine.pollAck(producer_ids[p], ack)) {
+                        ++acked[p];
+                    }
+                }
+                while (acked[p] != submitted) {
+                    if (engine.pollAck(producer_ids[p], ack)) {
+                        ++acked[p];
+                    }
+                }
+            });
+        }
+        for (std::thread &producer : producers) {
+            producer.join();
+        }
+        done.store(true, std::memory_order_release);
+        mover.join();
+        engine.stop();
+
+        uint64_t total_acked = 0;
+        for (uint64_t count : acked) {
+            total_acked += count;
+        }
+        if (total_acked != num_orders) {
+            state.SkipWithError("commands went unacked");
+        }
+        state.counters["migrations"] = static_cast<double>(engine.getMigrationCount());
+    }
+}
+
+BENCHMARK(ShardedRebalanceBenchmark)
+    ->Unit(benchmark::kMillisecond)
+    ->Args({20, 50000})
+    ->Args({200, 100000})
+    ->ArgNames({"symbols", "orders"})
+    ->Iterations(1)
+    ->UseRealTime();
+
+// deletes a random resting order and adds a new one to a random book, over books that keep their levels and
+// orders either in one shared huge page arena or on the heap. the books are filled first so the heap is as
+// fragmented as it gets in a long running engine, the time is per delete and add pair
+static void ArenaChurnBenchmark(benchmark::State &state) {
+    const bool use_arena = state.range(0) != 0;
+    const uint32_t num_symbols = state.range(1);
+    const uint64_t num_resting = state.range(2);
+    constexpr uint64_t NUM_CYCLES = 1000000;
+
+    for (auto i : state) {
+        state.PauseTiming();
+        EventHandler event_handler;
+        HugePageArena arena;
+        std::vector<std::unique_ptr<PriceLevelOrderBook>> books;
+        for (uint32_t symbol_id = 1; symbol_id <= num_symbols; ++symbol_id) {
+            books.push_back(std::make_unique<PriceLevelOrderBook>(symbol_id, event_handler, Clock::defaultClock(), nullptr,
+                use_arena ? &arena : nullptr));
+        }
+        std::mt19937 gen(5);
+        auto randomOrder = [&](uint64_t order_id) {
+            uint32_t symbol_id = 1 + gen() % num_symbols;
+            return gen() % 2 == 0 ? Order::limitBuyOrder(order_id, symbol_id, 1000 - gen() % 400, 10, OrderTimeInForce::GTC)
+                : Order::limitSellOrder(order_id, symbol_id, 1001 + gen() % 400, 10, OrderTimeInForce::GTC);
+        };
+        std::vector<std::pair<uint64_t, uint32_t>> resting;
+        resting.reserve(num_resting);
+        uint64_t order_id = 1;
+        for (; order_id <= num_resting; ++order_id) {
+            Order order = randomOrder(order_id);
+            books[order.getSymbolId() - 1]->addOrder(order);
+            resting.emplace_back(order_id, order.getSymbolId());
+        }
+        state.ResumeTiming();
+
+        for (uint64_t cycle = 0; cycle < NUM_CYCLES; ++cycle, ++order_id) {
+            auto &[resting_id, resting_symbol] = resting[gen() % resting.size()];
+            books[resting_symbol - 1]->deleteOrder(resting_id);
+            Order order = randomOrder(order_id);
+            books[order.getSymbolId() - 1]->addOrder(order);
+            resting_id = order_id;
+            resting_symbol = order.getSymbolId();
+        }
+
+        state.PauseTiming();
+        books.clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * NUM_CYCLES);
+}
+
+BENCHMARK(ArenaChurnBenchmark)
+    ->Unit(benchmark::kMillisecond)
+    ->Args({0, 2600, 1500000})
+    ->Args({1, 2600, 1500000})
+    ->ArgNames({"arena", "symbols", "resting"})
+    ->Iterations(1);
+
 BENCHMARK_MAIN();
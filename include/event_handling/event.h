@@ -4,59 +4,146 @@
 
 namespace QuantaTrader {
 
+// when an event was emitted and where it sits in the streams it belongs to. converts from a bare
+// timestamp for events that are not sequenced
+struct EventStamp {
+    Timestamp timestamp;
+    uint64_t sequence; // in the stream of the engine, of the shard for a ShardedEngine or of the worker for a MatchingScheduler, 0 if not sequenced
+    uint64_t symbol_sequence; // in the stream of the symbol's book, 0 for events not emitted by a book
+    uint16_t stream; // shard id for a ShardedEngine, worker id + 1 under a MatchingScheduler, 0 for an Engine
+
+    EventStamp(Timestamp timestamp, uint64_t sequence = 0, uint64_t symbol_sequence = 0, uint16_t stream = 0)
+        : timestamp(timestamp), sequence(sequence), symbol_sequence(symbol_sequence), stream(stream) {}
+};
+
 struct Event {
+    Timestamp timestamp; // engine time at which the event was emitted
+    uint64_t sequence;
+    uint64_t symbol_sequence; // follows the book when a ShardedEngine moves it, sequence changes stream
+    uint16_t stream;
+    explicit Event(const EventStamp &stamp)
+        : timestamp(stamp.timestamp), sequence(stamp.sequence), symbol_sequence(stamp.symbol_sequence), stream(stamp.stream) {}
     virtual ~Event() = default;
 };
 
 // Engine events
 struct EngineEvent : public Event {
     uint32_t symbol_id;
-    explicit EngineEvent(uint32_t symbol_id) : symbol_id(symbol_id) {}
+    EngineEvent(uint32_t symbol_id, const EventStamp &stamp) : Event(stamp), symbol_id(symbol_id) {}
 };
 
 struct SymbolAdded : public EngineEvent {
     std::string name;
-    SymbolAdded(uint32_t symbol_id, std::string name) : EngineEvent(symbol_id), name(std::move(name)) {}
+    SymbolAdded(uint32_t symbol_id, std::string name, const EventStamp &stamp) : EngineEvent(symbol_id, stamp), name(std::move(name)) {}
 
     friend std::ostream &operator<<(std::ostream &os, const SymbolAdded &notification);
 };
 
 struct SymbolDeleted : public EngineEvent {
     std::string name;
-    SymbolDeleted(uint32_t symbol_id, std::string name) : EngineEvent(symbol_id), name(std::move(name)) {}
+    SymbolDeleted(uint32_t symbol_id, std::string name, const EventStamp &stamp) : EngineEvent(symbol_id, stamp), name(std::move(name)) {}
 
     friend std::ostream &operator<<(std::ostream &os, const SymbolDeleted &notification);
 };
 
+// result of an auction uncross, price and volume are 0 if the book was not crossed
+struct AuctionUncrossed : public EngineEvent {
+    uint64_t price;
+    uint64_t volume;
+    AuctionUncrossed(uint32_t symbol_id, uint64_t price, uint64_t volume, const EventStamp &stamp)
+        : EngineEvent(symbol_id, stamp), price(price), volume(volume) {}
+
+    friend std::ostream &operator<<(std::ostream &os, const AuctionUncrossed &notification);
+};
+
+// one fill between an incoming order and a resting one. not an Event so a batch of them is a flat array
+struct Trade {
+    uint64_t trade_id; // increasing per book
+    uint64_t aggressor_id; // the incoming order, the buy order for auction trades
+    uint64_t passive_id; // the resting order, the sell order for auction trades
+    uint64_t price;
+    uint64_t quantity;
+    Timestamp timestamp;
+    uint64_t sequence; // numbered with the events of the book's streams, see EventStamp
+    uint64_t symbol_sequence;
+    uint32_t symbol_id;
+    uint16_t stream;
+    OrderSide aggressor_side;
+    bool auction; // executed by an uncross, neither order was the aggressor
+};
+
+// fills of one incoming order, summed over its sweep of the book
+struct FillSummary {
+    uint64_t aggressor_id;
+    uint64_t quantity;
+    uint64_t notional; // sum of price times quantity over the fills
+    uint64_t first_price;
+    uint64_t last_price;
+    uint64_t open_quantity; // left on the order after the sweep
+    uint32_t symbol_id;
+    uint32_t trade_count;
+    OrderSide side;
+};
+
+// why the pre-trade risk stage or the book turned an order away
+enum class RejectReason : uint8_t {
+    UNKNOWN_ACCOUNT = 0, // the owner id has no risk limits
+    ORDER_QUANTITY = 1,
+    ORDER_NOTIONAL = 2,
+    PRICE_COLLAR = 3, // the limit price is too far through the reference price
+    OPEN_QUANTITY = 4,
+    POSITION = 5, // filling the account's open orders and this one could breach its position limit
+    AUCTION = 6 // a market order reached a book in auction, it has no price to rest at until the uncross
+};
+
+std::string rejectReasonToString(RejectReason reason);
+
 // Order events
 struct OrderEvent : public Event {
     Order order;
-    explicit OrderEvent(Order order) : order(std::move(order)) {}
+    OrderEvent(Order order, const EventStamp &stamp) : Event(stamp), order(std::move(order)) {}
 };
 
 struct OrderAdded : public OrderEvent {
-    explicit OrderAdded(Order order) : OrderEvent(std::move(order)) {}
+    OrderAdded(Order order, const EventStamp &stamp) : OrderEvent(std::move(order), stamp) {}
 
     friend std::ostream &operator<<(std::ostream &os, const OrderAdded &notification);
 };
 
 struct OrderDeleted : public OrderEvent {
-    explicit OrderDeleted(Order order) : OrderEvent(std::move(order)) {}
+    OrderDeleted(Order order, const EventStamp &stamp) : OrderEvent(std::move(order), stamp) {}
 
     friend std::ostream &operator<<(std::ostream &os, const OrderDeleted &notification);
 };
 
 struct OrderExecuted : public OrderEvent {
-    explicit OrderExecuted(Order order) : OrderEvent(std::move(order)) {}
+    OrderExecuted(Order order, const EventStamp &stamp) : OrderEvent(std::move(order), stamp) {}
 
     friend std::ostream &operator<<(std::ostream &os, const OrderExecuted &notification);
 };
 
 struct OrderUpdated : public OrderEvent {
-    explicit OrderUpdated(Order order) : OrderEvent(std::move(order)) {}
+    OrderUpdated(Order order, const EventStamp &stamp) : OrderEvent(std::move(order), stamp) {}
 
     friend std::ostream &operator<<(std::ostream &os, const OrderUpdated &notification);
 };
+
+// self-trade prevention took quantity off the order without a fill. an order cancelled outright while
+// resting is reported by OrderDeleted instead
+struct SelfTradePrevented : public OrderEvent {
+    uint64_t quantity;
+    SelfTradePrevented(Order order, uint64_t quantity, const EventStamp &stamp) : OrderEvent(std::move(order), stamp), quantity(quantity) {}
+
+    friend std::ostream &operator<<(std::ostream &os, const SelfTradePrevented &notification);
+};
+
+// the order never reached its book
+struct OrderRejected : public OrderEvent {
+    RejectReason reason;
+    OrderRejected(Order order, RejectReason reason, const EventStamp &stamp) : OrderEvent(std::move(order), stamp), reason(reason) {}
+
+    friend std::ostream &operator<<(std::ostream &os, const OrderRejected &notification);
+};
 }
 
 #endif // QUANTA_TRADER_EVENT_H
\ No newline at end of file
@@ -1,5 +1,6 @@
 #ifndef QUANTA_TRADER_EVENT_HANDLER_H
 #define QUANTA_TRADER_EVENT_HANDLER_H
+#include <vector>
 #include "event.h"
 
 namespace QuantaTrader {
@@ -20,8 +21,31 @@ public:
     virtual void handleOrderDeleted(const OrderDeleted &event) {}
     virtual void handleOrderUpdated(const OrderUpdated &event) {}
     virtual void handleOrderExecuted(const OrderExecuted &event) {}
+    virtual void handleOrderRejected(const OrderRejected &event) {}
+    virtual void handleSelfTradePrevented(const SelfTradePrevented &event) {}
     virtual void handleSymbolAdded(const SymbolAdded &event) {}
     virtual void handleSymbolDeleted(const SymbolDeleted &event) {}
+    virtual void handleAuctionUncrossed(const AuctionUncrossed &event) {}
+
+    // executions of a bulk match such as an auction uncross, or the buy and sell side of a single fill, in
+    // execution order. override to handle them in one go, by default each one is passed to handleOrderExecuted
+    virtual void handleOrderExecutedBatch(const std::vector<OrderExecuted> &events) {
+        for (const OrderExecuted &event : events) {
+            handleOrderExecuted(event);
+        }
+    }
+
+    // trades of one incoming order's sweep, including the sweeps of stop orders it activated, or of an
+    // auction uncross, in execution order. summaries has one entry per incoming order that traded,
+    // in the order their sweeps finished, and is empty for an uncross
+    virtual void handleTrades(const std::vector<Trade> &trades, const std::vector<FillSummary> &summaries) {}
+
+    // orders removed together by a mass cancel. by default each one is passed to handleOrderDeleted
+    virtual void handleOrderDeletedBatch(const std::vector<OrderDeleted> &events) {
+        for (const OrderDeleted &event : events) {
+            handleOrderDeleted(event);
+        }
+    }
 };
 }
 
@@ -0,0 +1,141 @@
+#ifndef QUANTA_TRADER_EVENT_JOURNAL_H
+#define QUANTA_TRADER_EVENT_JOURNAL_H
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "cache_line.h"
+#include "event.h"
+#include "event_handler.h"
+
+namespace QuantaTrader {
+
+enum class EventType : uint8_t {
+    ORDER_ADDED = 0,
+    ORDER_DELETED = 1,
+    ORDER_UPDATED = 2,
+    ORDER_EXECUTED = 3,
+    ORDER_REJECTED = 4,
+    SELF_TRADE_PREVENTED = 5,
+    SYMBOL_ADDED = 6,
+    SYMBOL_DELETED = 7,
+    AUCTION_UNCROSSED = 8,
+    TRADE = 9
+};
+
+// fixed size summary of one event or trade, one cache line
+struct EventRecord {
+    uint64_t sequence;
+    uint64_t symbol_sequence;
+    Timestamp timestamp;
+    uint64_t order_id; // the aggressor of a trade
+    uint64_t price; // order, trade or uncross price
+    uint64_t quantity; // open quantity of the order, trade quantity or uncross volume
+    uint64_t detail_quantity; // passive order id of a trade, last executed quantity, quantity taken off by self-trade prevention
+    uint32_t symbol_id;
+    EventType type;
+    OrderSide side; // aggressor side of a trade
+    uint8_t detail; // reject reason, 1 for an auction trade
+};
+static_assert(sizeof(EventRecord) == CACHE_LINE_SIZE, "an event record must fit in one cache line");
+
+// the last capacity records of one event stream, slotted by sequence number. consumers on other threads
+// read it while it is written and resume from the sequence they last saw, without a lock: each slot is a
+// seqlock keyed by the sequence number of its record
+class EventJournal {
+public:
+    // capacity is rounded up to a power of 2
+    explicit EventJournal(size_t capacity);
+
+    // views memorySize(capacity) bytes at memory as a journal, capacity a power of 2. the memory starts out
+    // zeroed and outlives the journal. journals over the same shared memory in other processes see the same
+    // records, one over read only memory may only be read
+    EventJournal(void *memory, size_t capacity);
+
+    // bytes a journal of capacity records takes, capacity a power of 2
+    static size_t memorySize(size_t capacity);
+
+    EventJournal(const EventJournal &) = delete;
+    EventJournal &operator=(const EventJournal &) = delete;
+
+    // records with sequence 0 are not sequenced and are dropped. threads may append at the same time as
+    // long as no two of them are a capacity apart
+    void append(const EventRecord &record);
+
+    // appends the records from sequence on to records, at most max_records, stopping at the first one not
+    // written yet. returns false if sequence has already been overwritten: the consumer fell more than
+    // the capacity behind and has to recover from elsewhere
+    bool readFrom(uint64_t sequence, std::vector<EventRecord> &records, size_t max_records) const;
+
+    inline size_t getCapacity() const { return mask + 1; }
+
+private:
+    enum class ReadResult : uint8_t {
+        READ = 0,
+        NOT_WRITTEN = 1,
+        OVERWRITTEN = 2
+    };
+
+    static constexpr size_t WORDS = sizeof(EventRecord) / sizeof(uint64_t);
+
+    // the record as words, the first one is its sequence and 0 while the slot is being written
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        std::atomic<uint64_t> words[WORDS];
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "slots shared between processes must be lock free");
+
+    ReadResult read(uint64_t sequence, EventRecord &record) const;
+
+    std::unique_ptr<Slot[]> owned_slots;
+    Slot *slots;
+    size_t mask;
+};
+
+// records every event and trade in the journal of its event stream, then passes it on to handler. sequence
+// numbers are only unique within a stream, so each stream has a journal of its own written by its single writer
+class JournalEventHandler : public EventHandler {
+public:
+    // capacity records per journal, rounded up to a power of 2. streams is 1 for an Engine, the shard count for a
+    // ShardedEngine and the worker count + 1 under a MatchingScheduler, events of other streams are not journaled
+    JournalEventHandler(std::unique_ptr<EventHandler> handler, size_t capacity, size_t streams = 1);
+
+    void handleOrderAdded(const OrderAdded &event) override;
+    void handleOrderDeleted(const OrderDeleted &event) override;
+    void handleOrderUpdated(const OrderUpdated &event) override;
+    void handleOrderExecuted(const OrderExecuted &event) override;
+    void handleOrderRejected(const OrderRejected &event) override;
+    void handleSelfTradePrevented(const SelfTradePrevented &event) override;
+    void handleSymbolAdded(const SymbolAdded &event) override;
+    void handleSymbolDeleted(const SymbolDeleted &event) override;
+    void handleAuctionUncrossed(const AuctionUncrossed &event) override;
+    void handleOrderExecutedBatch(const std::vector<OrderExecuted> &events) override;
+    void handleOrderDeletedBatch(const std::vector<OrderDeleted> &events) override;
+    void handleTrades(const std::vector<Trade> &trades, const std::vector<FillSummary> &summaries) override;
+
+    // journal of the stream, for consumers on other threads. throws if the stream is not journaled
+    const EventJournal &getJournal(uint16_t stream = 0) const;
+
+    // EventJournal::readFrom on the journal of the stream
+    bool readFrom(uint16_t stream, uint64_t sequence, std::vector<EventRecord> &records, size_t max_records) const {
+        return getJournal(stream).readFrom(sequence, records, max_records);
+    }
+
+    inline size_t getStreamCount() const { return journals.size(); }
+
+protected:
+    // for handlers that keep the records elsewhere, they override append
+    explicit JournalEventHandler(std::unique_ptr<EventHandler> handler);
+
+    // keeps the record of an event of stream, in the stream's journal by default
+    virtual void append(const EventRecord &record, uint16_t stream);
+
+private:
+    void appendOrderEvent(const OrderEvent &event, EventType type, uint64_t detail_quantity = 0, uint8_t detail = 0);
+    void appendEngineEvent(const EngineEvent &event, EventType type, uint64_t price = 0, uint64_t quantity = 0);
+
+    std::unique_ptr<EventHandler> handler;
+    std::vector<std::unique_ptr<EventJournal>> journals;
+};
+}
+
+#endif // QUANTA_TRADER_EVENT_JOURNAL_H
@@ -0,0 +1,42 @@
+#ifndef QUANTA_TRADER_EVENT_SEQUENCER_H
+#define QUANTA_TRADER_EVENT_SEQUENCER_H
+#include <atomic>
+#include <cstdint>
+#include "cache_line.h"
+
+namespace QuantaTrader {
+
+// numbers the events of one stream 1, 2, 3, ... in the order they are handed to the event handler, so a
+// consumer can order them and spot gaps. a stream has a single writer: an Engine is one stream, a ShardedEngine
+// has one per shard and a MatchingScheduler one per worker, so matching threads never share the counter.
+// on its own line so numbering does not drag other data between cores
+class alignas(CACHE_LINE_SIZE) EventSequencer {
+public:
+    explicit EventSequencer(uint16_t stream = 0) : stream(stream) {}
+
+    EventSequencer(const EventSequencer &) = delete;
+    EventSequencer &operator=(const EventSequencer &) = delete;
+
+    // only from the stream's writer, a plain increment. the store is atomic so getLast() can be read anywhere
+    uint64_t next() {
+        uint64_t sequence = last.load(std::memory_order_relaxed) + 1;
+        last.store(sequence, std::memory_order_relaxed);
+        return sequence;
+    }
+
+    // last number handed out, 0 before the first event
+    uint64_t getLast() const {
+        return last.load(std::memory_order_relaxed);
+    }
+
+    uint16_t getStream() const {
+        return stream;
+    }
+
+private:
+    std::atomic<uint64_t> last{0};
+    uint16_t stream;
+};
+}
+
+#endif // QUANTA_TRADER_EVENT_SEQUENCER_H
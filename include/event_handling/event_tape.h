@@ -0,0 +1,172 @@
+#ifndef QUANTA_TRADER_EVENT_TAPE_H
+#define QUANTA_TRADER_EVENT_TAPE_H
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cache_line.h"
+#include "event_journal.h"
+#include "spin_lock.h"
+
+namespace QuantaTrader {
+
+// start of a tape segment file, the columns follow it
+struct TapeSegmentHeader {
+    static constexpr uint64_t MAGIC = 0x5154524b54415045;
+    static constexpr uint32_t VERSION = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t capacity; // rows the columns have room for
+    std::atomic<uint64_t> row_count; // rows written, bumped after each row so a live reader sees whole rows
+};
+
+// where each column of a segment of capacity rows starts, every column on its own cache line
+struct TapeLayout {
+    explicit TapeLayout(uint64_t capacity);
+
+    size_t timestamps;
+    size_t sequences;
+    size_t symbol_sequences;
+    size_t order_ids;
+    size_t prices;
+    size_t quantities;
+    size_t detail_quantities;
+    size_t symbol_ids;
+    size_t types;
+    size_t sides;
+    size_t details;
+    size_t size; // of the whole file
+};
+
+// writes every event and trade as a row of append only, memory mapped segment files with one column per
+// EventRecord field, then passes it on to handler. a row is a handful of stores into the page cache, the
+// kernel writes the pages back. every event stream has segments of its own, named prefix.<stream>-000000.tape,
+// prefix.<stream>-000001.tape, ... in directory, numbering on from the segments already there, and a single
+// writer: the engine's matching thread, or its shard's or worker's. a background thread opens the next segment
+// of every stream ahead of time, so a full segment is swapped for it without a syscall, the next file is there
+// empty until then. rows arriving while no segment could be opened are dropped and counted
+class EventTape : public JournalEventHandler {
+public:
+    // streams is 1 for an Engine, the shard count for a ShardedEngine and the worker count + 1 under a
+    // MatchingScheduler, events of other streams are not taped. throws if a first segment cannot be opened
+    EventTape(std::unique_ptr<EventHandler> handler, const std::string &directory, const std::string &prefix,
+        size_t rows_per_segment = 1 << 20, size_t streams = 1);
+    ~EventTape() override;
+
+    // closes the current segment of every stream and starts the next one, for rolling at a session boundary
+    void roll();
+
+    // segments of the stream started so far, the current one included
+    size_t getSegmentCount(uint16_t stream = 0);
+
+    // rows of the stream dropped as its segment was full and no next one could be opened
+    uint64_t getDroppedRows(uint16_t stream = 0);
+
+    static std::string segmentPath(const std::string &directory, const std::string &prefix, uint16_t stream, size_t index);
+
+protected:
+    void append(const EventRecord &record, uint16_t stream) override;
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Stream {
+        // taken by the stream's writer, only ever contended by roll()
+        SpinLock lock;
+        char *memory = nullptr;
+        uint64_t rows = 0;
+        size_t segments = 0;
+        uint64_t dropped = 0;
+        bool failing = false; // the last segment opened on the writer's thread failed, leave it to the background
+        // under the tape's lock
+        char *spare = nullptr; // next segment, opened ahead
+        size_t spare_index = 0;
+        size_t next_index = 0; // of the next segment file to create
+    };
+
+    // creates and maps segment index of stream, throws if it cannot
+    char *openSegment(uint16_t stream, size_t index);
+    void closeSegment(char *memory);
+
+    // swaps the stream's full segment for its spare, opening one here if the background thread has none
+    // ready. false if there is none, the full segment stays current
+    bool advance(Stream &tape, uint16_t stream);
+
+    // keeps a spare segment open for every stream
+    void run();
+
+    std::string directory;
+    std::string prefix;
+    size_t rows_per_segment;
+    TapeLayout layout;
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::mutex lock;
+    std::condition_variable work;
+    bool stopping;
+    std::thread thread;
+};
+
+// maps one segment read only for scans. the scans run 16 rows at a time with SSE2 where it is available
+class EventTapeReader {
+public:
+    explicit EventTapeReader(const std::string &path);
+    ~EventTapeReader();
+
+    EventTapeReader(const EventTapeReader &) = delete;
+    EventTapeReader &operator=(const EventTapeReader &) = delete;
+
+    // rows written so far, a segment still being written grows
+    uint64_t getRowCount() const {
+        return header().row_count.load(std::memory_order_acquire);
+    }
+
+    const uint64_t *timestamps() const { return column<uint64_t>(layout.timestamps); }
+    const uint64_t *sequences() const { return column<uint64_t>(layout.sequences); }
+    const uint64_t *symbolSequences() const { return column<uint64_t>(layout.symbol_sequences); }
+    const uint64_t *orderIds() const { return column<uint64_t>(layout.order_ids); }
+    const uint64_t *prices() const { return column<uint64_t>(layout.prices); }
+    const uint64_t *quantities() const { return column<uint64_t>(layout.quantities); }
+    const uint64_t *detailQuantities() const { return column<uint64_t>(layout.detail_quantities); }
+    const uint32_t *symbolIds() const { return column<uint32_t>(layout.symbol_ids); }
+    const EventType *types() const { return column<EventType>(layout.types); }
+    const OrderSide *sides() const { return column<OrderSide>(layout.sides); }
+    const uint8_t *details() const { return column<uint8_t>(layout.details); }
+
+    // row as a record
+    EventRecord getRecord(uint64_t row) const;
+
+    // rows of type
+    uint64_t countRows(EventType type) const;
+
+    // appends the rows of type for the symbol to rows
+    void selectRows(EventType type, uint32_t symbol_id, std::vector<uint64_t> &rows) const;
+
+    // sum of the quantity column over the rows of type for the symbol, the traded volume for TRADE
+    uint64_t sumQuantity(EventType type, uint32_t symbol_id) const;
+
+private:
+    const TapeSegmentHeader &header() const {
+        return *reinterpret_cast<const TapeSegmentHeader *>(memory);
+    }
+
+    template <typename T>
+    const T *column(size_t offset) const {
+        return reinterpret_cast<const T *>(memory + offset);
+    }
+
+    // bit i set if row + i matches, for the 16 rows from row
+    uint32_t matchBlock(uint64_t row, EventType type, uint32_t symbol_id, bool any_symbol) const;
+
+    template <typename Visit>
+    void scan(EventType type, uint32_t symbol_id, bool any_symbol, Visit visit) const;
+
+    const char *memory;
+    size_t size;
+    TapeLayout layout;
+};
+}
+
+#endif // QUANTA_TRADER_EVENT_TAPE_H
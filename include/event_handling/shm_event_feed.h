@@ -0,0 +1,100 @@
+#ifndef QUANTA_TRADER_SHM_EVENT_FEED_H
+#define QUANTA_TRADER_SHM_EVENT_FEED_H
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cache_line.h"
+#include "event_journal.h"
+
+namespace QuantaTrader {
+
+// start of a feed ring in shared memory, the ring's records follow it
+struct ShmRingHeader {
+    static constexpr uint64_t MAGIC = 0x5154524b45564e54; // set last, once the ring is ready
+    static constexpr uint32_t VERSION = 1;
+
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    // written after every record, for readers joining the feed. readers following it poll the records
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> last_sequence;
+};
+
+// a feed ring mapped into this process
+class ShmRing {
+public:
+    ShmRing(const ShmRing &) = delete;
+    ShmRing &operator=(const ShmRing &) = delete;
+    ~ShmRing();
+
+    // creates name in /dev/shm, replacing a ring left behind under that name, and unlinks it when destroyed
+    static std::unique_ptr<ShmRing> create(const std::string &name, size_t capacity);
+
+    // maps an existing ring read only
+    static std::unique_ptr<ShmRing> open(const std::string &name);
+
+    ShmRingHeader &header() {
+        return *static_cast<ShmRingHeader *>(memory);
+    }
+
+    const ShmRingHeader &header() const {
+        return *static_cast<const ShmRingHeader *>(memory);
+    }
+
+    EventJournal &records() {
+        return *journal;
+    }
+
+    const EventJournal &records() const {
+        return *journal;
+    }
+
+private:
+    ShmRing(std::string name, void *memory, size_t size, bool owner);
+
+    std::string name;
+    void *memory;
+    size_t size;
+    bool owner;
+    std::unique_ptr<EventJournal> journal;
+};
+
+// publishes every event and trade into shared memory rings for consumers in other processes, one ring per
+// event stream named name.<stream>, then passes it on to handler. publishing is a few stores to memory the
+// readers map, no syscalls. each ring has a single writer: the engine's matching thread, or its shard's
+class ShmEventPublisher : public JournalEventHandler {
+public:
+    // capacity records per ring, rounded up to a power of 2. streams is 1 for an Engine and the shard count
+    // for a ShardedEngine, events of other streams are not published
+    ShmEventPublisher(std::unique_ptr<EventHandler> handler, const std::string &name, size_t capacity, size_t streams = 1);
+
+    // name of the ring of stream, for readers
+    static std::string ringName(const std::string &name, uint16_t stream);
+
+protected:
+    void append(const EventRecord &record, uint16_t stream) override;
+
+private:
+    std::vector<std::unique_ptr<ShmRing>> rings;
+};
+
+// follows one ring of a ShmEventPublisher from another process
+class ShmEventReader {
+public:
+    // throws if the ring does not exist or is not ready yet
+    explicit ShmEventReader(const std::string &ring_name);
+
+    // sequence of the last record published, 0 before the first one
+    uint64_t getLastSequence() const;
+
+    // same as EventJournal::readFrom: false once sequence has been overwritten, the reader was lapped
+    bool readFrom(uint64_t sequence, std::vector<EventRecord> &records, size_t max_records) const;
+
+private:
+    std::unique_ptr<ShmRing> ring;
+};
+}
+
+#endif // QUANTA_TRADER_SHM_EVENT_FEED_H
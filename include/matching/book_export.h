@@ -0,0 +1,178 @@
+#ifndef QUANTA_TRADER_BOOK_EXPORT_H
+#define QUANTA_TRADER_BOOK_EXPORT_H
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "order.h"
+
+namespace QuantaTrader {
+
+// binary export of books: a header, then for each book its record followed by its levels, each level
+// record followed by the records of its orders in queue order. every record is fixed size with no padding,
+// so an export is a flat copy of the books and can be read back with a cast
+
+struct ExportHeader {
+    static constexpr uint64_t MAGIC = 0x5154524b424f4f4b;
+    static constexpr uint32_t VERSION = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t book_count;
+    uint64_t sequence; // last event sequence of the engine when the books were captured
+    Timestamp timestamp;
+};
+
+struct ExportBookRecord {
+    uint64_t last_traded_price;
+    uint64_t symbol_sequence; // last event of the book's own stream
+    uint64_t order_count;
+    uint32_t symbol_id;
+    uint32_t level_count;
+};
+
+// which of a book's level maps a level belongs to
+enum class ExportLevelKind : uint8_t {
+    LIMIT = 0,
+    ALL_OR_NONE = 1,
+    PEG_PRIMARY = 2, // pegged levels are keyed by offset, the price is the offset
+    PEG_MIDPOINT = 3,
+    PEG_MARKET = 4,
+    STOP = 5,
+    TRAILING_STOP = 6
+};
+
+struct ExportLevelRecord {
+    uint64_t price;
+    uint64_t volume;
+    uint32_t order_count;
+    ExportLevelKind kind;
+    OrderSide side;
+    uint16_t reserved; // 0 in an export, a snapshot capture sets EXPORT_LEVEL_UNCHANGED in it
+};
+
+// a captured level record not followed by its orders, the level is as the previous capture left it
+constexpr uint16_t EXPORT_LEVEL_UNCHANGED = 1;
+
+struct ExportOrderRecord {
+    uint64_t id;
+    uint64_t price;
+    uint64_t stop_price;
+    uint64_t quantity;
+    uint64_t open_quantity;
+    uint64_t visible_quantity;
+    uint64_t peak_quantity;
+    uint64_t trail_amount;
+    uint64_t peg_offset;
+    Timestamp timestamp;
+    uint32_t owner_id;
+    OrderType type;
+    OrderSide side;
+    OrderTimeInForce time_in_force;
+    SelfTradePrevention self_trade_prevention;
+};
+
+static_assert(sizeof(ExportHeader) == 32 && sizeof(ExportBookRecord) == 32 && sizeof(ExportLevelRecord) == 24
+    && sizeof(ExportOrderRecord) == 88, "export records must not have padding");
+
+ExportOrderRecord toExportRecord(const Order &order);
+
+// bytes of one export. reused between exports, once it has grown to the size of the books capturing them
+// again allocates nothing
+class ExportBuffer {
+public:
+    // drops the previous export and writes the header
+    void begin(uint64_t sequence, Timestamp timestamp);
+
+    // appends a record, returns its offset
+    template <typename T>
+    size_t append(const T &record) {
+        size_t offset = used;
+        if (used + sizeof(T) > bytes.size()) {
+            bytes.resize(std::max(2 * bytes.size(), used + sizeof(T)));
+        }
+        std::memcpy(bytes.data() + used, &record, sizeof(T));
+        used += sizeof(T);
+        return offset;
+    }
+
+    // appends records captured elsewhere
+    void appendBytes(const char *data, size_t size) {
+        if (used + size > bytes.size()) {
+            bytes.resize(std::max(2 * bytes.size(), used + size));
+        }
+        std::memcpy(bytes.data() + used, data, size);
+        used += size;
+    }
+
+    // overwrites the record at offset, for counts only known once the records after it are in
+    template <typename T>
+    void patch(size_t offset, const T &record) {
+        std::memcpy(bytes.data() + offset, &record, sizeof(T));
+    }
+
+    // a book's records are in
+    void endBook();
+
+    const char *data() const { return bytes.data(); }
+    size_t size() const { return used; }
+
+    // throws if the file cannot be written
+    void writeFile(const std::string &path) const;
+
+private:
+    std::vector<char> bytes;
+    size_t used = 0;
+    uint32_t book_count = 0;
+};
+
+// writes captured exports to disk on its own thread, so the thread matching the books only pays for the
+// capture. buffers are recycled once written
+class BookExporter {
+public:
+    BookExporter();
+    // writes what was submitted before returning
+    ~BookExporter();
+
+    BookExporter(const BookExporter &) = delete;
+    BookExporter &operator=(const BookExporter &) = delete;
+
+    // a buffer to capture into, one that was already written if there is one
+    std::unique_ptr<ExportBuffer> acquire();
+
+    // writes buffer to path on the exporter thread
+    void submit(std::unique_ptr<ExportBuffer> buffer, std::string path);
+
+    // waits until everything submitted so far is written, returns the number of writes that failed
+    size_t flush();
+
+private:
+    struct Job {
+        std::unique_ptr<ExportBuffer> buffer;
+        std::string path;
+    };
+
+    void run();
+
+    std::mutex lock;
+    std::condition_variable work;
+    std::condition_variable done;
+    std::deque<Job> jobs;
+    std::vector<std::unique_ptr<ExportBuffer>> free_buffers;
+    size_t pending = 0;
+    size_t failures = 0;
+    bool stopping = false;
+    std::thread thread;
+};
+
+// renders an export as text, for inspecting one after the fact. returns false if data is not a whole export
+bool renderExport(const char *data, size_t size, std::ostream &os);
+}
+
+#endif // QUANTA_TRADER_BOOK_EXPORT_H
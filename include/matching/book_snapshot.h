@@ -0,0 +1,98 @@
+#ifndef QUANTA_TRADER_BOOK_SNAPSHOT_H
+#define QUANTA_TRADER_BOOK_SNAPSHOT_H
+#include <memory>
+#include <vector>
+#include "book_export.h"
+#include "order_book.h"
+
+namespace QuantaTrader {
+
+// immutable copy of one book, its export records. shared by every epoch the book did not change in, and
+// within a book each level is its own chunk, shared by every capture the level did not change in
+class BookSnapshot {
+public:
+    // captures book through scratch, on the thread matching the book. previous is the book's last capture,
+    // the levels it still holds unchanged are shared with it and only the others are copied. nullptr
+    // copies every level, for a book never captured or captured into another snapshot
+    BookSnapshot(OrderBook &book, const BookSnapshot *previous, ExportBuffer &scratch);
+
+    uint32_t getSymbolId() const { return record.symbol_id; }
+    uint64_t getSymbolSequence() const { return record.symbol_sequence; }
+    uint64_t getLastTradedPrice() const { return record.last_traded_price; }
+    uint64_t getOrderCount() const { return record.order_count; }
+
+    // calls visit(level) for every level, in export order
+    template <typename Visit>
+    void forEachLevel(Visit visit) const {
+        walk([&](const ExportLevelRecord &level) { visit(level); }, [](const ExportLevelRecord &, const ExportOrderRecord &) {});
+    }
+
+    // calls visit(level, order) for every order, levels in export order and orders in queue order
+    template <typename Visit>
+    void forEachOrder(Visit visit) const {
+        walk([](const ExportLevelRecord &) {}, visit);
+    }
+
+    // appends the book's export records, the book record first
+    void exportBinary(ExportBuffer &buffer) const;
+
+private:
+    // a level record followed by the records of its orders
+    using LevelBytes = std::vector<char>;
+
+    template <typename VisitLevel, typename VisitOrder>
+    void walk(VisitLevel visit_level, VisitOrder visit_order) const {
+        for (const std::shared_ptr<const LevelBytes> &bytes : levels) {
+            ExportLevelRecord level;
+            std::memcpy(&level, bytes->data(), sizeof(level));
+            visit_level(level);
+            size_t offset = sizeof(level);
+            for (uint32_t order_index = 0; order_index < level.order_count; ++order_index) {
+                ExportOrderRecord order;
+                std::memcpy(&order, bytes->data() + offset, sizeof(order));
+                offset += sizeof(order);
+                visit_order(level, order);
+            }
+        }
+    }
+
+    ExportBookRecord record;
+    std::vector<std::shared_ptr<const LevelBytes>> levels; // in export order
+};
+
+// every book as of one epoch. readers pin an epoch by holding on to its snapshot, it stays whole for as
+// long as they do while the matching thread goes on and publishes later epochs
+class EngineSnapshot {
+public:
+    EngineSnapshot(uint64_t epoch, uint64_t sequence, Timestamp timestamp) : epoch(epoch), sequence(sequence), timestamp(timestamp) {}
+
+    uint64_t getEpoch() const { return epoch; }
+
+    // last event sequence of the engine at the epoch, a journal replayed from the next one brings it up to date
+    uint64_t getSequence() const { return sequence; }
+
+    Timestamp getTimestamp() const { return timestamp; }
+
+    // nullptr if the symbol had no book at the epoch
+    const BookSnapshot *findBook(uint32_t symbol_id) const;
+
+    // by symbol id
+    const std::vector<std::shared_ptr<const BookSnapshot>> &getBooks() const { return books; }
+
+    // writes the epoch as a binary export, the same as Engine::exportBinary at the epoch would have
+    void exportBinary(ExportBuffer &buffer) const;
+
+private:
+    friend struct OrderBookHandler;
+
+    // the symbol's capture, for a later epoch to share when the book has not changed since
+    std::shared_ptr<const BookSnapshot> shareBook(uint32_t symbol_id) const;
+
+    uint64_t epoch;
+    uint64_t sequence;
+    Timestamp timestamp;
+    std::vector<std::shared_ptr<const BookSnapshot>> books;
+};
+}
+
+#endif // QUANTA_TRADER_BOOK_SNAPSHOT_H
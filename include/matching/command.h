@@ -0,0 +1,56 @@
+#ifndef QUANTA_TRADER_COMMAND_H
+#define QUANTA_TRADER_COMMAND_H
+#include <cstdint>
+#include "order.h"
+
+namespace QuantaTrader {
+
+// mirrors the order entry points of Engine
+enum class CommandType : uint8_t {
+    ADD_ORDER = 0,
+    DELETE_ORDER = 1,
+    CANCEL_ORDER = 2,
+    MODIFY_ORDER = 3,
+    EXECUTE_ORDER = 4, // executes at the order's own price
+    EXECUTE_ORDER_AT_PRICE = 5,
+    START_AUCTION = 6,
+    UNCROSS_AUCTION = 7
+};
+
+enum class CommandStatus : uint8_t {
+    ACCEPTED = 0,
+    REJECTED = 1 // the engine threw, for example because the symbol does not exist, or the risk check turned the order away
+};
+
+// a request to the engine submitted from a gateway thread
+struct Command {
+    static Command addOrder(const Order &order);
+    static Command deleteOrder(uint32_t symbol_id, uint64_t order_id);
+    static Command cancelOrder(uint32_t symbol_id, uint64_t order_id, uint64_t cancelled_quantity);
+    static Command modifyOrder(uint32_t symbol_id, uint64_t order_id, uint64_t new_order_id, uint64_t new_price);
+    static Command executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quantity, uint64_t price);
+    static Command executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quantity);
+    static Command startAuction(uint32_t symbol_id);
+    static Command uncrossAuction(uint32_t symbol_id);
+
+    CommandType type;
+    uint32_t producer_id; // set on submission, selects the response ring the ack goes to
+    uint64_t request_id; // chosen by the producer and echoed back in the ack
+    uint32_t symbol_id;
+    uint64_t order_id;
+    uint64_t new_order_id;
+    uint64_t price;
+    uint64_t quantity;
+    Order order; // only used by ADD_ORDER
+};
+
+// result of a command, returned to the producer that submitted it
+struct CommandAck {
+    uint64_t request_id;
+    uint64_t order_id;
+    CommandType type;
+    CommandStatus status;
+};
+}
+
+#endif // QUANTA_TRADER_COMMAND_H
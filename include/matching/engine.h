@@ -6,8 +6,16 @@
 #include "robin_hood.h"
 #include "order.h"
 #include "order_book.h"
+#include "book_export.h"
+#include "book_snapshot.h"
 #include "symbol.h"
 #include "event_handler.h"
+#include "event_sequencer.h"
+#include "order_router.h"
+#include "huge_page_arena.h"
+#include "clock.h"
+#include "command.h"
+#include "risk_check.h"
 
 namespace QuantaTrader {
 
@@ -15,24 +23,99 @@ class EventHandler;
 
 struct OrderBookHandler {
 public:
-    explicit OrderBookHandler(std::unique_ptr<EventHandler> event_handler);
+    // with a risk check, orders only reach their book once it accepts them. with route_orders the books
+    // route their resting orders, so they can be found by id alone. books are placed on cpu's node
+    OrderBookHandler(std::unique_ptr<EventHandler> event_handler, Clock &clock, RiskCheck *risk_check = nullptr, int cpu = -1,
+        bool route_orders = false);
 
     void addOrderBook(uint32_t symbol_id, std::string symbol_name);
     void deleteOrderBook(uint32_t symbol_id, std::string symbol_name);
 
     // order functions with additional symbol_id to identify the order_book it is a part of
-    void addOrder(const Order &order);
+    // returns false if the risk check or the book rejected the order
+    bool addOrder(const Order &order);
     void deleteOrder(uint32_t symbol_id, uint64_t order_id);
     void cancelOrder(uint32_t symbol_id, uint64_t order_id, uint64_t cancelled_quantity);
     void modifyOrder(uint32_t symbol_id, uint64_t order_id, uint64_t new_order_id, uint64_t new_price);
     void executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quantity, uint64_t price);
     void executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quantity);
+    void startAuction(uint32_t symbol_id);
+    void uncrossAuction(uint32_t symbol_id);
+    size_t cancelAllOrders(uint32_t symbol_id);
+    size_t cancelSideOrders(uint32_t symbol_id, OrderSide side);
+    size_t cancelPriceRange(uint32_t symbol_id, OrderSide side, uint64_t low, uint64_t high);
+    size_t cancelOwnerOrders(uint32_t symbol_id, uint32_t owner_id);
+    size_t cancelOwnerOrders(uint32_t owner_id);
+    std::vector<uint64_t> getOwnerOrderIds(uint32_t symbol_id, uint32_t owner_id) const;
+    OwnerExposure getOwnerExposure(uint32_t symbol_id, uint32_t owner_id) const;
+    OwnerExposure getOwnerExposure(uint32_t owner_id) const;
+    std::vector<uint32_t> getOwnerSymbols(uint32_t owner_id) const;
+
+    // numbers the symbol's events in sequencer's stream, nullptr returns them to the engine's
+    void setSequencer(uint32_t symbol_id, EventSequencer *sequencer);
+
+    // symbol of the resting order, throws if there is none with the id or orders are not routed
+    uint32_t routeOrder(uint64_t order_id) const;
+
+    bool findOrderSymbol(uint64_t order_id, uint32_t &symbol_id) const {
+        return router.find(order_id, symbol_id);
+    }
+
+    // last sequence number handed to an event
+    uint64_t getLastSequence() const {
+        return sequencer.getLast();
+    }
+
+    ArenaStats getArenaStats() const {
+        return arena.getStats();
+    }
+
+    int getCpu() const {
+        return cpu;
+    }
+
+    // captures every book into buffer
+    void exportBinary(ExportBuffer &buffer) const;
+
+    // publishes the next epoch, recapturing only the levels that changed since the last one
+    uint64_t publishSnapshot();
+
+    // latest epoch, safe from any thread
+    std::shared_ptr<const EngineSnapshot> getSnapshot() const {
+        return std::atomic_load(&snapshot);
+    }
 
     std::string toString();
 
 private:
+    // stamps the events the engine emits itself, they belong to no book
+    EventStamp stamp() {
+        return EventStamp{clock.now(), sequencer.next()};
+    }
+
+    // resting order id : symbol, before the books as they unroute their orders when destroyed. only kept
+    // with route_orders, otherwise no book is given it
+    OrderRouter router;
+    bool route_orders;
+    // books are constructed on a thread pinned to it, -1 for the calling thread
+    int cpu;
+    // levels and orders of every book, before the books as they free into it
+    HugePageArena arena;
     std::unordered_map<uint32_t, std::unique_ptr<OrderBook>> symbol_to_order_book;
+    // symbol : owners that have sent orders to it, so owner wide calls only visit those books. an owner stays
+    // listed after its orders there are gone, until it is mass cancelled. kept per symbol so adding an order
+    // only touches its own symbol's set, the map itself only changes with the books
+    robin_hood::unordered_map<uint32_t, robin_hood::unordered_set<uint32_t>> symbol_owners;
     std::unique_ptr<EventHandler> event_handler;
+    Clock &clock;
+    RiskCheck *risk_check;
+    // numbers every event of the engine, the books' included
+    EventSequencer sequencer;
+    // latest epoch, swapped atomically as readers load it from other threads
+    std::shared_ptr<const EngineSnapshot> snapshot;
+    // symbols deleted since the latest epoch, a book added again under one must not reuse its old capture
+    std::vector<uint32_t> deleted_symbols;
+    ExportBuffer snapshot_buffer;
 };
 
 class Engine {
@@ -41,7 +124,16 @@ public:
     Engine &operator=(Engine &&other) = delete;
 
     // Constructor for the engine, using the event_handler as the basis
-    explicit Engine(std::unique_ptr<EventHandler> event_handler);
+    // clock stamps every event the engine emits, pass a SimulatedClock to make replays reproducible
+    // risk_check, if given, vets every order before it reaches its book and must outlive the engine
+    // cpu, if given, is where the engine is matched. the levels and orders of the books are placed on its
+    // NUMA node and every book is constructed on a thread pinned to it, whatever thread adds the symbol.
+    // a MatchingThread running the engine pins itself to the same cpu
+    // route_orders keeps a router of resting order ids to symbols for the ById calls below. it costs every
+    // order coming to rest or leaving an insert or erase in a table shared by all the books, so it is off
+    // unless asked for
+    explicit Engine(std::unique_ptr<EventHandler> event_handler, Clock &clock = Clock::defaultClock(), RiskCheck *risk_check = nullptr,
+        int cpu = -1, bool route_orders = false);
 
     // adds a new symbol and its order book to the engine
     void addSymbol(uint32_t symbol_id, const std::string &symbol_name);
@@ -50,17 +142,104 @@ public:
     void deleteSymbol(uint32_t symbol_id);
 
     bool hasSymbol(uint32_t symbol_id) const;
-    void addOrder(const Order &order);
+    // returns false if the risk check or the book rejected the order, an OrderRejected event says why
+    bool addOrder(const Order &order);
     void deleteOrder(uint32_t symbol_id, uint64_t order_id);
     void cancelOrder(uint32_t symbol_id, uint64_t order_id, uint64_t cancelled_quantity);
     void modifyOrder(uint32_t symbol_id, uint64_t order_id, uint64_t new_order_id, uint64_t new_price);
     void executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quantity, uint64_t price);
     void executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quantity);
+
+    // the same by order id alone, the engine looks up the symbol of the resting order. only for an engine
+    // constructed with route_orders. order ids must be unique across symbols for these, they throw if no
+    // resting order has the id or orders are not routed
+    void deleteOrderById(uint64_t order_id);
+    void cancelOrderById(uint64_t order_id, uint64_t cancelled_quantity);
+    void modifyOrderById(uint64_t order_id, uint64_t new_order_id, uint64_t new_price);
+    void executeOrderById(uint64_t order_id, uint64_t quantity, uint64_t price);
+    void executeOrderById(uint64_t order_id, uint64_t quantity);
+
+    // false if no resting order has the id, always without route_orders
+    bool findOrderSymbol(uint64_t order_id, uint32_t &symbol_id) const;
+
+    // puts the symbol's book into auction mode, orders accumulate without matching
+    void startAuction(uint32_t symbol_id);
+
+    // uncrosses the symbol's book at its equilibrium price and resumes continuous matching
+    void uncrossAuction(uint32_t symbol_id);
+
+    // mass cancels, for kill switches. each removes the orders in bulk, activates stop orders once
+    // and returns the number of orders cancelled
+
+    // cancels every resting order of the symbol
+    size_t cancelAllOrders(uint32_t symbol_id);
+
+    // cancels every resting order of one side of the symbol
+    size_t cancelSideOrders(uint32_t symbol_id, OrderSide side);
+
+    // cancels the limit and iceberg orders of one side of the symbol resting at prices in [low, high]
+    size_t cancelPriceRange(uint32_t symbol_id, OrderSide side, uint64_t low, uint64_t high);
+
+    // cancels the owner's resting orders in the symbol
+    size_t cancelOwnerOrders(uint32_t symbol_id, uint32_t owner_id);
+
+    // cancels the owner's resting orders in every symbol. the owner wide calls visit the books of every symbol,
+    // not while a MatchingScheduler drives the engine
+    size_t cancelOwnerOrders(uint32_t owner_id);
+
+    // per owner queries, they only touch the owner's orders
+
+    // ids of the owner's resting orders in the symbol
+    std::vector<uint64_t> getOwnerOrderIds(uint32_t symbol_id, uint32_t owner_id) const;
+
+    // open interest of the owner in the symbol
+    OwnerExposure getOwnerExposure(uint32_t symbol_id, uint32_t owner_id) const;
+
+    // open interest of the owner summed over every symbol
+    OwnerExposure getOwnerExposure(uint32_t owner_id) const;
+
+    // symbols the owner has sent orders to since it was last mass cancelled
+    std::vector<uint32_t> getOwnerSymbols(uint32_t owner_id) const;
+
+    // sequence number of the last event the engine emitted in its own stream, a consumer that has seen it
+    // is up to date. under a MatchingScheduler the books' events are numbered in the workers' streams instead
+    uint64_t getLastSequence() const;
+
+    // numbers the symbol's events in sequencer's stream from now on, nullptr returns them to the engine's
+    // stream. only from the thread driving the symbol, sequencer must outlive its use
+    void setSequencer(uint32_t symbol_id, EventSequencer *sequencer);
+
+    // memory held by the books' levels and orders
+    ArenaStats getArenaStats() const;
+
+    // cpu the engine is placed on, -1 if it is not
+    int getCpu() const;
+
+    // applies a command through the matching entry point it mirrors, returns false if it was rejected
+    bool process(const Command &command);
+
     std::string toString() const;
 
-    // Exports the engine to a specified path in txt format
+    // captures every book into buffer, with the sequence of the last event so a journal can be replayed on top
+    void exportBinary(ExportBuffer &buffer) const;
+
+    // Exports the engine to a specified path in binary format, render_export prints it as text
     void exportEngine(const std::string &name) const;
 
+    // captures the books on the calling thread and leaves writing them to the exporter's thread
+    void exportEngine(BookExporter &exporter, const std::string &name) const;
+
+    // consistent snapshots for readers on other threads. publishSnapshot runs on the thread matching the
+    // engine and copies only the levels that changed since the previous epoch, the rest is shared with it.
+    // getSnapshot can be called from any thread, the epoch it returns stays valid and unchanged for as long
+    // as the reader holds it, so exports and inspections of it do not hold up matching
+
+    // publishes the books as they are now as the next epoch and returns its number
+    uint64_t publishSnapshot();
+
+    // latest published epoch, nullptr before the first
+    std::shared_ptr<const EngineSnapshot> getSnapshot() const;
+
     friend std::ostream &operator<<(std::ostream &os, const Engine &engine);
 
 private:
@@ -1,6 +1,11 @@
 #ifndef OUANTA_TRADER_LEVEL_H
 #define OUANTA_TRADER_LEVEL_H
+#include <map>
+#include <vector>
+#include "huge_page_arena.h"
 #include "order.h"
+#include "order_table.h"
+#include "volume_ladder.h"
 
 namespace QuantaTrader {
 
@@ -11,11 +16,17 @@ enum class LevelSide {
 
 using namespace boost::intrusive;
 
+struct RestingOrderCold;
+using RestingOrderTable = OrderTable<RestingOrder, RestingOrderCold>;
+
 class Level {
 public:
-    Level(uint64_t price, LevelSide side, uint32_t symbol_id);
-    const list<Order> &getOrders() const;
-    list<Order> &getOrders();
+    // order_table holds the cold fields of the level's orders. ladder, if given, is kept in step with the
+    // level's volume. the queue position tree draws from arena
+    Level(uint64_t price, LevelSide side, uint32_t symbol_id, RestingOrderTable *order_table, VolumeLadder *ladder = nullptr,
+        HugePageArena *arena = nullptr);
+    const list<RestingOrder> &getOrders() const;
+    list<RestingOrder> &getOrders();
 
     inline uint64_t getPrice() const { return price; }
     inline uint64_t getVolume() const { return volume; }
@@ -24,28 +35,89 @@ public:
     inline size_t size() const { return orders.size(); }
     inline size_t empty() const { return orders.empty(); }
 
-    Order &front(); // least recently inserted order in the level
-    Order &back(); // most recently inserted order in the level
+    // number of orders resting in the level, the intrusive list keeps a constant time size
+    inline size_t getOrderCount() const { return orders.size(); }
+
+    // displayed quantity resting ahead of the order in the level's FIFO queue
+    uint64_t getQuantityAhead(const RestingOrder &order) const;
+
+    RestingOrder &front(); // least recently inserted order in the level
+    RestingOrder &back(); // most recently inserted order in the level
     void removeFront(); // removes the least recently inserted order
     void removeBack(); // removes the most recently inserted order
 
-    void addOrder(Order &order);
-    void deleteOrder(const Order &order);
-    void reduceVolume(uint64_t amount);
+    void addOrder(RestingOrder &order);
+    void deleteOrder(const RestingOrder &order);
+    // amount is displayed quantity, only the visible part of an iceberg counts towards the volume
+    void reduceVolume(const RestingOrder &order, uint64_t amount);
+
+    // unlinks every order at once and takes the level's volume off its ladder
+    void clear();
+
+    // shows the next peak of an iceberg whose displayed quantity filled
+    void replenish(RestingOrder &order);
 
     void popFront(); // removes the oldest order inserted in the level
     void popBack(); // removes the newest order inserted in the level
 
+    // whether the level or any of its orders changed since the last snapshot captured it. every change to a
+    // resting order goes through one of the calls above, so they are what marks it
+    inline bool isChanged() const { return changed; }
+    inline void markCaptured() { changed = false; }
+
     std::string toString() const;
     friend std::ostream &operator<<(std::ostream &os, const Level &level);
 
 private:
+    void addVolume(uint64_t amount);
+    void subtractVolume(uint64_t amount);
+
+    // the order's fields in the order table's cold store, its queue position among them
+    OrderCold &cold(const RestingOrder &order) const;
+
+    // records that amount of the order's open quantity left the queue
+    void dequeue(const RestingOrder &order, uint64_t amount);
+
+    // reassigns queue slots to the resting orders and resets the queue counters
+    void compactQueue();
+
+    // sum of the quantity removed from behind the front of the queue in slots before slot
+    uint64_t removedBefore(uint32_t slot) const;
+
 uint64_t price;
-    list<Order> orders;
+    list<RestingOrder> orders;
+    RestingOrderTable *order_table;
     LevelSide side;
     uint32_t symbol_id;
     uint64_t volume;
+    VolumeLadder *ladder; // null for stop levels, they never match
+    bool changed;
+
+    // queue position tracking: an order's quantity ahead is the quantity enqueued before it, minus what
+    // left from the front of the queue, minus what was cancelled from earlier slots behind the front.
+    // fills only ever hit the front order so they are a counter bump, cancels further back go into
+    // a fenwick tree over enqueue slots
+    uint64_t queue_tail; // cumulative quantity enqueued
+    uint64_t queue_head; // cumulative quantity removed from the front order
+    uint32_t next_slot;
+    std::vector<uint64_t, ArenaAllocator<uint64_t>> removed_behind_front; // fenwick tree, index i holds slot i - 1
+};
+
+// levels by price, nodes come from the book's arena
+using LevelMap = std::map<uint64_t, Level, std::less<uint64_t>, ArenaAllocator<std::pair<const uint64_t, Level>>>;
+
+// the rest of a resting order, kept by the book's order table at the slot its hot record names
+struct RestingOrderCold {
+    OrderCold cold;
+    RestingOrder *order; // the hot record
+    LevelMap::iterator level_it;
+    // links the order into its owner's list in the book, unlinks itself when the order leaves the table
+    list_member_hook<link_mode<auto_unlink>> owner_hook;
+
+    // the resting orders of one owner, in the order they joined the book
+    using OwnerList = list<RestingOrderCold, member_hook<RestingOrderCold, list_member_hook<link_mode<auto_unlink>>,
+        &RestingOrderCold::owner_hook>, constant_time_size<false>>;
 };
 }
 
-#endif // OUANTA_TRADER_LEVEL_H
\ No newline at end of file
+#endif // OUANTA_TRADER_LEVEL_H
@@ -0,0 +1,120 @@
+#ifndef QUANTA_TRADER_MATCHING_SCHEDULER_H
+#define QUANTA_TRADER_MATCHING_SCHEDULER_H
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "robin_hood.h"
+#include "engine.h"
+#include "command.h"
+#include "mpsc_queue.h"
+#include "spin_lock.h"
+
+namespace QuantaTrader {
+
+// utilization report for one worker
+struct WorkerStats {
+    uint64_t commands; // commands processed
+    uint64_t batches; // symbol queue drains
+    uint64_t steals; // symbol queues taken from another worker
+    uint64_t busy_ns; // time spent processing commands
+    uint64_t elapsed_ns; // time since start
+    double utilization; // busy_ns / elapsed_ns
+};
+
+// runs an Engine on a pool of matching threads with work stealing.
+// every symbol has its own command queue. a symbol queue with work is put on its home worker's
+// deque, and a worker with nothing to do steals whole symbol queues from the other workers.
+// a symbol queue is drained by at most one worker at a time, so commands for a symbol are applied
+// in submission order and each book is only ever touched by one thread at a time.
+// books of different symbols are matched concurrently, so the engine's event handler and clock
+// must be safe to call from several threads. every worker numbers its events in a stream of its own,
+// stream worker id + 1: a book takes on the stream of the worker draining it, like a book moving
+// between the shards of a ShardedEngine, and goes back to the engine's stream once the scheduler stops
+class MatchingScheduler {
+public:
+    MatchingScheduler(Engine &engine, size_t num_workers, size_t symbol_queue_capacity = 1 << 12, size_t batch_size = 64);
+    ~MatchingScheduler();
+
+    MatchingScheduler(const MatchingScheduler &) = delete;
+    MatchingScheduler &operator=(const MatchingScheduler &) = delete;
+
+    // creates the command queue of a symbol already added to the engine, only before start()
+    void addSymbol(uint32_t symbol_id);
+
+    // creates a response queue and returns the producer id to submit with, only before start()
+    uint32_t registerProducer(size_t response_capacity = 1 << 12);
+
+    void start();
+
+    // stops the workers and applies every command submitted before the call
+    void stop();
+
+    // returns false if the symbol's queue is full, throws if the symbol was not added
+    bool submit(uint32_t producer_id, Command command);
+
+    // producer only, returns false if there is no ack waiting
+    bool pollAck(uint32_t producer_id, CommandAck &ack);
+
+    std::vector<WorkerStats> getWorkerStats() const;
+
+    // sequence number of the last event in the worker's stream, from any thread
+    uint64_t getLastSequence(uint32_t worker_id) const;
+
+    inline size_t getWorkerCount() const { return workers.size(); }
+
+private:
+    struct SymbolQueue {
+        SymbolQueue(uint32_t symbol_id, uint32_t home_worker, size_t capacity)
+            : symbol_id(symbol_id), home_worker(home_worker), commands(capacity), scheduled(false) {}
+
+        uint32_t symbol_id;
+        uint32_t home_worker;
+        MpscQueue<Command> commands;
+        std::atomic<bool> scheduled; // true while the queue sits on a deque or is being drained
+        EventSequencer *sequencer = nullptr; // stream the book is numbered in, by the worker draining it
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Worker {
+        explicit Worker(uint16_t stream) : sequencer(stream) {}
+
+        SpinLock lock;
+        std::deque<SymbolQueue *> ready; // owner pops from the front, thieves take from the back
+        std::atomic<size_t> ready_count{0};
+        std::atomic<uint64_t> commands{0};
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> busy_ns{0};
+        std::thread thread;
+        EventSequencer sequencer;
+    };
+
+    void run(uint32_t worker_id);
+
+    // puts the queue on a worker's deque if no one else has done so already
+    void schedule(SymbolQueue &queue, uint32_t worker_id);
+
+    SymbolQueue *popLocal(uint32_t worker_id);
+    SymbolQueue *steal(uint32_t worker_id);
+
+    // applies up to batch_size commands from the queue, then reschedules it if work is left
+    void drain(SymbolQueue &queue, uint32_t worker_id);
+
+    void apply(const Command &command);
+
+    Engine &engine;
+    size_t symbol_queue_capacity;
+    size_t batch_size;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::unique_ptr<SymbolQueue>> symbol_queues;
+    robin_hood::unordered_map<uint32_t, SymbolQueue *> symbol_to_queue;
+    // several workers answer the same producer, so responses go through multi producer queues
+    std::vector<std::unique_ptr<MpscQueue<CommandAck>>> responses;
+    std::atomic<bool> running;
+    std::chrono::steady_clock::time_point start_time;
+    uint64_t run_ns; // how long the last run lasted, reported once the scheduler is stopped
+};
+}
+
+#endif // QUANTA_TRADER_MATCHING_SCHEDULER_H
@@ -0,0 +1,67 @@
+#ifndef QUANTA_TRADER_MATCHING_THREAD_H
+#define QUANTA_TRADER_MATCHING_THREAD_H
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "engine.h"
+#include "command.h"
+#include "mpsc_queue.h"
+#include "spsc_queue.h"
+
+namespace QuantaTrader {
+
+// runs an Engine on a dedicated thread fed by a lock free ingress queue.
+// any number of gateway threads submit commands concurrently, the matching thread drains them
+// in batches and answers every command on the response ring of the producer that sent it.
+// once started, the engine must only be touched through this class until stop() returns
+class MatchingThread {
+public:
+    // the matching thread is pinned to the engine's cpu, if it has one, and the ingress queue is placed on its node
+    MatchingThread(Engine &engine, size_t ingress_capacity = 1 << 16, size_t batch_size = 64);
+    ~MatchingThread();
+
+    MatchingThread(const MatchingThread &) = delete;
+    MatchingThread &operator=(const MatchingThread &) = delete;
+
+    // creates a response ring and returns the producer id to submit with, only before start().
+    // producer_cpu, if given, is where the producer runs, its ring is placed on that node
+    uint32_t registerProducer(size_t response_capacity = 1 << 12, int producer_cpu = -1);
+
+    // refreshed once per drained batch so every order in the batch shares one clock reading
+    void setBatchClock(CoarseClock &clock);
+
+    void start();
+
+    // processes every command submitted before the call, then joins the matching thread
+    void stop();
+
+    // returns false if the ingress queue is full. a producer that keeps failing must poll its
+    // acks, the matching thread waits for room on a full response ring. throws for an unregistered producer
+    bool submit(uint32_t producer_id, Command command);
+
+    // producer only, returns false if there is no ack waiting. throws for an unregistered producer
+    bool pollAck(uint32_t producer_id, CommandAck &ack);
+
+    inline uint64_t getProcessedCount() const { return processed.load(std::memory_order_relaxed); }
+    inline size_t getQueueDepth() const { return ingress->size(); }
+
+private:
+    void run();
+
+    // processes a batch and returns how many commands it held
+    size_t drainBatch(std::vector<Command> &batch);
+
+    Engine &engine;
+    int cpu; // the engine's
+    std::unique_ptr<MpscQueue<Command>> ingress;
+    std::vector<std::unique_ptr<SpscQueue<CommandAck>>> responses;
+    size_t batch_size;
+    CoarseClock *batch_clock;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> processed;
+};
+}
+
+#endif // QUANTA_TRADER_MATCHING_THREAD_H
@@ -3,7 +3,12 @@
 
 #include <cstdint>
 #include <chrono>
+#include <string>
+#include <ostream>
+#include <algorithm>
 #include <boost/intrusive/list.hpp>
+#include "cache_line.h"
+#include "clock.h"
 
 namespace QuantaTrader {
 
@@ -23,8 +28,14 @@ enum class OrderType : uint8_t {
     STOP_LIMIT = 3, // sell or buy once the price reaches a specified stop level, 
                     // then execute a limit order at a specified price
     TRAILING_STOP = 4, // a stop order that moves with the market price to lock in profits
-    TRAILING_STOP_LIMIT = 5 // a trailing stop order that triggers a limit order instead of 
-                            // a market order when the stop level is reached.
+    TRAILING_STOP_LIMIT = 5, // a trailing stop order that triggers a limit order instead of 
+                             // a market order when the stop level is reached.
+    ICEBERG = 6, // a limit order that displays at most its peak quantity, the hidden reserve
+                 // replenishes the peak each time it fills
+    PEG_PRIMARY = 7, // non displayed, priced at the same side's best price less an offset
+    PEG_MIDPOINT = 8, // non displayed, priced at the midpoint of the best prices less an offset
+    PEG_MARKET = 9 // non displayed, priced at the opposite side's best price less an offset,
+                   // never crossing it
 };
 
 enum class OrderTimeInForce : uint8_t {
@@ -34,44 +45,163 @@ enum class OrderTimeInForce : uint8_t {
     FOK = 3 // Fill Or Kill (Must be executed fully and immediately or is canceled)
 };
 
-struct Order : public list_base_hook<> {
+// what the matching sweep does when an incoming order meets a resting order of the same owner, taken from
+// the incoming order. orders without an owner never trigger it. all or none and fill or kill orders check
+// their liquidity with their own orders counted, so prevention can leave them partly filled. resting all or
+// none orders of the owner are skipped rather than cancelled, and auctions uncross without prevention
+enum class SelfTradePrevention : uint8_t {
+    NONE = 0, // the orders trade
+    CANCEL_NEWEST = 1, // the rest of the incoming order is cancelled
+    CANCEL_OLDEST = 2, // the resting order is cancelled and matching goes on
+    CANCEL_BOTH = 3, // both orders are cancelled
+    DECREMENT = 4 // both orders lose the smaller open quantity without trading, an order left with none is cancelled
+};
+
+std::string typeToString(OrderType type);
+std::string sideToString(OrderSide side);
+std::string timeInForceToString(OrderTimeInForce time_in_force);
+
+// fields read by the matching sweep. a resting order keeps them in the record its level links,
+// so walking a level only touches one cache line per order
+struct OrderHot {
+    uint64_t id;  // Unique identifier for the order
+    uint64_t price;  // Price
+    uint64_t open_quantity;  // Open quantity
+    uint64_t visible_quantity;  // Quantity displayed in the level, below open quantity only for a resting iceberg
+    uint32_t symbol_id;  // Symbol identifier
+    uint32_t owner_id;  // Session or account that sent the order, 0 if none
+    uint32_t slot;  // Slot of the cold fields in the book's order table while the order rests, unused otherwise
+    OrderType type;  // Type of the order
+    OrderSide side;  // Side of the order
+    OrderTimeInForce time_in_force;  // Time in force for the order
+    SelfTradePrevention self_trade_prevention;  // Applied when the order trades against its own owner
+};
+
+// fields only written when an order fills and read when reporting. a resting order keeps them in
+// the book's cold store, apart from the hot record
+struct OrderCold {
+    uint64_t quantity;  // Quantity of the order
+    uint64_t executed_quantity;  // Executed quantity
+    uint64_t stop_price;  // Stop price
+    uint64_t trail_amount; // Amount the trailing stop price trails behind the market price
+    uint64_t peak_quantity;  // Most quantity displayed at once, the whole quantity unless the order is an iceberg
+    uint64_t peg_offset;  // Distance of a pegged order from its reference price, away from the opposite side
+    uint64_t last_executed_price;  // Price at which the last portion of the order was executed
+    uint64_t last_executed_quantity;  // Quantity of the last portion of the order that was executed
+    Timestamp timestamp;  // Time the order was placed, nanoseconds since epoch
+    uint64_t queue_entry;  // Cumulative level quantity enqueued ahead of the order when it joined the level
+    uint32_t queue_slot;  // Position of the order in its level's enqueue sequence
+};
+
+// getters and book side changes of an order, over the hot and cold fields Parts hands out. an order
+// holds both, a resting order is split between its hot record and the book's cold store
+template <typename Parts>
+class OrderFields {
+public:
+    inline uint64_t getId() const { return hot().id; }
+    inline OrderType getType() const { return hot().type; }
+    inline OrderSide getSide() const { return hot().side; }
+    inline OrderTimeInForce getTimeInForce() const { return hot().time_in_force; }
+    inline uint32_t getSymbolId() const { return hot().symbol_id; }
+    inline uint32_t getOwnerId() const { return hot().owner_id; }
+    inline SelfTradePrevention getSelfTradePrevention() const { return hot().self_trade_prevention; }
+    inline uint64_t getPrice() const { return hot().price; }
+    inline uint64_t getStopPrice() const { return cold().stop_price; }
+    inline uint64_t getLastExecutedPrice() const { return cold().last_executed_price; }
+    inline uint64_t getTrailAmount() const { return cold().trail_amount; }
+    inline uint64_t getQuantity() const { return cold().quantity; }
+    inline uint64_t getExecutedQuantity() const { return cold().executed_quantity; }
+    inline uint64_t getOpenQuantity() const { return hot().open_quantity; }
+    inline uint64_t getVisibleQuantity() const { return hot().visible_quantity; }
+    inline uint64_t getPeakQuantity() const { return cold().peak_quantity; }
+    inline uint64_t getPegOffset() const { return cold().peg_offset; }
+    inline bool isPegged() const { return hot().type >= OrderType::PEG_PRIMARY && hot().type <= OrderType::PEG_MARKET; }
+    inline uint64_t getLastExecutedQuantity() const { return cold().last_executed_quantity; }
+    inline Timestamp getTimestamp() const { return cold().timestamp; }
+
+    friend class PriceLevelOrderBook;
+    friend class Level;
+
+private:
+    inline void setId(uint64_t id) { hot().id = id; }
+    inline void setType(OrderType type) { hot().type = type; }
+    inline void setTimeInForce(OrderTimeInForce time_in_force) { hot().time_in_force = time_in_force; }
+    inline void setPrice(uint64_t price) { hot().price = price; }
+    inline void setStopPrice(uint64_t stop_price) { cold().stop_price = stop_price; }
+    inline void setTrailAmount(uint64_t trail_amount) { cold().trail_amount = trail_amount; }
+
+    void setQuantity(uint64_t quantity_) {
+        cold().quantity = std::min(quantity_, hot().open_quantity);
+        hot().open_quantity = quantity_;
+        // an iceberg gives up its hidden reserve first
+        hot().visible_quantity = hot().type == OrderType::ICEBERG ? std::min(hot().visible_quantity, quantity_) : quantity_;
+    }
+
+    // shows a fresh peak, the whole open quantity for anything but an iceberg
+    void replenish() {
+        hot().visible_quantity = std::min(cold().peak_quantity, hot().open_quantity);
+    }
+
+    // takes quantity off the order without a fill, from the displayed part first like a fill would
+    void decrement(uint64_t quantity_) {
+        hot().open_quantity -= quantity_;
+        hot().visible_quantity -= std::min(hot().visible_quantity, quantity_);
+    }
+
+    void execute(uint64_t price_, uint64_t quantity_) {
+        hot().open_quantity -= quantity_;
+        hot().visible_quantity -= std::min(hot().visible_quantity, quantity_);
+        cold().executed_quantity += quantity_;
+        cold().last_executed_price = price_;
+        cold().last_executed_quantity = quantity_;
+    }
+
+    const OrderHot &hot() const { return static_cast<const Parts &>(*this).hotFields(); }
+    OrderHot &hot() { return static_cast<Parts &>(*this).hotFields(); }
+    const OrderCold &cold() const { return static_cast<const Parts &>(*this).coldFields(); }
+    OrderCold &cold() { return static_cast<Parts &>(*this).coldFields(); }
+};
+
+class OrderRef;
+
+struct Order : public OrderFields<Order> {
 public:
-    static Order marketSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t quantity, OrderTimeInForce time_in_force);
-    static Order marketBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t quantity, OrderTimeInForce time_in_force);
-
-    static Order limitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t quantity, OrderTimeInForce time_in_force);
-    static Order limitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t quantity, OrderTimeInForce time_in_force);
-
-    static Order stopSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force);
-    static Order stopBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force);
-
-    static Order stopLimitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force);
-    static Order stopLimitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force);
-
-    static Order trailingStopSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force);
-    static Order trailingStopBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force);
-
-    static Order trailingStopLimitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force);
-    static Order trailingStopLimitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force);
-
-    inline uint64_t getId() const { return id; }
-    inline OrderType getType() const { return type; }
-    inline OrderSide getSide() const { return side; }
-    inline OrderTimeInForce getTimeInForce() const { return time_in_force; }
-    inline uint32_t getSymbolId() const { return symbol_id; }
-    inline uint64_t getPrice() const { return price; }
-    inline uint64_t getStopPrice() const { return stop_price; }
-    inline uint64_t getLastExecutedPrice() const { return last_executed_price; }
-    inline uint64_t getTrailAmount() const { return trail_amount; }
-    inline uint64_t getQuantity() const { return quantity; }
-    inline uint64_t getExecutedQuantity() const { return executed_quantity; }
-    inline uint64_t getOpenQuantity() const { return open_quantity; }
-    inline uint64_t getLastExecutedQuantity() const { return last_executed_quantity; }
-    inline std::chrono::time_point<std::chrono::system_clock> getTimestamp() const { return timestamp; }
+    // the factories stamp the order with clock, pass a cheaper or deterministic clock to avoid the system call
+    static Order marketSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order marketBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    static Order limitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order limitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    // limit orders showing at most peak_quantity of quantity in the book
+    static Order icebergSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t peak_quantity, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order icebergBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t peak_quantity, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    // pegged orders store an offset instead of a price, the book prices them from its best prices when matching
+    static Order primaryPegSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order primaryPegBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    static Order midpointPegSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order midpointPegBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    static Order marketPegSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order marketPegBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    static Order stopSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order stopBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    static Order stopLimitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order stopLimitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    static Order trailingStopSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order trailingStopBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+
+    static Order trailingStopLimitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
+    static Order trailingStopLimitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock = Clock::defaultClock());
 
     bool operator==(const Order &other) const
     {
-        return id == other.id;
+        return hot.id == other.hot.id;
     }
 
     bool operator!=(const Order &other) const
@@ -79,51 +209,89 @@ public:
         return !(*this == other);
     }
 
+    // tags the order with the session or account sending it, before it is submitted
+    Order &withOwner(uint32_t owner_id) {
+        hot.owner_id = owner_id;
+        return *this;
+    }
+
+    Order &withSelfTradePrevention(SelfTradePrevention self_trade_prevention) {
+        hot.self_trade_prevention = self_trade_prevention;
+        return *this;
+    }
+
     std::string toString() const;
     Order() = default; // default constructor
     // declaring friends so the private section can be accessed
     friend std::ostream &operator<<(std::ostream &os, const Order &order);
+    friend class OrderFields<Order>;
+    friend class OrderRef;
     friend class PriceLevelOrderBook;
     friend class Level;
 
 private:
     Order(uint64_t id, OrderType type, OrderSide side, OrderTimeInForce time_in_force, uint32_t symbol_id, uint64_t price, uint64_t stop_price, 
-        uint64_t trail_amount, uint64_t quantity, std::chrono::time_point<std::chrono::system_clock> timestamp);
+        uint64_t trail_amount, uint64_t quantity, Timestamp timestamp);
 
-    inline void setId(uint64_t id) { this->id = id; }
-    inline void setType(OrderType type) { this->type = type; }
-    inline void setTimeInForce(OrderTimeInForce time_in_force) { this->time_in_force = time_in_force; }
-    inline void setPrice(uint64_t price) { this->price = price; }
-    inline void setStopPrice(uint64_t stop_price) { this->stop_price = stop_price; }
-    inline void setTrailAmount(uint64_t trail_amount) { this->trail_amount = trail_amount; }
+    // puts a resting order back together
+    Order(const OrderHot &hot, const OrderCold &cold) : hot(hot), cold(cold) {}
 
-    void setQuantity(uint64_t quantity_) {
-        quantity = std::min(quantity_, open_quantity);
-        open_quantity = quantity_;
-    }
+    const OrderHot &hotFields() const { return hot; }
+    OrderHot &hotFields() { return hot; }
+    const OrderCold &coldFields() const { return cold; }
+    OrderCold &coldFields() { return cold; }
+
+    OrderHot hot;
+    OrderCold cold;
+};
+
+// the record a level links for a resting order, the hook and the hot fields fill one cache line.
+// only the hot getters compile on it, the rest of the order is in the book's cold store at hot.slot
+struct alignas(CACHE_LINE_SIZE) RestingOrder : public list_base_hook<>, public OrderFields<RestingOrder> {
+    explicit RestingOrder(const OrderHot &hot) : hot(hot) {}
+
+    inline uint32_t getSlot() const { return hot.slot; }
+    inline void setSlot(uint32_t slot) { hot.slot = slot; }
 
-    void execute(uint32_t price_, uint64_t quantity_) {
-        open_quantity -= quantity_;
-        executed_quantity += quantity_;
-        last_executed_price = price_;
-        last_executed_quantity = quantity_;
+    friend class OrderFields<RestingOrder>;
+    friend class OrderRef;
+    friend class PriceLevelOrderBook;
+
+private:
+    const OrderHot &hotFields() const { return hot; }
+    OrderHot &hotFields() { return hot; }
+
+    OrderHot hot;
+};
+
+// an order's hot and cold fields wherever they are kept, so a fill or a cancel changes an incoming
+// order and a resting one alike
+class OrderRef : public OrderFields<OrderRef> {
+public:
+    OrderRef(Order &order) : hot(order.hot), cold(order.cold) {}
+    OrderRef(RestingOrder &order, OrderCold &cold) : hot(order.hot), cold(cold) {}
+
+    // a copy of the whole order, for an event
+    Order toOrder() const {
+        return Order(hot, cold);
     }
 
-    uint64_t id;  // Unique identifier for the order
-    OrderType type;  // Type of the order
-    OrderSide side;  // Side of the order
-    OrderTimeInForce time_in_force;  // Time in force for the order
-    uint32_t symbol_id;  // Symbol identifier
-    uint64_t price;  // Price
-    uint64_t stop_price;  // Stop price
-    uint64_t trail_amount; // Amount the trailing stop price trails behind the market price
-    uint64_t last_executed_price;  // Price at which the last portion of the order was executed
-    uint64_t quantity;  // Quantity of the order
-    uint64_t executed_quantity;  // Executed quantity
-    uint64_t open_quantity;  // Open quantity
-    uint64_t last_executed_quantity;  // Quantity of the last portion of the order that was executed
-    std::chrono::time_point<std::chrono::system_clock> timestamp;  // Time the order was placed
+    friend class OrderFields<OrderRef>;
+
+private:
+    const OrderHot &hotFields() const { return hot; }
+    OrderHot &hotFields() { return hot; }
+    const OrderCold &coldFields() const { return cold; }
+    OrderCold &coldFields() { return cold; }
+
+    OrderHot &hot;
+    OrderCold &cold;
 };
+
+// lock in the hot record: the hot fields without padding, and with the list hook exactly one cache line
+static_assert(sizeof(OrderHot) == 48, "unexpected padding in the hot order fields");
+static_assert(sizeof(RestingOrder) == CACHE_LINE_SIZE, "a resting order's hot record must fill one cache line");
+static_assert(alignof(RestingOrder) == CACHE_LINE_SIZE, "a resting order's hot record must start on a cache line");
 }
 
 #endif // QUANTA_TRADER_ORDER_H
\ No newline at end of file
@@ -1,20 +1,56 @@
 #ifndef QUANTA_TRADER_ORDER_BOOK_H
 #define QUANTA_TRADER_ORDER_BOOK_H
+#include <vector>
 #include "order.h"
+#include "book_export.h"
+#include "event.h"
+#include "event_sequencer.h"
+#include "order_router.h"
 
 namespace QuantaTrader {
 
+// open interest of one owner, notional only counts orders with a limit price
+struct OwnerExposure {
+    size_t order_count;
+    uint64_t buy_quantity;
+    uint64_t sell_quantity;
+    uint64_t buy_notional;
+    uint64_t sell_notional;
+};
+
 class OrderBook {
 public:
     // return the symbol id of the book
     virtual uint32_t getSymbolId() const = 0;
 
-    // Adds an order to the order book
-    virtual void addOrder(Order order) = 0;
+    // Adds an order to the order book, returns false if the book turned it away. a market order sent while the
+    // book is in auction mode is rejected with RejectReason::AUCTION
+    virtual bool addOrder(Order order) = 0;
     
-    // Removes an order from the order book
+    // Removes an order from the order book. this and every other call naming a resting order by id
+    // throws std::runtime_error if the book has no such order, it may have filled or been cancelled already
     virtual void deleteOrder(uint64_t order_id) = 0;
     
+    // Mass cancels, each returns the number of orders removed from the book
+
+    // Removes every resting order, stop orders included
+    virtual size_t cancelAllOrders() = 0;
+
+    // Removes every resting order of a side, stop orders included
+    virtual size_t cancelSideOrders(OrderSide side) = 0;
+
+    // Removes the limit and iceberg orders of a side resting at prices in [low, high]
+    virtual size_t cancelPriceRange(OrderSide side, uint64_t low, uint64_t high) = 0;
+
+    // Removes every resting order of an owner
+    virtual size_t cancelOwnerOrders(uint32_t owner_id) = 0;
+    
+    // Ids of the owner's resting orders, in the order they joined the book
+    virtual std::vector<uint64_t> getOwnerOrderIds(uint32_t owner_id) const = 0;
+
+    // Open quantity and notional of the owner's resting orders
+    virtual OwnerExposure getOwnerExposure(uint32_t owner_id) const = 0;
+
     // Modifies an existing order in the order book
     virtual void modifyOrder(uint64_t order_id, uint64_t new_order_id, uint64_t new_price) = 0;
 
@@ -39,13 +75,52 @@ public:
     // Whether the book has this order
     virtual bool hasOrder(uint64_t order_id) const = 0;
 
-    // Gets an order from the book
-    virtual const Order &getOrder(uint64_t order_id) const = 0;
+    // Gets a copy of an order from the book, a resting order is kept in two parts
+    virtual Order getOrder(uint64_t order_id) const = 0;
+
+    // Number of orders resting at a price level on a side, 0 if there is no such level
+    virtual size_t getLevelOrderCount(OrderSide side, uint64_t price) const = 0;
+
+    // Open quantity resting ahead of an order in its level's queue, the order must be in the book
+    virtual uint64_t getQueuePosition(uint64_t order_id) const = 0;
+
+    // Switches the book to auction mode, orders rest without matching until uncross(). market orders
+    // are rejected meanwhile
+    virtual void startAuction() = 0;
+
+    // Executes the crossed part of the book at the price maximising the executed volume and
+    // returns the book to continuous matching
+    virtual void uncross() = 0;
+
+    // Whether the book is in auction mode
+    virtual bool inAuction() const = 0;
 
     // Whether the book is empty or not
     virtual bool empty() const = 0;
 
-    // Exports the book to a specified path in txt format
+    // Numbers the book's events in sequencer's stream from now on, nullptr leaves them unsequenced.
+    // the symbol sequence carries on whatever the stream
+    virtual void setSequencer(EventSequencer *sequencer) = 0;
+
+    // Emits OrderRejected for an order turned away before it reached the book, numbered in the book's stream
+    virtual void rejectOrder(const Order &order, RejectReason reason) = 0;
+
+    // Routes the book's resting orders through router from now on, unrouting them from the previous one.
+    // nullptr stops routing
+    virtual void setRouter(OrderRouter *router) = 0;
+
+    // Symbol sequence of the book's last event, it moves with every change to the book
+    virtual uint64_t getSymbolSequence() const = 0;
+
+    // Appends the book's records to an export, see book_export.h
+    virtual void exportBinary(ExportBuffer &buffer) const = 0;
+
+    // Appends the book's records like exportBinary, except that a level unchanged since the last capture
+    // is written as its level record alone, flagged EXPORT_LEVEL_UNCHANGED. full writes every level whole.
+    // either way the levels count as captured afterwards
+    virtual void captureChanges(ExportBuffer &buffer, bool full) = 0;
+
+    // Exports the book to a specified path in binary format, render_export prints it as text
     virtual void exportOrderBook(const std::string &path) const = 0;
 
     virtual std::string toString() const = 0;
@@ -0,0 +1,66 @@
+#ifndef QUANTA_TRADER_ORDER_ROUTER_H
+#define QUANTA_TRADER_ORDER_ROUTER_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "robin_hood.h"
+#include "spin_lock.h"
+
+namespace QuantaTrader {
+
+// symbol of every resting order by order id, so cancels and modifies can name the order alone.
+// the books keep it exact, an order is routed when it comes to rest and unrouted when it leaves.
+// ids index a ring of words directly, each holding the id's high bits and the symbol, so a lookup is one
+// load and routes are added and removed with a compare and swap from any number of matching threads.
+// an id whose word is taken by an order still resting capacity ids apart goes to a locked overflow map.
+// ids must be unique across the symbols sharing a router, and are told apart up to 2^32 times the capacity
+class OrderRouter {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = size_t(1) << 20;
+
+    // capacity is rounded up to a power of 2
+    explicit OrderRouter(size_t capacity = DEFAULT_CAPACITY);
+
+    OrderRouter(const OrderRouter &) = delete;
+    OrderRouter &operator=(const OrderRouter &) = delete;
+
+    void add(uint64_t order_id, uint32_t symbol_id);
+    void remove(uint64_t order_id, uint32_t symbol_id);
+
+    // false if no resting order has the id
+    bool find(uint64_t order_id, uint32_t &symbol_id) const {
+        uint64_t word = words[order_id & mask].load(std::memory_order_acquire);
+        if ((word >> 32) == tag(order_id)) {
+            symbol_id = static_cast<uint32_t>(word);
+            return true;
+        }
+        return overflowed.load(std::memory_order_acquire) != 0 && findOverflow(order_id, symbol_id);
+    }
+
+    // orders routed through the overflow map, a steady count well above 0 asks for a larger capacity
+    size_t getOverflowCount() const {
+        return overflowed.load(std::memory_order_relaxed);
+    }
+
+private:
+    // high bits of the id, offset by 1 so a taken word is never 0
+    uint64_t tag(uint64_t order_id) const {
+        return ((order_id >> shift) + 1) & 0xffffffff;
+    }
+
+    uint64_t pack(uint64_t order_id, uint32_t symbol_id) const {
+        return (tag(order_id) << 32) | symbol_id;
+    }
+
+    bool findOverflow(uint64_t order_id, uint32_t &symbol_id) const;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    uint64_t mask;
+    uint32_t shift;
+    std::atomic<size_t> overflowed;
+    mutable SpinLock overflow_lock;
+    robin_hood::unordered_flat_map<uint64_t, uint32_t> overflow;
+};
+}
+
+#endif // QUANTA_TRADER_ORDER_ROUTER_H
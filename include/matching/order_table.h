@@ -0,0 +1,318 @@
+#ifndef QUANTA_TRADER_ORDER_TABLE_H
+#define QUANTA_TRADER_ORDER_TABLE_H
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+#include "robin_hood.h"
+#include "huge_page_arena.h"
+
+namespace QuantaTrader {
+
+// a book's resting orders by id, for ids handed out densely and in increasing order.
+// ids are split into pages of PAGE_SLOTS, the directory entry of a page is (id >> PAGE_BITS) - first_page,
+// so a lookup is two array indexes instead of a hash probe. a page is recycled once its last order leaves
+// and the directory drops the empty pages at its front as ids move on. an id too far above the directory
+// slides it up, the orders still resting on the pages left behind move to a hash map.
+// ids pages would hold poorly, below the directory or so sparse that a new page would mostly stay empty,
+// go to the hash map as well. entries do not move for as long as they are in the table.
+// each entry has a cold record in a parallel store, at the slot the table gives the entry, so the entries
+// stay small and the cold records are only touched once an entry is found. T reports its id with getId()
+// and keeps its slot with getSlot() and setSlot().
+// entries, cold records and pages come from the arena if there is one
+template <typename T, typename Cold>
+class OrderTable {
+public:
+    using value_type = T;
+    using iterator = value_type *;
+
+    static constexpr uint64_t PAGE_BITS = 9;
+    static constexpr uint64_t PAGE_SLOTS = uint64_t(1) << PAGE_BITS;
+    // furthest a page can be from the directory's first, past it the directory slides up
+    static constexpr uint64_t MAX_PAGES = uint64_t(1) << 14;
+    // pages are mapped freely up to this many, past it only while they stay 1 / SPARSENESS full on average
+    static constexpr uint64_t MIN_PAGES = 4;
+    static constexpr uint64_t SPARSENESS = 16;
+    static constexpr size_t SPARE_PAGES = 4;
+    static constexpr size_t CHUNK_ENTRIES = 256;
+
+    explicit OrderTable(HugePageArena *arena = nullptr) : arena(arena) {}
+
+    OrderTable(const OrderTable &) = delete;
+    OrderTable &operator=(const OrderTable &) = delete;
+
+    ~OrderTable() {
+        forEach([this](value_type &entry) {
+            cold(entry).~Cold();
+            entry.~value_type();
+        });
+        for (Page *page : directory) {
+            if (page != nullptr) {
+                freePage(page);
+            }
+        }
+        for (Page *page : spare_pages) {
+            freePage(page);
+        }
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            arena.deallocate(chunks[i], CHUNK_ENTRIES);
+            cold_allocator().deallocate(cold_chunks[i], CHUNK_ENTRIES);
+        }
+    }
+
+    iterator find(uint64_t id) const {
+        // ids below the directory wrap around past its end
+        uint64_t index = (id >> PAGE_BITS) - first_page;
+        if (index < directory.size() && directory[index] != nullptr) {
+            value_type *entry = directory[index]->slots[id & (PAGE_SLOTS - 1)];
+            if (entry != nullptr) {
+                return entry;
+            }
+        }
+        if (fallback.empty()) {
+            return nullptr;
+        }
+        auto it = fallback.find(id);
+        return it == fallback.end() ? nullptr : it->second;
+    }
+
+    iterator end() const {
+        return nullptr;
+    }
+
+    // returns the entry of id and whether it was added, an entry already there is left as it is
+    std::pair<iterator, bool> emplace(uint64_t id, T value, Cold cold_record) {
+        iterator existing = find(id);
+        if (existing != nullptr) {
+            return {existing, false};
+        }
+        uint32_t slot = 0;
+        value_type *entry = new (allocate(slot)) value_type(std::move(value));
+        entry->setSlot(slot);
+        new (&coldAt(slot)) Cold(std::move(cold_record));
+        Page *page = mapPage(id);
+        if (page != nullptr) {
+            page->slots[id & (PAGE_SLOTS - 1)] = entry;
+            ++page->count;
+        } else {
+            fallback.emplace(id, entry);
+        }
+        ++entries;
+        return {entry, true};
+    }
+
+    void erase(iterator entry) {
+        uint64_t id = entry->getId();
+        uint64_t index = (id >> PAGE_BITS) - first_page;
+        if (index < directory.size() && directory[index] != nullptr && directory[index]->slots[id & (PAGE_SLOTS - 1)] == entry) {
+            Page &page = *directory[index];
+            page.slots[id & (PAGE_SLOTS - 1)] = nullptr;
+            if (--page.count == 0) {
+                releasePage(index);
+            }
+        } else {
+            fallback.erase(id);
+        }
+        uint32_t slot = entry->getSlot();
+        coldAt(slot).~Cold();
+        entry->~value_type();
+        Entry *freed = reinterpret_cast<Entry *>(entry);
+        freed->free = {free_entries, slot};
+        free_entries = freed;
+        --entries;
+    }
+
+    size_t erase(uint64_t id) {
+        iterator entry = find(id);
+        if (entry == nullptr) {
+            return 0;
+        }
+        erase(entry);
+        return 1;
+    }
+
+    // the cold record of an entry
+    Cold &cold(const value_type &entry) const {
+        return coldAt(entry.getSlot());
+    }
+
+    // calls visit(entry) for every entry, in no particular order
+    template <typename Visit>
+    void forEach(Visit visit) const {
+        for (Page *page : directory) {
+            if (page != nullptr) {
+                for (value_type *entry : page->slots) {
+                    if (entry != nullptr) {
+                        visit(*entry);
+                    }
+                }
+            }
+        }
+        for (const auto &[id, entry] : fallback) {
+            visit(*entry);
+        }
+    }
+
+    size_t size() const {
+        return entries;
+    }
+
+    bool empty() const {
+        return entries == 0;
+    }
+
+    // entries kept in the hash map rather than on pages
+    size_t getFallbackCount() const {
+        return fallback.size();
+    }
+
+private:
+    struct Page {
+        value_type *slots[PAGE_SLOTS] = {};
+        uint64_t count = 0;
+    };
+
+    // storage of one entry, chained to the next free one while unused
+    union Entry {
+        struct {
+            Entry *next;
+            uint32_t slot;
+        } free;
+        value_type value;
+
+        Entry() : free{nullptr, 0} {}
+        ~Entry() {}
+    };
+
+    // storage for an entry, its cold record is at slot
+    value_type *allocate(uint32_t &slot) {
+        if (free_entries == nullptr) {
+            uint32_t first_slot = static_cast<uint32_t>(chunks.size() * CHUNK_ENTRIES);
+            Entry *chunk = arena.allocate(CHUNK_ENTRIES);
+            Cold *cold_chunk = cold_allocator().allocate(CHUNK_ENTRIES);
+            chunks.push_back(chunk);
+            cold_chunks.push_back(cold_chunk);
+            for (size_t i = CHUNK_ENTRIES; i-- > 0;) {
+                new (&chunk[i]) Entry();
+                chunk[i].free = {free_entries, first_slot + static_cast<uint32_t>(i)};
+                free_entries = &chunk[i];
+            }
+        }
+        Entry *entry = free_entries;
+        free_entries = entry->free.next;
+        slot = entry->free.slot;
+        return &entry->value;
+    }
+
+    Cold &coldAt(uint32_t slot) const {
+        return cold_chunks[slot / CHUNK_ENTRIES][slot % CHUNK_ENTRIES];
+    }
+
+    // the page for id, mapping it if pages should hold id, nullptr if the id belongs in the fallback
+    Page *mapPage(uint64_t id) {
+        uint64_t page_number = id >> PAGE_BITS;
+        if (directory.empty()) {
+            first_page = page_number;
+        }
+        if (page_number < first_page) {
+            return nullptr;
+        }
+        if (page_number - first_page >= MAX_PAGES) {
+            slide(page_number);
+        }
+        uint64_t index = page_number - first_page;
+        if (index < directory.size() && directory[index] != nullptr) {
+            return directory[index];
+        }
+        if (mapped_pages >= MIN_PAGES && (mapped_pages + 1) * PAGE_SLOTS > SPARSENESS * (paged_entries() + 1)) {
+            return nullptr;
+        }
+        if (index >= directory.size()) {
+            directory.resize(index + 1, nullptr);
+        }
+        if (spare_pages.empty()) {
+            directory[index] = new (page_allocator().allocate(1)) Page();
+        } else {
+            directory[index] = spare_pages.back();
+            spare_pages.pop_back();
+        }
+        ++mapped_pages;
+        return directory[index];
+    }
+
+    void releasePage(uint64_t index) {
+        recyclePage(directory[index]);
+        directory[index] = nullptr;
+        --mapped_pages;
+        if (index == 0) {
+            size_t empty_front = 0;
+            while (empty_front < directory.size() && directory[empty_front] == nullptr) {
+                ++empty_front;
+            }
+            directory.erase(directory.begin(), directory.begin() + static_cast<std::ptrdiff_t>(empty_front));
+            first_page += empty_front;
+        }
+    }
+
+    // moves the directory up so page_number is its last page. the orders left resting on the pages dropped
+    // from its front go to the fallback, they stay where they are
+    void slide(uint64_t page_number) {
+        uint64_t new_first = page_number - MAX_PAGES + 1;
+        size_t dropped = 0;
+        while (dropped < directory.size() && (first_page + dropped < new_first || directory[dropped] == nullptr)) {
+            Page *page = directory[dropped];
+            if (page != nullptr) {
+                for (value_type *entry : page->slots) {
+                    if (entry != nullptr) {
+                        fallback.emplace(entry->getId(), entry);
+                    }
+                }
+                *page = Page();
+                recyclePage(page);
+                --mapped_pages;
+            }
+            ++dropped;
+        }
+        directory.erase(directory.begin(), directory.begin() + static_cast<std::ptrdiff_t>(dropped));
+        first_page = directory.empty() ? page_number : first_page + dropped;
+    }
+
+    void recyclePage(Page *page) {
+        if (spare_pages.size() < SPARE_PAGES) {
+            spare_pages.push_back(page);
+        } else {
+            freePage(page);
+        }
+    }
+
+    ArenaAllocator<Cold> cold_allocator() const {
+        return ArenaAllocator<Cold>(arena.getArena());
+    }
+
+    ArenaAllocator<Page> page_allocator() const {
+        return ArenaAllocator<Page>(arena.getArena());
+    }
+
+    void freePage(Page *page) {
+        page->~Page();
+        page_allocator().deallocate(page, 1);
+    }
+
+    size_t paged_entries() const {
+        return entries - fallback.size();
+    }
+
+    ArenaAllocator<Entry> arena;
+    std::vector<Page *> directory;
+    uint64_t first_page = 0;
+    uint64_t mapped_pages = 0;
+    std::vector<Page *> spare_pages;
+    robin_hood::unordered_flat_map<uint64_t, value_type *> fallback;
+    std::vector<Entry *> chunks;
+    std::vector<Cold *> cold_chunks; // chunk i holds the cold records of the entries of chunks[i]
+    Entry *free_entries = nullptr;
+    size_t entries = 0;
+};
+}
+
+#endif // QUANTA_TRADER_ORDER_TABLE_H
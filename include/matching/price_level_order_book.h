@@ -2,31 +2,55 @@
 #define QUANTA_TRADER_PRICE_LEVEL_ORDER_BOOK_H
 #include <map>
 #include <limits>
+#include <stdexcept>
+#include <vector>
 #include "level.h"
 #include "order_book.h"
 #include "robin_hood.h"
 #include "order.h"
+#include "order_table.h"
 #include "event_handler.h"
 
 namespace QuantaTrader {
 
-struct OrderWithLevelIterator {
-    Order order;
-    std::map<uint64_t, Level>::iterator level_it;
-};
+// (open quantity, order id) : resting all or none order
+using AonSizeMap = std::map<std::pair<uint64_t, uint64_t>, RestingOrder *, std::less<std::pair<uint64_t, uint64_t>>,
+    ArenaAllocator<std::pair<const std::pair<uint64_t, uint64_t>, RestingOrder *>>>;
 
 class PriceLevelOrderBook : public OrderBook {
 public:
-    PriceLevelOrderBook(uint32_t symbol_id, EventHandler &event_handler);
+    // sequencer, if given, numbers the book's events and must outlive the book or be replaced.
+    // arena, if given, holds the book's levels and orders and must outlive the book
+    PriceLevelOrderBook(uint32_t symbol_id, EventHandler &event_handler, Clock &clock, EventSequencer *sequencer = nullptr,
+        HugePageArena *arena = nullptr);
+
+    // levels point into the book's volume ladders
+    PriceLevelOrderBook(const PriceLevelOrderBook &) = delete;
+    PriceLevelOrderBook &operator=(const PriceLevelOrderBook &) = delete;
+
+    // unroutes the resting orders
+    ~PriceLevelOrderBook() override;
 
     uint32_t getSymbolId() const override {
         return symbol_id;
     }
 
-    void addOrder(Order order) override;
+    bool addOrder(Order order) override;
 
     void deleteOrder(uint64_t order_id) override;
 
+    size_t cancelAllOrders() override;
+
+    size_t cancelSideOrders(OrderSide side) override;
+
+    size_t cancelPriceRange(OrderSide side, uint64_t low, uint64_t high) override;
+
+    size_t cancelOwnerOrders(uint32_t owner_id) override;
+
+    std::vector<uint64_t> getOwnerOrderIds(uint32_t owner_id) const override;
+
+    OwnerExposure getOwnerExposure(uint32_t owner_id) const override;
+
     void modifyOrder(uint64_t order_id, uint64_t new_order_id, uint64_t new_price) override;
 
     void cancelOrder(uint64_t order_id, uint64_t quantity) override;
@@ -61,14 +85,51 @@ public:
         return orders.find(order_id) != orders.end();
     }
 
-    const Order &getOrder(uint64_t order_id) const override {
-        return orders.find(order_id)->second.order;
+    Order getOrder(uint64_t order_id) const override {
+        return toOrder(*findOrder(order_id));
+    }
+
+    size_t getLevelOrderCount(OrderSide side, uint64_t price) const override {
+        const LevelMap &levels = side == OrderSide::SELL ? sell_levels : buy_levels;
+        auto level_it = levels.find(price);
+        return level_it == levels.end() ? 0 : level_it->second.getOrderCount();
+    }
+
+    uint64_t getQueuePosition(uint64_t order_id) const override {
+        const RestingOrder &resting = *findOrder(order_id);
+        return orders.cold(resting).level_it->second.getQuantityAhead(resting);
     }
 
     bool empty() const override {
         return orders.empty();
     }
 
+    // resting orders the order table could not keep on its pages, they are found by a hash probe
+    size_t getFallbackOrderCount() const {
+        return orders.getFallbackCount();
+    }
+
+    void startAuction() override;
+
+    void uncross() override;
+
+    bool inAuction() const override {
+        return in_auction;
+    }
+
+    void setSequencer(EventSequencer *sequencer) override {
+        this->sequencer = sequencer;
+    }
+    void rejectOrder(const Order &order, RejectReason reason) override;
+    void setRouter(OrderRouter *router) override;
+    uint64_t getSymbolSequence() const override {
+        return symbol_sequence;
+    }
+
+    void exportBinary(ExportBuffer &buffer) const override;
+
+    void captureChanges(ExportBuffer &buffer, bool full) override;
+
     void exportOrderBook(const std::string &path) const override;
 
     std::string toString() const override;
@@ -77,6 +138,52 @@ public:
 protected:
     void deleteOrder(uint64_t order_id) const;
 
+    // the resting order, throws if the book has none with the id. a command can name an order that filled
+    // or was cancelled after the command was sent, so this is a rejection rather than a bug
+    RestingOrderTable::iterator findOrder(uint64_t order_id) const {
+        auto orders_it = orders.find(order_id);
+        if (orders_it == orders.end()) {
+            throw std::runtime_error("Order does not exist in the book");
+        }
+        return orders_it;
+    }
+
+    // both parts of a resting order, to change it
+    OrderRef resting(RestingOrder &order) const {
+        return OrderRef(order, orders.cold(order).cold);
+    }
+
+    // a copy of a resting order, for its events
+    Order toOrder(const RestingOrder &order) const {
+        return Order(order.hot, orders.cold(order).cold);
+    }
+
+    // puts the order in the order table and at the back of the level of level_it, and indexes it
+    RestingOrder &restOrder(const Order &order, LevelMap::iterator level_it);
+
+    // takes a resting order out of its level, its indexes and the book without emitting an event
+    void removeOrder(RestingOrderTable::iterator orders_it);
+
+    // an order came to rest: links it into its owner's list, owner 0 is not tracked, and routes it
+    void indexOrder(RestingOrder &order);
+
+    // an order is leaving the book
+    void unindexOrder(RestingOrder &order);
+
+    // removes the levels in [first, last) of levels whole, recording an OrderDeleted for each of their orders
+    void cancelLevels(LevelMap &levels, LevelMap::iterator first,
+        LevelMap::iterator last);
+
+    // cancels every resting order of side
+    void cancelSide(OrderSide side);
+
+    // sends the events of a mass cancel and activates stop orders once, returns the number of orders cancelled
+    size_t finishMassCancel();
+
+    // calls visit(levels, kind, side) for each level map of book in export order, book const or not
+    template <typename Book, typename Visit>
+    static void forEachLevelMap(Book &book, Visit visit);
+
     void addMarketOrder(Order &order);
 
     void addLimitOrder(Order &order);
@@ -84,6 +191,38 @@ protected:
     // helper function for addLimitOrder
     void insertLimitOrder(const Order &order);
 
+    // all or none orders rest apart from the regular levels so they never hold up the queue
+    void insertAonOrder(const Order &order);
+
+    // fills resting all or none orders that the incoming order can fill in full, best price first and only
+    // priced better than through, or at it as well if inclusive. a regular level at a price trades first
+    void matchAonOrders(Order &order, uint64_t through, bool inclusive);
+
+    // liquidity was added to side, fills the resting all or none orders of the other side that now can
+    void activateAonOrders(OrderSide side);
+
+    // removes a resting all or none order from the size index, before its open quantity changes
+    void unindexAonOrder(const RestingOrder &order);
+
+
+    // an arriving pegged order trades like a limit order at its current price, the rest of it rests by offset
+    void addPeggedOrder(Order &order);
+
+    // helper function for addPeggedOrder
+    void insertPeggedOrder(const Order &order);
+
+    // price a pegged order of side follows before its offset, false if the best prices it needs are missing
+    static bool pegReference(OrderType type, OrderSide side, uint64_t best_buy, uint64_t best_sell, uint64_t &reference);
+
+    // price a pegged order of side would have against the given best prices, false if its reference is missing
+    static bool pegPrice(OrderType type, OrderSide side, uint64_t offset, uint64_t best_buy, uint64_t best_sell, uint64_t &price);
+
+    // pegged volume resting on side that an incoming order limited to price would trade with
+    uint64_t crossingPegVolume(OrderSide side, uint64_t price, uint64_t best_buy, uint64_t best_sell) const;
+
+    // replaces level and price with the front pegged level of side if it crosses limit at a better price
+    void bestPeggedLevel(OrderSide side, uint64_t limit, uint64_t best_buy, uint64_t best_sell, Level *&level, uint64_t &price);
+
     void addStopOrder(Order &order);
 
     // helper function for addStopOrder
@@ -92,7 +231,7 @@ protected:
     void insertTrailingStopOrder(const Order &order);
 
     // calculates and sets the stop price of a trailing stop order
-    uint64_t calculateStopPrice(Order &order);
+    uint64_t calculateStopPrice(OrderRef order);
 
     // updates the price of trailing stop buy order
     void updateTrailingBuyStopOrders();
@@ -114,11 +253,89 @@ protected:
 
     void match(Order &order);
 
-    // helper function for match order
+    // fills the auction curves with the level prices in [low, high] ascending, the volume bid at or above
+    // each price and the volume offered at or below it
+    void buildAuctionCurves(uint64_t low, uint64_t high);
+
+    // index into the auction curves of the uncross price: most volume executed, then smallest imbalance,
+    // then closest to reference
+    size_t findEquilibrium(uint64_t reference) const;
+
+    // helper function for match order, checks the volume ladder of the opposite side
     [[nodiscard]] bool canMatchOrder(const Order &order) const;
 
-    // matches 2 orders at a particular price
-    void executeOrders(Order &sell, Order &buy, uint64_t executing_price);
+    // regular and pegged volume an order of side priced at price could trade against
+    uint64_t matchableVolume(OrderSide side, uint64_t price) const;
+
+    // applies the incoming order's self-trade prevention mode against a resting order of its owner
+    // at the front of level
+    void preventSelfTrade(Order &order, Level &level, RestingOrder &resting);
+
+    // adds a fill to the trade batch
+    void recordTrade(uint64_t aggressor_id, OrderSide aggressor_side, uint64_t passive_id, uint64_t price, uint64_t quantity,
+        bool auction = false);
+
+    // hands the trade batch and fill summaries to the event handler
+    void flushTrades();
+
+    // reads the clock once for a command coming into the book, every event and trade the command produces,
+    // stop activations and nested calls included, carries that one reading
+    class CommandTime {
+    public:
+        explicit CommandTime(PriceLevelOrderBook &book) : book(book) {
+            if (book.command_depth++ == 0) {
+                book.command_time = book.clock.now();
+            }
+        }
+        ~CommandTime() {
+            --book.command_depth;
+        }
+
+    private:
+        PriceLevelOrderBook &book;
+    };
+
+    // time of the command being processed
+    Timestamp eventTime() {
+        return command_depth != 0 ? command_time : clock.now();
+    }
+
+    // time and sequence numbers of the next event the book emits
+    EventStamp stamp() {
+        return stamp(eventTime());
+    }
+
+    EventStamp stamp(Timestamp timestamp) {
+        if (sequencer == nullptr) {
+            return EventStamp{timestamp, 0, ++symbol_sequence};
+        }
+        return EventStamp{timestamp, sequencer->next(), ++symbol_sequence, sequencer->getStream()};
+    }
+
+    // numbers a batch of events or trades just before it is handed over. batches are built while other
+    // events go out, numbering them on the way out keeps the stream in the order the handler sees it
+    template <typename E>
+    void sequenceBatch(std::vector<E> &batch) {
+        for (E &event : batch) {
+            EventStamp event_stamp = stamp(event.timestamp);
+            event.sequence = event_stamp.sequence;
+            event.symbol_sequence = event_stamp.symbol_sequence;
+            event.stream = event_stamp.stream;
+        }
+    }
+
+    // matches 2 orders at a particular price for at most max_quantity, returns the quantity that was executed
+    uint64_t executeOrders(OrderRef sell, OrderRef buy, uint64_t executing_price,
+        uint64_t max_quantity = std::numeric_limits<uint64_t>::max());
+
+    // takes the displayed quantity the resting order lost since visible_before off its level,
+    // and shows an iceberg's next peak once the current one has filled. the peak's OrderUpdated is
+    // left to the caller if replenished is given, the order id is added to it instead
+    void reduceRestingOrder(Level &level, RestingOrder &order, uint64_t visible_before,
+        std::vector<uint64_t> *replenished = nullptr);
+
+    // gives resting all or none orders a go at iceberg peaks shown since the last call
+    void activateReplenishedAonOrders();
 
     // returns the last traded buy price
     uint64_t lastTradedBuyPrice() const {
@@ -139,30 +356,104 @@ protected:
 
     EventHandler &event_handler;
 
+    // stamps the events emitted by the book, read once per command
+    Clock &clock;
+    Timestamp command_time;
+    uint32_t command_depth;
+
+    // stream the book's events are numbered in, nullptr if they are not
+    EventSequencer *sequencer;
+
+    // last number of the book's own stream
+    uint64_t symbol_sequence;
+
     // current price of the symbol
     uint64_t last_traded_price;
 
     uint64_t trailing_buy_price;
     uint64_t trailing_sell_price;
 
-    // using robin_hood unordered_map : https://github.com/martinus/robin-hood-hashing
-    // for availability of reverse traversal of the map, and better performance
-    // orderID: OrderWithLevelIterator
-    robin_hood::unordered_map<uint64_t, OrderWithLevelIterator> orders;
+    // levels, orders and ladders draw from it, nullptr for the heap
+    HugePageArena *arena;
+
+    // orderID: hot record the levels link, with the cold fields, level and owner hook in the table's
+    // cold store. indexed directly for dense ids, see order_table.h
+    RestingOrderTable orders;
 
     // both levels are sorted in ascending order, its the calling function's responsibility
     // to use the sell levels in descending and buy orders in ascending order
     // price : levels
-    std::map<uint64_t, Level> sell_levels;
-    std::map<uint64_t, Level> buy_levels;
+    LevelMap sell_levels;
+    LevelMap buy_levels;
+
+    // price : resting all or none levels, not part of the ladders as they cannot fill a fill or kill order
+    LevelMap aon_sell_levels;
+    LevelMap aon_buy_levels;
+
+    // (open quantity, order id) : resting all or none order, smallest first so the orders an incoming
+    // order could fill are a prefix and the common case of none is a single comparison
+    AonSizeMap aon_sell_sizes;
+    AonSizeMap aon_buy_sizes;
+
+    // offset : pegged levels, one map per peg type in PEG_PRIMARY order. a level's price is the offset, so
+    // the front level is the most aggressive whatever the best prices are and a move of the best prices costs
+    // nothing until a match prices the front levels
+    static constexpr size_t PEG_TYPES = 3;
+    LevelMap pegged_sell_levels[PEG_TYPES];
+    LevelMap pegged_buy_levels[PEG_TYPES];
+
+    // resting pegged volume by offset, for fill or kill checks
+    VolumeLadder pegged_sell_ladders[PEG_TYPES];
+    VolumeLadder pegged_buy_ladders[PEG_TYPES];
+
+    // orders only rest while the book is in auction mode
+    bool in_auction;
+
+    // reused between uncrosses
+    std::vector<uint64_t> auction_prices;
+    std::vector<uint64_t> auction_demand;
+    std::vector<uint64_t> auction_supply;
+    std::vector<OrderExecuted> auction_executions;
+    std::vector<uint64_t> auction_filled;
+    std::vector<uint64_t> auction_replenished;
+    // the two executions of a fill, reused between fills
+    std::vector<OrderExecuted> fill_executions;
+
+    // owner id : the owner's resting orders, a node map as the lists must not move
+    robin_hood::unordered_node_map<uint32_t, RestingOrderCold::OwnerList> owner_orders;
+    // order id : symbol of the engine's resting orders, nullptr if the engine does not route by id
+    OrderRouter *router;
+
+    // reused between mass cancels
+    std::vector<OrderDeleted> mass_cancelled;
+
+    // trades and fill summaries since the outermost match started, reused between batches
+    std::vector<Trade> trades;
+    std::vector<FillSummary> fill_summaries;
+    uint64_t next_trade_id;
+
+    // matches in progress, a fill can activate stop orders that match inside the outer match
+    uint32_t match_depth;
+
+    // ids of the all or none orders being filled, used as a stack as fills can match again inside a fill.
+    // reused between matches
+    std::vector<uint64_t> aon_candidates;
+
+    // an iceberg on the side showed a new peak that resting all or none orders have not been checked against
+    bool sell_replenished;
+    bool buy_replenished;
+
+    // cumulative resting volume by price of each side, for fill or kill checks
+    VolumeLadder sell_ladder;
+    VolumeLadder buy_ladder;
 
     // price : stop levels
-    std::map<uint64_t, Level> stop_sell_levels;
-    std::map<uint64_t, Level> stop_buy_levels;
+    LevelMap stop_sell_levels;
+    LevelMap stop_buy_levels;
     
     // price : trailing stop levels
-    std::map<uint64_t, Level> trailing_stop_sell_levels;
-    std::map<uint64_t, Level> trailing_stop_buy_levels;
+    LevelMap trailing_stop_sell_levels;
+    LevelMap trailing_stop_buy_levels;
 };
 }
 
@@ -0,0 +1,53 @@
+#ifndef QUANTA_TRADER_REBALANCE_POLICY_H
+#define QUANTA_TRADER_REBALANCE_POLICY_H
+#include <cstdint>
+#include <vector>
+
+namespace QuantaTrader {
+
+// load of one matching shard since the previous rebalance
+struct ShardLoad {
+    uint32_t shard_id;
+    uint64_t commands; // commands applied since the previous rebalance
+    uint64_t queue_depth; // commands waiting in the shard's ingress queue
+    uint64_t latency_ns; // moving average of the time between submission and application
+    uint32_t symbols; // books owned by the shard
+};
+
+// load of one symbol since the previous rebalance
+struct SymbolLoad {
+    uint32_t symbol_id;
+    uint32_t shard_id;
+    uint64_t commands;
+};
+
+// moves a symbol's book to another shard
+struct Migration {
+    uint32_t symbol_id;
+    uint32_t to_shard;
+};
+
+// decides which books to move between shards, called periodically with fresh load figures
+class RebalancePolicy {
+public:
+    virtual ~RebalancePolicy() = default;
+    virtual std::vector<Migration> plan(const std::vector<ShardLoad> &shards, const std::vector<SymbolLoad> &symbols) = 0;
+};
+
+// moves symbols from the busiest shard to the idlest one when their backlog or latency differ by
+// more than imbalance_ratio, never moves a symbol that carries most of its shard's load since that
+// would just move the hot spot
+class QueueDepthPolicy : public RebalancePolicy {
+public:
+    explicit QueueDepthPolicy(double imbalance_ratio = 2.0, uint64_t min_queue_depth = 64, uint32_t max_migrations = 1);
+
+    std::vector<Migration> plan(const std::vector<ShardLoad> &shards, const std::vector<SymbolLoad> &symbols) override;
+
+private:
+    double imbalance_ratio;
+    uint64_t min_queue_depth; // backlog below which a shard is never considered overloaded
+    uint32_t max_migrations; // per call
+};
+}
+
+#endif // QUANTA_TRADER_REBALANCE_POLICY_H
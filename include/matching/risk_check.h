@@ -0,0 +1,120 @@
+#ifndef QUANTA_TRADER_RISK_CHECK_H
+#define QUANTA_TRADER_RISK_CHECK_H
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "cache_line.h"
+#include "event.h"
+#include "event_handler.h"
+#include "order_book.h"
+
+namespace QuantaTrader {
+
+// pre-trade risk stage, consulted by the engine before an order reaches its book. the engine keeps
+// the stage's view of every order in step through the order hooks
+class RiskCheck {
+public:
+    virtual ~RiskCheck() = default;
+
+    // whether order may go to book, otherwise reason says why not. runs on the matching thread of the book
+    virtual bool check(const Order &order, const OrderBook &book, RejectReason &reason) = 0;
+
+    // the order entered its book
+    virtual void orderAdded(const Order &) {}
+
+    // the order filled its last executed quantity
+    virtual void orderExecuted(const Order &) {}
+
+    // the order left its book, its open quantity will not fill
+    virtual void orderDeleted(const Order &) {}
+
+    // a cancel is about to set the open quantity of the resting order to the one given
+    virtual void orderResized(const Order &, uint64_t) {}
+
+    // the order lost the given quantity of its open quantity without a fill
+    virtual void orderReduced(const Order &, uint64_t) {}
+};
+
+// limits of one account, the defaults switch a limit off
+struct RiskLimits {
+    uint64_t max_order_quantity = std::numeric_limits<uint64_t>::max();
+    uint64_t max_order_notional = std::numeric_limits<uint64_t>::max();
+    uint64_t max_open_quantity = std::numeric_limits<uint64_t>::max(); // both sides together
+    uint64_t max_position = std::numeric_limits<uint64_t>::max(); // net executed quantity either way, over all symbols
+};
+
+// flat per account limits and counters indexed by owner id, one cache line per account so a check is
+// a single line fetch. the counters are atomics so one instance can sit in front of every shard of a
+// ShardedEngine. a check and the counter updates it relies on are not one atomic step, orders of one
+// account accepted on different shards at the same time can overshoot a limit by what they add together
+class PreTradeRisk : public RiskCheck {
+public:
+    // owner ids below max_accounts are accounts, each starts out with limits. a limit order's price may be
+    // at most collar_bps through the last traded price, or the middle of the book before the first trade.
+    // 0 turns collars off
+    PreTradeRisk(uint32_t max_accounts, const RiskLimits &limits, uint32_t collar_bps);
+
+    // not synchronised with check, set limits before orders flow
+    void setLimits(uint32_t owner_id, const RiskLimits &limits);
+
+    // open quantity of the account's accepted orders on a side
+    uint64_t getOpenQuantity(uint32_t owner_id, OrderSide side) const;
+
+    // net executed quantity of the account, positive when long
+    int64_t getPosition(uint32_t owner_id) const;
+
+    bool check(const Order &order, const OrderBook &book, RejectReason &reason) override;
+    void orderAdded(const Order &order) override;
+    void orderExecuted(const Order &order) override;
+    void orderDeleted(const Order &order) override;
+    void orderResized(const Order &order, uint64_t open_quantity) override;
+    void orderReduced(const Order &order, uint64_t quantity) override;
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Account {
+        RiskLimits limits;
+        std::atomic<uint64_t> open_buy_quantity{0};
+        std::atomic<uint64_t> open_sell_quantity{0};
+        std::atomic<int64_t> position{0};
+    };
+    static_assert(sizeof(Account) == CACHE_LINE_SIZE, "an account must fit in one cache line");
+
+    // last traded price, or the middle of the book before the first trade, 0 if there is neither
+    static uint64_t referencePrice(const OrderBook &book);
+
+    std::atomic<uint64_t> &openQuantity(Account &account, OrderSide side) {
+        return side == OrderSide::SELL ? account.open_sell_quantity : account.open_buy_quantity;
+    }
+
+    std::unique_ptr<Account[]> accounts;
+    uint32_t account_count;
+    uint32_t collar_bps;
+};
+
+// passes every event on to handler and keeps risk_check in step with the orders they describe. a triggered
+// stop is reported to it as deleted and then added again as the market or limit order it turns into
+class RiskEventHandler : public EventHandler {
+public:
+    RiskEventHandler(std::unique_ptr<EventHandler> handler, RiskCheck &risk_check);
+
+    void handleOrderAdded(const OrderAdded &event) override;
+    void handleOrderDeleted(const OrderDeleted &event) override;
+    void handleOrderUpdated(const OrderUpdated &event) override;
+    void handleOrderExecuted(const OrderExecuted &event) override;
+    void handleOrderRejected(const OrderRejected &event) override;
+    void handleSelfTradePrevented(const SelfTradePrevented &event) override;
+    void handleSymbolAdded(const SymbolAdded &event) override;
+    void handleSymbolDeleted(const SymbolDeleted &event) override;
+    void handleAuctionUncrossed(const AuctionUncrossed &event) override;
+    void handleOrderExecutedBatch(const std::vector<OrderExecuted> &events) override;
+    void handleOrderDeletedBatch(const std::vector<OrderDeleted> &events) override;
+    void handleTrades(const std::vector<Trade> &trades, const std::vector<FillSummary> &summaries) override;
+
+private:
+    std::unique_ptr<EventHandler> handler;
+    RiskCheck &risk_check;
+};
+}
+
+#endif // QUANTA_TRADER_RISK_CHECK_H
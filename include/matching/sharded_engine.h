@@ -0,0 +1,209 @@
+#ifndef QUANTA_TRADER_SHARDED_ENGINE_H
+#define QUANTA_TRADER_SHARDED_ENGINE_H
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "robin_hood.h"
+#include "order_book.h"
+#include "order_router.h"
+#include "huge_page_arena.h"
+#include "event_handler.h"
+#include "event_sequencer.h"
+#include "clock.h"
+#include "command.h"
+#include "mpsc_queue.h"
+#include "rebalance_policy.h"
+#include "risk_check.h"
+
+namespace QuantaTrader {
+
+// where a shard runs and how much of its work crosses NUMA nodes
+struct ShardNumaStats {
+    int cpu; // the shard's thread is pinned to it, -1 if not pinned
+    int node; // node of that cpu, -1 if unknown
+    uint64_t remote_commands; // applied for producers registered on another node
+    uint32_t remote_books; // books on the shard whose levels and orders live in another node's arena, after migrations
+    size_t arena_bytes; // mapped by the shard's arena
+    size_t arena_bound_bytes; // of those, bound to the shard's node
+};
+
+// matching engine whose books are pinned to shards, one matching thread per shard.
+// commands are routed to the shard that owns the symbol. a rebalance policy looks at per shard
+// backlog and latency and migrates books between shards while the engine runs: only the migrating
+// symbol is held back, its commands are parked until the book reaches the new shard and then
+// replayed there in submission order, so nothing is lost or reordered.
+// books on different shards are matched concurrently, so the event handler, clock and risk check
+// must be safe to call from several threads
+class ShardedEngine {
+public:
+    // risk_check, if given, vets every order on its shard before it reaches the book and must outlive the engine.
+    // shard_cpus, if given, holds the cpu of every shard: its thread is pinned there and its queues, arena and
+    // books are placed on that cpu's NUMA node.
+    // route_orders keeps a router of resting order ids to symbols shared by the shards, for submitById. every
+    // order coming to rest or leaving then writes to it from its shard's thread, so it is off unless asked for
+    ShardedEngine(std::unique_ptr<EventHandler> event_handler, size_t num_shards, Clock &clock = Clock::defaultClock(),
+        size_t queue_capacity = 1 << 16, RiskCheck *risk_check = nullptr, const std::vector<int> &shard_cpus = {},
+        bool route_orders = false);
+    ~ShardedEngine();
+
+    ShardedEngine(const ShardedEngine &) = delete;
+    ShardedEngine &operator=(const ShardedEngine &) = delete;
+
+    // adds a symbol and its book to a shard, symbols are spread round robin unless a shard is given.
+    // only before start()
+    void addSymbol(uint32_t symbol_id, const std::string &symbol_name);
+    void addSymbol(uint32_t symbol_id, const std::string &symbol_name, uint32_t shard_id);
+
+    bool hasSymbol(uint32_t symbol_id) const;
+
+    // creates a response queue and returns the producer id to submit with, only before start().
+    // producer_cpu, if given, is where the producer runs, its queue is placed on that node
+    uint32_t registerProducer(size_t response_capacity = 1 << 12, int producer_cpu = -1);
+
+    // the policy is consulted every interval by a rebalancer thread while the engine runs
+    void setRebalancePolicy(std::unique_ptr<RebalancePolicy> policy, std::chrono::milliseconds interval);
+
+    void start();
+
+    // stops the shards after every submitted command and pending migration has been applied
+    void stop();
+
+    // returns false if the owning shard's queue is full, or the symbol is moving and queue_capacity commands
+    // are already parked for it. throws if the symbol does not exist
+    bool submit(uint32_t producer_id, Command command);
+
+    // the same for a command naming its order by id alone, the symbol is looked up in the router the shards
+    // share and command.symbol_id is ignored. only with route_orders. throws if no resting order has the id,
+    // an order is only routed once its shard has applied the command adding it
+    bool submitById(uint32_t producer_id, Command command);
+
+    // false if no resting order has the id, always without route_orders. from any thread
+    bool findOrderSymbol(uint64_t order_id, uint32_t &symbol_id) const {
+        return router.find(order_id, symbol_id);
+    }
+
+    // producer only, returns false if there is no ack waiting
+    bool pollAck(uint32_t producer_id, CommandAck &ack);
+
+    // asks the policy for migrations and starts them, returns how many were started. safe to call by hand
+    // while the rebalancer thread runs, calls are serialized
+    size_t rebalance();
+
+    // starts moving a symbol's book to another shard, returns false if it already lives there or
+    // is already moving. the move completes asynchronously on the matching threads
+    bool migrateSymbol(uint32_t symbol_id, uint32_t to_shard);
+
+    // shard currently owning the symbol
+    uint32_t getShard(uint32_t symbol_id) const;
+
+    // sequence number of the last event in the shard's stream, the stream id of its events is the shard id
+    uint64_t getLastSequence(uint32_t shard_id) const;
+
+    // memory held by the levels and orders of the books created on the shard, a book keeps its arena when
+    // it migrates
+    ArenaStats getArenaStats(uint32_t shard_id) const;
+
+    // placement of the shard and the traffic reaching it from other nodes, from any thread
+    ShardNumaStats getNumaStats(uint32_t shard_id) const;
+
+    // cumulative load of every shard since start
+    std::vector<ShardLoad> getShardLoads() const;
+
+    inline size_t getShardCount() const { return shards.size(); }
+    inline uint64_t getMigrationCount() const { return migrations.load(std::memory_order_relaxed); }
+
+private:
+    enum class MessageType : uint8_t {
+        COMMAND = 0,
+        MIGRATE_OUT = 1, // the source shard hands the book over to the target shard
+        ADOPT = 2 // the target shard takes the book and replays the parked commands
+    };
+
+    struct Message {
+        MessageType type;
+        uint32_t symbol_id;
+        uint32_t target_shard;
+        uint64_t submit_time;
+        OrderBook *book;
+        Command command;
+    };
+
+    // routing state of a symbol, shared by producers and the matching threads
+    struct alignas(CACHE_LINE_SIZE) SymbolRoute {
+        std::atomic<uint32_t> shard{0};
+        uint32_t home_shard = 0; // the book was created there and allocates from its arena
+        std::atomic<uint32_t> inflight{0}; // producers currently pushing on the fast path
+        std::atomic<bool> migrating{false};
+        std::atomic<uint64_t> commands{0}; // applied so far, read by the rebalancer
+        uint64_t commands_at_last_rebalance = 0; // under rebalance_lock
+        std::mutex parked_lock;
+        std::vector<Message> parked; // commands submitted while the symbol was moving
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        Shard(uint16_t shard_id, size_t queue_capacity, size_t control_capacity, int cpu, int node)
+            : ingress(queue_capacity), control(control_capacity), sequencer(shard_id), cpu(cpu), node(node) {}
+
+        MpscQueue<Message> ingress;
+        // books handed over by other shards, kept apart from the ingress so a shard handing a book
+        // over never waits on a full command queue
+        MpscQueue<Message> control;
+        // only touched by the shard's thread once the engine runs
+        robin_hood::unordered_map<uint32_t, std::unique_ptr<OrderBook>> books;
+        // parked commands of an adopted book, taken off its route so they replay without its lock
+        std::vector<Message> replaying;
+        std::thread thread;
+        // numbers the events of the shard's books, a book takes on its new shard's stream when it moves
+        EventSequencer sequencer;
+        std::atomic<uint64_t> commands{0};
+        std::atomic<uint64_t> latency_ns{0};
+        std::atomic<uint32_t> symbols{0};
+        std::atomic<uint64_t> remote_commands{0};
+        uint64_t commands_at_last_rebalance = 0; // under rebalance_lock
+        int cpu;
+        int node;
+    };
+
+    void run(uint32_t shard_id);
+    void handle(uint32_t shard_id, Message &message);
+    void apply(uint32_t shard_id, OrderBook &book, const Message &message);
+    void adopt(uint32_t shard_id, Message &message);
+    void push(MpscQueue<Message> &queue, const Message &message);
+    void runRebalancer();
+
+    SymbolRoute &route(uint32_t symbol_id) const;
+    static uint64_t now();
+
+    std::unique_ptr<EventHandler> event_handler;
+    Clock &clock;
+    RiskCheck *risk_check;
+    // resting order id : symbol for every shard, before the shards as their books unroute orders when destroyed.
+    // only kept with route_orders
+    OrderRouter router;
+    bool route_orders;
+    // one per shard, apart from the shards as a migrated book frees into the arena of the shard it was created on
+    std::vector<std::unique_ptr<HugePageArena>> arenas;
+    std::vector<std::unique_ptr<Shard>> shards;
+    robin_hood::unordered_map<uint32_t, std::unique_ptr<SymbolRoute>> routes;
+    std::vector<std::unique_ptr<MpscQueue<CommandAck>>> responses;
+    std::vector<int> producer_nodes; // NUMA node of every producer, -1 if unknown
+    // most commands parked for one moving symbol
+    size_t parked_capacity;
+    std::unique_ptr<RebalancePolicy> policy;
+    // serializes rebalance(), between the rebalancer thread and callers
+    std::mutex rebalance_lock;
+    std::chrono::milliseconds rebalance_interval;
+    std::thread rebalancer;
+    std::atomic<bool> running;
+    std::atomic<bool> stopping; // set once the rebalancer is gone, the shards drain and exit
+    std::atomic<uint32_t> migrations_in_flight;
+    std::atomic<uint64_t> migrations;
+    uint32_t next_shard;
+};
+}
+
+#endif // QUANTA_TRADER_SHARDED_ENGINE_H
@@ -0,0 +1,61 @@
+#ifndef QUANTA_TRADER_VOLUME_LADDER_H
+#define QUANTA_TRADER_VOLUME_LADDER_H
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "huge_page_arena.h"
+
+namespace QuantaTrader {
+
+// resting volume of one side of a book indexed by price, answers "how much rests at or
+// better than this price" in O(log n) instead of walking the levels.
+// prices inside a window of ticks live in a fenwick tree, the window follows the book and
+// grows up to max_span ticks, at most doubling at a time so no single rebuild is large. prices that
+// would stretch it further are kept in an ordered spill map, queries inside the window add the spill
+// below it as one running total and only queries outside it walk the spilled prices between the window
+// and the price, so the answer is always exact
+class VolumeLadder {
+public:
+    static constexpr uint64_t DEFAULT_MAX_SPAN = 1 << 14;
+
+    // the window and the spill draw from arena, nullptr for the heap
+    explicit VolumeLadder(uint64_t max_span = DEFAULT_MAX_SPAN, HugePageArena *arena = nullptr);
+
+    void add(uint64_t price, uint64_t quantity);
+    void remove(uint64_t price, uint64_t quantity);
+
+    // total volume resting at prices <= price
+    uint64_t volumeAtOrBelow(uint64_t price) const;
+
+    // total volume resting at prices >= price
+    uint64_t volumeAtOrAbove(uint64_t price) const;
+
+    inline uint64_t getTotalVolume() const { return total_volume; }
+
+private:
+    inline bool covers(uint64_t price) const { return price >= base && price - base < volumes.size(); }
+
+    // moves or grows the window so it covers price, returns false if that would more than double it or exceed max_span
+    bool place(uint64_t price);
+
+    // rebuilds the window as size ticks starting at new_base, keeping the volume it already holds
+    void rebase(uint64_t new_base, size_t size);
+
+    // sum of the first count ticks of the window
+    uint64_t prefix(size_t count) const;
+
+    uint64_t max_span;
+    uint64_t base; // price of the first tick in the window
+    std::vector<uint64_t, ArenaAllocator<uint64_t>> volumes; // volume per tick
+    std::vector<uint64_t, ArenaAllocator<uint64_t>> tree; // fenwick tree over volumes, index i holds tick i - 1
+    std::vector<uint64_t, ArenaAllocator<uint64_t>> rebased; // reused by rebase
+    uint64_t window_volume;
+    uint64_t total_volume;
+    // price : volume, never overlaps the window
+    std::map<uint64_t, uint64_t, std::less<uint64_t>, ArenaAllocator<std::pair<const uint64_t, uint64_t>>> spill;
+    uint64_t spill_below; // spilled volume priced below the window
+};
+}
+
+#endif // QUANTA_TRADER_VOLUME_LADDER_H
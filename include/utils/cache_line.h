@@ -0,0 +1,11 @@
+#ifndef QUANTA_TRADER_CACHE_LINE_H
+#define QUANTA_TRADER_CACHE_LINE_H
+#include <cstddef>
+
+namespace QuantaTrader {
+
+// size of a cache line on the platforms we target
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+}
+
+#endif // QUANTA_TRADER_CACHE_LINE_H
@@ -0,0 +1,103 @@
+#ifndef QUANTA_TRADER_CLOCK_H
+#define QUANTA_TRADER_CLOCK_H
+#include <cstdint>
+#include <chrono>
+
+namespace QuantaTrader {
+
+// all timestamps in the engine are nanoseconds since the unix epoch
+using Timestamp = uint64_t;
+
+// source of order timestamps and engine event times
+class Clock {
+public:
+    virtual ~Clock() = default;
+
+    virtual Timestamp now() = 0;
+
+    // clock used by the order factories and the engine when none is given, a SystemClock unless replaced
+    static Clock &defaultClock();
+
+    // replaces the default clock, the clock must outlive every order factory call and engine using it
+    static void setDefaultClock(Clock &clock);
+};
+
+// reads std::chrono::system_clock, goes through the vDSO on every call
+class SystemClock : public Clock {
+public:
+    Timestamp now() override;
+};
+
+// reads the cpu timestamp counter and converts ticks to wall clock nanoseconds using a ratio
+// calibrated against the system clock at construction, costs a handful of cycles per call
+class TscClock : public Clock {
+public:
+    // calibration busy waits for calibration_time against the system clock
+    explicit TscClock(std::chrono::microseconds calibration_time = std::chrono::microseconds(10000));
+
+    Timestamp now() override {
+        uint64_t elapsed_ticks = readTicks() - base_ticks;
+        return base_time + static_cast<uint64_t>((static_cast<unsigned __int128>(elapsed_ticks) * ns_per_tick) >> 32);
+    }
+
+    // nanoseconds per tick in 32.32 fixed point
+    inline uint64_t getNsPerTick() const { return ns_per_tick; }
+
+    static uint64_t readTicks();
+
+private:
+    Timestamp base_time;
+    uint64_t base_ticks;
+    uint64_t ns_per_tick;
+};
+
+// returns a cached time that is refreshed from the source clock once per batch of work,
+// every order and event in the batch shares the timestamp of the refresh
+class CoarseClock : public Clock {
+public:
+    explicit CoarseClock(Clock &source);
+
+    Timestamp now() override { return cached_time; }
+
+    // samples the source clock, call at the start of every batch
+    void refresh() { cached_time = source.now(); }
+
+private:
+    Clock &source;
+    Timestamp cached_time;
+};
+
+// returns the timestamp supplied by the caller, used to stamp orders with exchange or gateway times
+class ExchangeClock : public Clock {
+public:
+    explicit ExchangeClock(Timestamp time = 0) : current_time(time) {}
+
+    Timestamp now() override { return current_time; }
+
+    void set(Timestamp time) { current_time = time; }
+
+private:
+    Timestamp current_time;
+};
+
+// deterministic clock for replay, starts at start_time and advances by step on every reading
+// so two replays of the same input produce bit identical timestamps
+class SimulatedClock : public Clock {
+public:
+    explicit SimulatedClock(Timestamp start_time = 0, uint64_t step = 1) : current_time(start_time), step(step) {}
+
+    Timestamp now() override {
+        Timestamp time = current_time;
+        current_time += step;
+        return time;
+    }
+
+    void advance(uint64_t amount) { current_time += amount; }
+
+private:
+    Timestamp current_time;
+    uint64_t step;
+};
+}
+
+#endif // QUANTA_TRADER_CLOCK_H
@@ -0,0 +1,131 @@
+#ifndef QUANTA_TRADER_HUGE_PAGE_ARENA_H
+#define QUANTA_TRADER_HUGE_PAGE_ARENA_H
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "cache_line.h"
+#include "spin_lock.h"
+
+namespace QuantaTrader {
+
+constexpr size_t HUGE_PAGE_SIZE = size_t(1) << 21;
+constexpr size_t GIGANTIC_PAGE_SIZE = size_t(1) << 30;
+
+struct ArenaStats {
+    size_t reserved_bytes; // mapped chunks
+    size_t huge_page_bytes; // of those, backed by reserved huge pages
+    size_t transparent_bytes; // of those, only advised to use transparent huge pages
+    size_t node_bound_bytes; // of those, bound to the arena's NUMA node
+    size_t allocated_bytes; // handed out and not yet returned, size classes included
+    size_t peak_allocated_bytes;
+    size_t large_bytes; // allocations past the largest size class, served by operator new
+    uint64_t allocations;
+    uint64_t deallocations;
+};
+
+// memory for a group of books, so their levels and orders share a few huge pages instead of spreading
+// small allocations over the whole heap. chunks are mapped from reserved huge pages if the system has
+// them, 1 GB pages for chunk sizes that are a multiple of it, and otherwise mapped aligned and advised to
+// use transparent huge pages. an arena given a NUMA node binds its chunks to it before they are touched.
+// allocations are carved off the current chunk and recycled through a free
+// list per 16 byte size class, chunks are only unmapped with the arena. blocks of whole cache lines
+// start on a cache line and blocks aligned past 16 bytes are rounded up to whole cache lines, so types
+// aligned to anything up to a cache line stay in the arena.
+// a spin lock makes it safe to share between the threads matching its books, it is uncontended as long as
+// they are matched on one thread at a time
+class HugePageArena {
+public:
+    static constexpr size_t ALIGNMENT = 16;
+    static constexpr size_t MAX_CLASS_SIZE = size_t(1) << 16;
+
+    // chunk_size is rounded up to a multiple of HUGE_PAGE_SIZE, nothing is mapped before the first allocation.
+    // a node of -1 leaves placement to the kernel
+    explicit HugePageArena(size_t chunk_size = HUGE_PAGE_SIZE, int node = -1);
+    ~HugePageArena();
+
+    HugePageArena(const HugePageArena &) = delete;
+    HugePageArena &operator=(const HugePageArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment);
+    void deallocate(void *pointer, size_t size, size_t alignment);
+
+    ArenaStats getStats() const;
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    // maps another chunk and makes it the current one
+    void mapChunk();
+
+    size_t chunk_size;
+    int node;
+    mutable SpinLock lock;
+    std::vector<FreeBlock *> free_blocks; // per size class
+    std::vector<std::pair<char *, size_t>> chunks; // start, mapped length
+    char *current;
+    char *chunk_end;
+    ArenaStats stats;
+};
+
+// allocator of the engine's containers, draws from an arena. a default constructed allocator has none and
+// uses operator new, aligned for over-aligned types, containers moved or swapped take their allocator with them
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() : arena(nullptr) {}
+    explicit ArenaAllocator(HugePageArena *arena) : arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.getArena()) {}
+
+    T *allocate(size_t count) {
+        if (arena == nullptr) {
+            if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+                return static_cast<T *>(::operator new(count * sizeof(T), std::align_val_t(alignof(T))));
+            }
+            return static_cast<T *>(::operator new(count * sizeof(T)));
+        }
+        return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *pointer, size_t count) {
+        if (arena == nullptr) {
+            if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+                ::operator delete(pointer, std::align_val_t(alignof(T)));
+            } else {
+                ::operator delete(pointer);
+            }
+        } else {
+            arena->deallocate(pointer, count * sizeof(T), alignof(T));
+        }
+    }
+
+    HugePageArena *getArena() const {
+        return arena;
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return arena == other.getArena();
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+        return arena != other.getArena();
+    }
+
+private:
+    HugePageArena *arena;
+};
+}
+
+#endif // QUANTA_TRADER_HUGE_PAGE_ARENA_H
@@ -0,0 +1,111 @@
+#ifndef QUANTA_TRADER_MPSC_QUEUE_H
+#define QUANTA_TRADER_MPSC_QUEUE_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "cache_line.h"
+
+namespace QuantaTrader {
+
+// bounded lock free multi producer single consumer queue.
+// every cell carries a sequence number that tells producers and the consumer whose turn it is.
+// producers claim cells with a CAS on the tail and publish through the cell's sequence, the consumer
+// only ever writes cell sequences and its own head, so producers never wait on the consumer's counter
+template <typename T>
+class MpscQueue {
+public:
+    // capacity is rounded up to a power of 2
+    explicit MpscQueue(size_t capacity) {
+        size_t rounded = 2;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        mask = rounded - 1;
+        cells = std::unique_ptr<Cell[]>(new Cell[rounded]);
+        for (size_t i = 0; i < rounded; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        tail.value.store(0, std::memory_order_relaxed);
+        head.value.store(0, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    // returns false if the queue is full, safe to call from any number of threads
+    bool tryPush(const T &item) {
+        size_t position = tail.value.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (tail.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.item = item;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false; // the consumer has not freed this cell yet
+            } else {
+                position = tail.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // spins until there is room in the queue
+    void push(const T &item) {
+        while (!tryPush(item)) {
+        }
+    }
+
+    // consumer only, returns false if the queue is empty
+    bool tryPop(T &item) {
+        size_t position = head.value.load(std::memory_order_relaxed);
+        Cell &cell = cells[position & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != position + 1) {
+            return false;
+        }
+        item = cell.item;
+        cell.sequence.store(position + mask + 1, std::memory_order_release);
+        head.value.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // consumer only, moves up to max_items into out and returns how many were moved
+    size_t popBatch(T *out, size_t max_items) {
+        size_t popped = 0;
+        while (popped < max_items && tryPop(out[popped])) {
+            ++popped;
+        }
+        return popped;
+    }
+
+    // approximate number of queued items, safe to call from any thread
+    size_t size() const {
+        size_t current_head = head.value.load(std::memory_order_relaxed);
+        size_t current_tail = tail.value.load(std::memory_order_relaxed);
+        return current_tail > current_head ? current_tail - current_head : 0;
+    }
+
+    inline size_t capacity() const { return mask + 1; }
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Cell {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) PaddedCounter {
+        std::atomic<size_t> value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    PaddedCounter tail; // claimed by producers
+    PaddedCounter head; // owned by the consumer
+};
+}
+
+#endif // QUANTA_TRADER_MPSC_QUEUE_H
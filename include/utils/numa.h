@@ -0,0 +1,30 @@
+#ifndef QUANTA_TRADER_NUMA_H
+#define QUANTA_TRADER_NUMA_H
+#include <cstddef>
+#include <functional>
+
+namespace QuantaTrader {
+
+// placement of threads and memory on NUMA nodes, straight on the kernel's interfaces so there is no
+// dependency on libnuma. node and cpu numbers are the kernel's, -1 stands for unknown or anywhere.
+// on systems without NUMA support every call reports -1 or failure and changes nothing
+
+// node the cpu belongs to
+int numaNodeOfCpu(int cpu);
+
+// node of the cpu the calling thread is running on right now
+int currentNumaNode();
+
+// restricts the calling thread to the cpu, returns false if the kernel refused
+bool pinCurrentThread(int cpu);
+
+// runs work on a thread pinned to cpu and waits for it, so the memory work touches first is placed on the
+// cpu's node. exceptions are passed on to the caller. a cpu of -1 runs work on the calling thread
+void runOnCpu(int cpu, const std::function<void()> &work);
+
+// asks the kernel to place the pages of the range on the node, falling back to other nodes when it is
+// full. only pages not yet touched move, returns false if the kernel refused
+bool bindToNode(void *address, size_t length, int node);
+}
+
+#endif // QUANTA_TRADER_NUMA_H
@@ -0,0 +1,38 @@
+#ifndef QUANTA_TRADER_SPIN_LOCK_H
+#define QUANTA_TRADER_SPIN_LOCK_H
+#include <atomic>
+#include <thread>
+
+namespace QuantaTrader {
+
+// test and test-and-set lock for very short critical sections, satisfies Lockable
+class SpinLock {
+public:
+    void lock() {
+        for (;;) {
+            if (!locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            uint32_t spins = 0;
+            while (locked.load(std::memory_order_relaxed)) {
+                if (++spins > 256) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked{false};
+};
+}
+
+#endif // QUANTA_TRADER_SPIN_LOCK_H
@@ -0,0 +1,82 @@
+#ifndef QUANTA_TRADER_SPSC_QUEUE_H
+#define QUANTA_TRADER_SPSC_QUEUE_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "cache_line.h"
+
+namespace QuantaTrader {
+
+// bounded lock free single producer single consumer ring.
+// each side keeps a cached copy of the other side's index so the shared counters
+// are only read when the ring looks full or empty
+template <typename T>
+class SpscQueue {
+public:
+    // capacity is rounded up to a power of 2
+    explicit SpscQueue(size_t capacity) {
+        size_t rounded = 2;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        mask = rounded - 1;
+        items = std::unique_ptr<T[]>(new T[rounded]);
+        producer.index.store(0, std::memory_order_relaxed);
+        producer.cached_other = 0;
+        consumer.index.store(0, std::memory_order_relaxed);
+        consumer.cached_other = 0;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // producer only, returns false if the ring is full
+    bool tryPush(const T &item) {
+        size_t tail = producer.index.load(std::memory_order_relaxed);
+        if (tail - producer.cached_other > mask) {
+            producer.cached_other = consumer.index.load(std::memory_order_acquire);
+            if (tail - producer.cached_other > mask) {
+                return false;
+            }
+        }
+        items[tail & mask] = item;
+        producer.index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only, returns false if the ring is empty
+    bool tryPop(T &item) {
+        size_t head = consumer.index.load(std::memory_order_relaxed);
+        if (head == consumer.cached_other) {
+            consumer.cached_other = producer.index.load(std::memory_order_acquire);
+            if (head == consumer.cached_other) {
+                return false;
+            }
+        }
+        item = items[head & mask];
+        consumer.index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate number of queued items, safe to call from any thread
+    size_t size() const {
+        size_t head = consumer.index.load(std::memory_order_acquire);
+        return producer.index.load(std::memory_order_acquire) - head;
+    }
+
+    inline size_t capacity() const { return mask + 1; }
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Side {
+        std::atomic<size_t> index; // written by the owning side
+        size_t cached_other; // last seen index of the other side
+    };
+
+    std::unique_ptr<T[]> items;
+    size_t mask;
+    Side producer;
+    Side consumer;
+};
+}
+
+#endif // QUANTA_TRADER_SPSC_QUEUE_H
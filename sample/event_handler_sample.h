@@ -19,11 +19,20 @@ protected:
     void handleOrderExecuted(const OrderExecuted &notification) override {
         std::cout << notification << std::endl;
     }
+    void handleOrderRejected(const OrderRejected &notification) override {
+        std::cout << notification << std::endl;
+    }
+    void handleSelfTradePrevented(const SelfTradePrevented &notification) override {
+        std::cout << notification << std::endl;
+    }
     void handleSymbolAdded(const SymbolAdded &notification) override {
         std::cout << notification << std::endl;
     }
     void handleSymbolDeleted(const SymbolDeleted &notification) override {
         std::cout << notification << std::endl;
     }
+    void handleAuctionUncrossed(const AuctionUncrossed &notification) override {
+        std::cout << notification << std::endl;
+    }
 };
 #endif
\ No newline at end of file
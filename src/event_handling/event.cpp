@@ -14,6 +14,31 @@ std::ostream &operator<<(std::ostream &os, const SymbolDeleted &event) {
     return os;
 }
 
+std::ostream &operator<<(std::ostream &os, const AuctionUncrossed &event) {
+    os << "Auction Uncrossed\n" << "ID: " << event.symbol_id << "\n" << "Price: " << event.price << "\n" << "Volume: " << event.volume << "\n";
+    return os;
+}
+
+std::string rejectReasonToString(RejectReason reason) {
+    switch (reason) {
+        case RejectReason::UNKNOWN_ACCOUNT:
+            return "Unknown Account";
+        case RejectReason::ORDER_QUANTITY:
+            return "Order Quantity";
+        case RejectReason::ORDER_NOTIONAL:
+            return "Order Notional";
+        case RejectReason::PRICE_COLLAR:
+            return "Price Collar";
+        case RejectReason::OPEN_QUANTITY:
+            return "Open Quantity";
+        case RejectReason::POSITION:
+            return "Position";
+        case RejectReason::AUCTION:
+            return "Auction";
+    }
+    return "Unknown";
+}
+
 // Order events
 std::ostream &operator<<(std::ostream &os, const OrderAdded &event) {
     os << "Order Added\n" << event.order;
@@ -34,4 +59,14 @@ std::ostream &operator<<(std::ostream &os, const OrderUpdated &event) {
     os << "Order Updated\n" << event.order;
     return os;
 }
+
+std::ostream &operator<<(std::ostream &os, const SelfTradePrevented &event) {
+    os << "Self Trade Prevented\n" << "Quantity: " << event.quantity << "\n" << event.order;
+    return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const OrderRejected &event) {
+    os << "Order Rejected\n" << "Reason: " << rejectReasonToString(event.reason) << "\n" << event.order;
+    return os;
+}
 }
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include <cstring>
+#include <stdexcept>
+#include "event_journal.h"
+
+namespace QuantaTrader {
+
+EventJournal::EventJournal(size_t capacity) : slots(nullptr), mask(0) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    owned_slots.reset(new Slot[rounded]);
+    slots = owned_slots.get();
+    for (size_t i = 0; i < rounded; ++i) {
+        for (std::atomic<uint64_t> &word : slots[i].words) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+    mask = rounded - 1;
+}
+
+EventJournal::EventJournal(void *memory, size_t capacity) : slots(static_cast<Slot *>(memory)), mask(capacity - 1) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        throw std::runtime_error("Journal capacity must be a power of 2");
+    }
+}
+
+size_t EventJournal::memorySize(size_t capacity) {
+    return capacity * sizeof(Slot);
+}
+
+void EventJournal::append(const EventRecord &record) {
+    if (record.sequence == 0) {
+        return;
+    }
+    uint64_t words[WORDS];
+    std::memcpy(words, &record, sizeof(record));
+    Slot &slot = slots[record.sequence & mask];
+    slot.words[0].store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 1; i < WORDS; ++i) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.words[0].store(words[0], std::memory_order_release);
+}
+
+EventJournal::ReadResult EventJournal::read(uint64_t sequence, EventRecord &record) const {
+    const Slot &slot = slots[sequence & mask];
+    uint64_t written = slot.words[0].load(std::memory_order_acquire);
+    if (written != sequence) {
+        // 0 is a slot being written, it may be this record or a later one, so try again later
+        return written > sequence ? ReadResult::OVERWRITTEN : ReadResult::NOT_WRITTEN;
+    }
+    uint64_t words[WORDS];
+    words[0] = written;
+    for (size_t i = 1; i < WORDS; ++i) {
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // a writer came round the ring while we copied
+    if (slot.words[0].load(std::memory_order_relaxed) != sequence) {
+        return ReadResult::OVERWRITTEN;
+    }
+    std::memcpy(&record, words, sizeof(record));
+    return ReadResult::READ;
+}
+
+bool EventJournal::readFrom(uint64_t sequence, std::vector<EventRecord> &records, size_t max_records) const {
+    EventRecord record;
+    for (size_t count = 0; count < max_records; ++count) {
+        ReadResult result = read(sequence + count, record);
+        if (result == ReadResult::OVERWRITTEN) {
+            // records already read stay valid, the caller hears of the overrun on its next read
+            return count != 0;
+        }
+        if (result == ReadResult::NOT_WRITTEN) {
+            break;
+        }
+        records.push_back(record);
+    }
+    return true;
+}
+
+JournalEventHandler::JournalEventHandler(std::unique_ptr<EventHandler> handler, size_t capacity, size_t streams)
+    : handler(std::move(handler)) {
+    for (size_t stream = 0; stream < streams; ++stream) {
+        journals.push_back(std::make_unique<EventJournal>(capacity));
+    }
+}
+
+JournalEventHandler::JournalEventHandler(std::unique_ptr<EventHandler> handler) : handler(std::move(handler)) {}
+
+const EventJournal &JournalEventHandler::getJournal(uint16_t stream) const {
+    if (stream >= journals.size()) {
+        throw std::runtime_error("Stream is not journaled");
+    }
+    return *journals[stream];
+}
+
+void JournalEventHandler::append(const EventRecord &record, uint16_t stream) {
+    if (stream < journals.size()) {
+        journals[stream]->append(record);
+    }
+}
+
+void JournalEventHandler::appendOrderEvent(const OrderEvent &event, EventType type, uint64_t detail_quantity, uint8_t detail) {
+    const Order &order = event.order;
+    append(EventRecord{event.sequence, event.symbol_sequence, event.timestamp, order.getId(), order.getPrice(),
+        order.getOpenQuantity(), detail_quantity, order.getSymbolId(), type, order.getSide(), detail}, event.stream);
+}
+
+void JournalEventHandler::appendEngineEvent(const EngineEvent &event, EventType type, uint64_t price, uint64_t quantity) {
+    append(EventRecord{event.sequence, event.symbol_sequence, event.timestamp, 0, price, quantity, 0, event.symbol_id,
+        type, OrderSide::BUY, 0}, event.stream);
+}
+
+void JournalEventHandler::handleOrderAdded(const OrderAdded &event) {
+    appendOrderEvent(event, EventType::ORDER_ADDED);
+    handler->handleOrderAdded(event);
+}
+
+void JournalEventHandler::handleOrderDeleted(const OrderDeleted &event) {
+    appendOrderEvent(event, EventType::ORDER_DELETED);
+    handler->handleOrderDeleted(event);
+}
+
+void JournalEventHandler::handleOrderUpdated(const OrderUpdated &event) {
+    appendOrderEvent(event, EventType::ORDER_UPDATED);
+    handler->handleOrderUpdated(event);
+}
+
+void JournalEventHandler::handleOrderExecuted(const OrderExecuted &event) {
+    appendOrderEvent(event, EventType::ORDER_EXECUTED, event.order.getLastExecutedQuantity());
+    handler->handleOrderExecuted(event);
+}
+
+void JournalEventHandler::handleOrderRejected(const OrderRejected &event) {
+    appendOrderEvent(event, EventType::ORDER_REJECTED, 0, static_cast<uint8_t>(event.reason));
+    handler->handleOrderRejected(event);
+}
+
+void JournalEventHandler::handleSelfTradePrevented(const SelfTradePrevented &event) {
+    appendOrderEvent(event, EventType::SELF_TRADE_PREVENTED, event.quantity);
+    handler->handleSelfTradePrevented(event);
+}
+
+void JournalEventHandler::handleSymbolAdded(const SymbolAdded &event) {
+    appendEngineEvent(event, EventType::SYMBOL_ADDED);
+    handler->handleSymbolAdded(event);
+}
+
+void JournalEventHandler::handleSymbolDeleted(const SymbolDeleted &event) {
+    appendEngineEvent(event, EventType::SYMBOL_DELETED);
+    handler->handleSymbolDeleted(event);
+}
+
+void JournalEventHandler::handleAuctionUncrossed(const AuctionUncrossed &event) {
+    appendEngineEvent(event, EventType::AUCTION_UNCROSSED, event.price, event.volume);
+    handler->handleAuctionUncrossed(event);
+}
+
+void JournalEventHandler::handleOrderExecutedBatch(const std::vector<OrderExecuted> &events) {
+    for (const OrderExecuted &event : events) {
+        appendOrderEvent(event, EventType::ORDER_EXECUTED, event.order.getLastExecutedQuantity());
+    }
+    handler->handleOrderExecutedBatch(events);
+}
+
+void JournalEventHandler::handleOrderDeletedBatch(const std::vector<OrderDeleted> &events) {
+    for (const OrderDeleted &event : events) {
+        appendOrderEvent(event, EventType::ORDER_DELETED);
+    }
+    handler->handleOrderDeletedBatch(events);
+}
+
+void JournalEventHandler::handleTrades(const std::vector<Trade> &trades, const std::vector<FillSummary> &summaries) {
+    for (const Trade &trade : trades) {
+        append(EventRecord{trade.sequence, trade.symbol_sequence, trade.timestamp, trade.aggressor_id, trade.price,
+            trade.quantity, trade.passive_id, trade.symbol_id, EventType::TRADE, trade.aggressor_side,
+            static_cast<uint8_t>(trade.auction)}, trade.stream);
+    }
+    handler->handleTrades(trades, summaries);
+}
+}
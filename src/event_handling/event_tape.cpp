@@ -0,0 +1,358 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include "event_tape.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace QuantaTrader {
+
+namespace {
+// rows scanned per block, one SSE2 register of the type column
+constexpr uint64_t BLOCK_ROWS = 16;
+
+size_t alignUp(size_t offset) {
+    return (offset + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+bool fileExists(const std::string &path) {
+    struct stat status;
+    return stat(path.c_str(), &status) == 0;
+}
+}
+
+TapeLayout::TapeLayout(uint64_t capacity) {
+    size_t offset = alignUp(sizeof(TapeSegmentHeader));
+    auto place = [&](size_t element_size) {
+        size_t start = offset;
+        offset = alignUp(offset + capacity * element_size);
+        return start;
+    };
+    timestamps = place(sizeof(uint64_t));
+    sequences = place(sizeof(uint64_t));
+    symbol_sequences = place(sizeof(uint64_t));
+    order_ids = place(sizeof(uint64_t));
+    prices = place(sizeof(uint64_t));
+    quantities = place(sizeof(uint64_t));
+    detail_quantities = place(sizeof(uint64_t));
+    symbol_ids = place(sizeof(uint32_t));
+    types = place(sizeof(EventType));
+    sides = place(sizeof(OrderSide));
+    details = place(sizeof(uint8_t));
+    size = offset;
+}
+
+EventTape::EventTape(std::unique_ptr<EventHandler> handler, const std::string &directory, const std::string &prefix,
+    size_t rows_per_segment, size_t streams)
+    : JournalEventHandler(std::move(handler)),
+    directory(directory),
+    prefix(prefix),
+    rows_per_segment(rows_per_segment),
+    layout(rows_per_segment),
+    stopping(false) {
+    if (rows_per_segment == 0) {
+        throw std::runtime_error("Tape segments need room for a row");
+    }
+    for (size_t stream_id = 0; stream_id < streams; ++stream_id) {
+        auto stream = std::make_unique<Stream>();
+        while (fileExists(segmentPath(directory, prefix, static_cast<uint16_t>(stream_id), stream->next_index))) {
+            ++stream->next_index;
+        }
+        this->streams.push_back(std::move(stream));
+    }
+    try {
+        for (size_t stream_id = 0; stream_id < streams; ++stream_id) {
+            Stream &tape = *this->streams[stream_id];
+            tape.memory = openSegment(static_cast<uint16_t>(stream_id), tape.next_index++);
+            tape.segments = 1;
+        }
+    } catch (const std::runtime_error &) {
+        for (auto &stream : this->streams) {
+            closeSegment(stream->memory);
+        }
+        throw;
+    }
+    thread = std::thread(&EventTape::run, this);
+}
+
+EventTape::~EventTape() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    work.notify_all();
+    thread.join();
+    for (size_t stream_id = 0; stream_id < streams.size(); ++stream_id) {
+        Stream &tape = *streams[stream_id];
+        closeSegment(tape.memory);
+        if (tape.spare != nullptr) {
+            // never written, it would only show up as an empty segment
+            closeSegment(tape.spare);
+            unlink(segmentPath(directory, prefix, static_cast<uint16_t>(stream_id), tape.spare_index).c_str());
+        }
+    }
+}
+
+std::string EventTape::segmentPath(const std::string &directory, const std::string &prefix, uint16_t stream, size_t index) {
+    char number[16];
+    std::snprintf(number, sizeof(number), "%06zu", index);
+    return directory + "/" + prefix + "." + std::to_string(stream) + "-" + number + ".tape";
+}
+
+char *EventTape::openSegment(uint16_t stream, size_t index) {
+    std::string path = segmentPath(directory, prefix, stream, index);
+    int fd = open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Could not create tape segment " + path);
+    }
+    // the file is sparse until rows reach its pages
+    if (ftruncate(fd, static_cast<off_t>(layout.size)) != 0) {
+        close(fd);
+        unlink(path.c_str());
+        throw std::runtime_error("Could not size tape segment " + path);
+    }
+    void *mapped = mmap(nullptr, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        unlink(path.c_str());
+        throw std::runtime_error("Could not map tape segment " + path);
+    }
+    char *memory = static_cast<char *>(mapped);
+    TapeSegmentHeader &header = *reinterpret_cast<TapeSegmentHeader *>(memory);
+    header.magic = TapeSegmentHeader::MAGIC;
+    header.version = TapeSegmentHeader::VERSION;
+    header.capacity = rows_per_segment;
+    header.row_count.store(0, std::memory_order_release);
+    return memory;
+}
+
+void EventTape::closeSegment(char *memory) {
+    if (memory != nullptr) {
+        munmap(memory, layout.size);
+    }
+}
+
+bool EventTape::advance(Stream &tape, uint16_t stream) {
+    char *next = nullptr;
+    bool was_failing = tape.failing;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::swap(next, tape.spare);
+        if (next == nullptr && !tape.failing) {
+            // the background thread has not caught up, open one here rather than drop rows
+            try {
+                next = openSegment(stream, tape.next_index);
+                ++tape.next_index;
+            } catch (const std::runtime_error &) {
+                tape.failing = true;
+            }
+        }
+    }
+    if (next == nullptr) {
+        // while failing the background thread retries on its own
+        if (!was_failing) {
+            work.notify_one();
+        }
+        return false;
+    }
+    // the background thread opens the one after
+    work.notify_one();
+    tape.failing = false;
+    closeSegment(tape.memory);
+    tape.memory = next;
+    tape.rows = 0;
+    ++tape.segments;
+    return true;
+}
+
+void EventTape::run() {
+    // a failed open is retried after a while, the disk may be full
+    constexpr auto RETRY_INTERVAL = std::chrono::milliseconds(100);
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        size_t missing = streams.size();
+        for (size_t stream_id = 0; stream_id < streams.size() && missing == streams.size(); ++stream_id) {
+            if (streams[stream_id]->spare == nullptr) {
+                missing = stream_id;
+            }
+        }
+        if (stopping) {
+            return;
+        }
+        if (missing == streams.size()) {
+            work.wait(guard);
+            continue;
+        }
+        // opened under the lock so a writer falling back to opening one itself never races for the index
+        Stream &tape = *streams[missing];
+        try {
+            tape.spare = openSegment(static_cast<uint16_t>(missing), tape.next_index);
+            tape.spare_index = tape.next_index++;
+        } catch (const std::runtime_error &) {
+            work.wait_for(guard, RETRY_INTERVAL);
+        }
+    }
+}
+
+void EventTape::roll() {
+    for (size_t stream_id = 0; stream_id < streams.size(); ++stream_id) {
+        Stream &tape = *streams[stream_id];
+        std::lock_guard<SpinLock> guard(tape.lock);
+        advance(tape, static_cast<uint16_t>(stream_id));
+    }
+}
+
+size_t EventTape::getSegmentCount(uint16_t stream) {
+    if (stream >= streams.size()) {
+        throw std::runtime_error("Stream is not taped");
+    }
+    Stream &tape = *streams[stream];
+    std::lock_guard<SpinLock> guard(tape.lock);
+    return tape.segments;
+}
+
+uint64_t EventTape::getDroppedRows(uint16_t stream) {
+    if (stream >= streams.size()) {
+        throw std::runtime_error("Stream is not taped");
+    }
+    Stream &tape = *streams[stream];
+    std::lock_guard<SpinLock> guard(tape.lock);
+    return tape.dropped;
+}
+
+void EventTape::append(const EventRecord &record, uint16_t stream) {
+    if (stream >= streams.size()) {
+        return;
+    }
+    Stream &tape = *streams[stream];
+    std::lock_guard<SpinLock> guard(tape.lock);
+    // a full segment is swapped when the next row arrives, it stays mapped until then
+    if (tape.rows == rows_per_segment && !advance(tape, stream)) {
+        ++tape.dropped;
+        return;
+    }
+    char *memory = tape.memory;
+    uint64_t row = tape.rows;
+    reinterpret_cast<uint64_t *>(memory + layout.timestamps)[row] = record.timestamp;
+    reinterpret_cast<uint64_t *>(memory + layout.sequences)[row] = record.sequence;
+    reinterpret_cast<uint64_t *>(memory + layout.symbol_sequences)[row] = record.symbol_sequence;
+    reinterpret_cast<uint64_t *>(memory + layout.order_ids)[row] = record.order_id;
+    reinterpret_cast<uint64_t *>(memory + layout.prices)[row] = record.price;
+    reinterpret_cast<uint64_t *>(memory + layout.quantities)[row] = record.quantity;
+    reinterpret_cast<uint64_t *>(memory + layout.detail_quantities)[row] = record.detail_quantity;
+    reinterpret_cast<uint32_t *>(memory + layout.symbol_ids)[row] = record.symbol_id;
+    reinterpret_cast<EventType *>(memory + layout.types)[row] = record.type;
+    reinterpret_cast<OrderSide *>(memory + layout.sides)[row] = record.side;
+    reinterpret_cast<uint8_t *>(memory + layout.details)[row] = record.detail;
+    tape.rows = row + 1;
+    reinterpret_cast<TapeSegmentHeader *>(memory)->row_count.store(tape.rows, std::memory_order_release);
+}
+
+EventTapeReader::EventTapeReader(const std::string &path) : memory(nullptr), size(0), layout(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Tape segment " + path + " does not exist");
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(TapeSegmentHeader)) {
+        close(fd);
+        throw std::runtime_error("Tape segment " + path + " is not valid");
+    }
+    size = static_cast<size_t>(status.st_size);
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Could not map tape segment " + path);
+    }
+    memory = static_cast<const char *>(mapped);
+    if (header().magic != TapeSegmentHeader::MAGIC || header().version != TapeSegmentHeader::VERSION
+        || TapeLayout(header().capacity).size > size) {
+        munmap(const_cast<char *>(memory), size);
+        throw std::runtime_error("Tape segment " + path + " is not valid");
+    }
+    layout = TapeLayout(header().capacity);
+}
+
+EventTapeReader::~EventTapeReader() {
+    munmap(const_cast<char *>(memory), size);
+}
+
+EventRecord EventTapeReader::getRecord(uint64_t row) const {
+    return EventRecord{sequences()[row], symbolSequences()[row], timestamps()[row], orderIds()[row], prices()[row],
+        quantities()[row], detailQuantities()[row], symbolIds()[row], types()[row], sides()[row], details()[row]};
+}
+
+uint32_t EventTapeReader::matchBlock(uint64_t row, EventType type, uint32_t symbol_id, bool any_symbol) const {
+#ifdef __SSE2__
+    __m128i block_types = _mm_loadu_si128(reinterpret_cast<const __m128i *>(types() + row));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block_types, _mm_set1_epi8(static_cast<char>(type)))));
+    if (any_symbol || mask == 0) {
+        return mask;
+    }
+    __m128i symbol = _mm_set1_epi32(static_cast<int>(symbol_id));
+    uint32_t symbol_mask = 0;
+    for (uint32_t quarter = 0; quarter < 4; ++quarter) {
+        __m128i block_symbols = _mm_loadu_si128(reinterpret_cast<const __m128i *>(symbolIds() + row + quarter * 4));
+        uint32_t matches = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block_symbols, symbol))));
+        symbol_mask |= matches << (quarter * 4);
+    }
+    return mask & symbol_mask;
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < BLOCK_ROWS; ++i) {
+        if (types()[row + i] == type && (any_symbol || symbolIds()[row + i] == symbol_id)) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+template <typename Visit>
+void EventTapeReader::scan(EventType type, uint32_t symbol_id, bool any_symbol, Visit visit) const {
+    uint64_t row_count = getRowCount();
+    uint64_t row = 0;
+    for (; row + BLOCK_ROWS <= row_count; row += BLOCK_ROWS) {
+        uint32_t mask = matchBlock(row, type, symbol_id, any_symbol);
+        while (mask != 0) {
+            visit(row + static_cast<uint64_t>(__builtin_ctz(mask)));
+            mask &= mask - 1;
+        }
+    }
+    for (; row < row_count; ++row) {
+        if (types()[row] == type && (any_symbol || symbolIds()[row] == symbol_id)) {
+            visit(row);
+        }
+    }
+}
+
+uint64_t EventTapeReader::countRows(EventType type) const {
+    uint64_t row_count = getRowCount();
+    uint64_t count = 0;
+    uint64_t row = 0;
+    for (; row + BLOCK_ROWS <= row_count; row += BLOCK_ROWS) {
+        count += static_cast<uint64_t>(__builtin_popcount(matchBlock(row, type, 0, true)));
+    }
+    for (; row < row_count; ++row) {
+        count += types()[row] == type;
+    }
+    return count;
+}
+
+void EventTapeReader::selectRows(EventType type, uint32_t symbol_id, std::vector<uint64_t> &rows) const {
+    scan(type, symbol_id, false, [&](uint64_t row) { rows.push_back(row); });
+}
+
+uint64_t EventTapeReader::sumQuantity(EventType type, uint32_t symbol_id) const {
+    const uint64_t *quantity = quantities();
+    uint64_t sum = 0;
+    scan(type, symbol_id, false, [&](uint64_t row) { sum += quantity[row]; });
+    return sum;
+}
+}
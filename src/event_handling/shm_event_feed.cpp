@@ -0,0 +1,120 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdexcept>
+#include "shm_event_feed.h"
+
+namespace QuantaTrader {
+
+namespace {
+// the records start on the cache line after the header
+constexpr size_t RECORDS_OFFSET = sizeof(ShmRingHeader);
+static_assert(RECORDS_OFFSET % CACHE_LINE_SIZE == 0, "ring records must start on a cache line");
+
+std::string shmPath(const std::string &name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+}
+
+ShmRing::ShmRing(std::string name, void *memory, size_t size, bool owner)
+    : name(std::move(name)), memory(memory), size(size), owner(owner) {
+    journal = std::make_unique<EventJournal>(static_cast<char *>(memory) + RECORDS_OFFSET, header().capacity);
+}
+
+ShmRing::~ShmRing() {
+    munmap(memory, size);
+    if (owner) {
+        shm_unlink(name.c_str());
+    }
+}
+
+std::unique_ptr<ShmRing> ShmRing::create(const std::string &name, size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    std::string path = shmPath(name);
+    shm_unlink(path.c_str());
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Could not create shared memory ring " + path);
+    }
+    size_t size = RECORDS_OFFSET + EventJournal::memorySize(rounded);
+    // a new object reads as zeros, which is an empty ring
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        shm_unlink(path.c_str());
+        throw std::runtime_error("Could not size shared memory ring " + path);
+    }
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(path.c_str());
+        throw std::runtime_error("Could not map shared memory ring " + path);
+    }
+    ShmRingHeader &header = *static_cast<ShmRingHeader *>(memory);
+    header.version = ShmRingHeader::VERSION;
+    header.record_size = sizeof(EventRecord);
+    header.capacity = rounded;
+    header.last_sequence.store(0, std::memory_order_relaxed);
+    header.magic.store(ShmRingHeader::MAGIC, std::memory_order_release);
+    return std::unique_ptr<ShmRing>(new ShmRing(path, memory, size, true));
+}
+
+std::unique_ptr<ShmRing> ShmRing::open(const std::string &name) {
+    std::string path = shmPath(name);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Shared memory ring " + path + " does not exist");
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < RECORDS_OFFSET) {
+        close(fd);
+        throw std::runtime_error("Shared memory ring " + path + " is not ready");
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    void *memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("Could not map shared memory ring " + path);
+    }
+    const ShmRingHeader &header = *static_cast<const ShmRingHeader *>(memory);
+    if (header.magic.load(std::memory_order_acquire) != ShmRingHeader::MAGIC || header.version != ShmRingHeader::VERSION
+        || header.record_size != sizeof(EventRecord) || RECORDS_OFFSET + EventJournal::memorySize(header.capacity) > size) {
+        munmap(memory, size);
+        throw std::runtime_error("Shared memory ring " + path + " is not ready");
+    }
+    return std::unique_ptr<ShmRing>(new ShmRing(path, memory, size, false));
+}
+
+ShmEventPublisher::ShmEventPublisher(std::unique_ptr<EventHandler> handler, const std::string &name, size_t capacity, size_t streams)
+    : JournalEventHandler(std::move(handler)) {
+    for (size_t stream = 0; stream < streams; ++stream) {
+        rings.push_back(ShmRing::create(ringName(name, static_cast<uint16_t>(stream)), capacity));
+    }
+}
+
+std::string ShmEventPublisher::ringName(const std::string &name, uint16_t stream) {
+    return name + "." + std::to_string(stream);
+}
+
+void ShmEventPublisher::append(const EventRecord &record, uint16_t stream) {
+    if (stream >= rings.size() || record.sequence == 0) {
+        return;
+    }
+    ShmRing &ring = *rings[stream];
+    ring.records().append(record);
+    ring.header().last_sequence.store(record.sequence, std::memory_order_release);
+}
+
+ShmEventReader::ShmEventReader(const std::string &ring_name) : ring(ShmRing::open(ring_name)) {}
+
+uint64_t ShmEventReader::getLastSequence() const {
+    return ring->header().last_sequence.load(std::memory_order_acquire);
+}
+
+bool ShmEventReader::readFrom(uint64_t sequence, std::vector<EventRecord> &records, size_t max_records) const {
+    return ring->records().readFrom(sequence, records, max_records);
+}
+}
@@ -0,0 +1,160 @@
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+#include "book_export.h"
+
+namespace QuantaTrader {
+
+namespace {
+const char *LEVEL_KIND_NAMES[] = {"LIMIT", "ALL OR NONE", "PRIMARY PEGGED", "MIDPOINT PEGGED", "MARKET PEGGED", "STOP", "TRAILING STOP"};
+
+// reads the record at offset and moves past it, false if data ends first
+template <typename T>
+bool read(const char *data, size_t size, size_t &offset, T &record) {
+    if (size - offset < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&record, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+}
+
+ExportOrderRecord toExportRecord(const Order &order) {
+    return ExportOrderRecord{order.getId(), order.getPrice(), order.getStopPrice(), order.getQuantity(), order.getOpenQuantity(),
+        order.getVisibleQuantity(), order.getPeakQuantity(), order.getTrailAmount(), order.getPegOffset(), order.getTimestamp(),
+        order.getOwnerId(), order.getType(), order.getSide(), order.getTimeInForce(), order.getSelfTradePrevention()};
+}
+
+void ExportBuffer::begin(uint64_t sequence, Timestamp timestamp) {
+    used = 0;
+    book_count = 0;
+    append(ExportHeader{ExportHeader::MAGIC, ExportHeader::VERSION, 0, sequence, timestamp});
+}
+
+void ExportBuffer::endBook() {
+    ++book_count;
+    ExportHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    header.book_count = book_count;
+    patch(0, header);
+}
+
+void ExportBuffer::writeFile(const std::string &path) const {
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    bool written = std::fwrite(bytes.data(), 1, used, file) == used;
+    if (std::fclose(file) != 0 || !written) {
+        throw std::runtime_error("Could not write " + path);
+    }
+}
+
+BookExporter::BookExporter() : thread(&BookExporter::run, this) {}
+
+BookExporter::~BookExporter() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    work.notify_one();
+    thread.join();
+}
+
+std::unique_ptr<ExportBuffer> BookExporter::acquire() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (free_buffers.empty()) {
+        return std::make_unique<ExportBuffer>();
+    }
+    std::unique_ptr<ExportBuffer> buffer = std::move(free_buffers.back());
+    free_buffers.pop_back();
+    return buffer;
+}
+
+void BookExporter::submit(std::unique_ptr<ExportBuffer> buffer, std::string path) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(Job{std::move(buffer), std::move(path)});
+        ++pending;
+    }
+    work.notify_one();
+}
+
+size_t BookExporter::flush() {
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&] { return pending == 0; });
+    size_t failed = failures;
+    failures = 0;
+    return failed;
+}
+
+void BookExporter::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        work.wait(guard, [&] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+            return;
+        }
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        guard.unlock();
+        bool written = true;
+        try {
+            job.buffer->writeFile(job.path);
+        } catch (const std::runtime_error &) {
+            written = false;
+        }
+        guard.lock();
+        failures += written ? 0 : 1;
+        free_buffers.push_back(std::move(job.buffer));
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    }
+}
+
+bool renderExport(const char *data, size_t size, std::ostream &os) {
+    size_t offset = 0;
+    ExportHeader header;
+    if (!read(data, size, offset, header) || header.magic != ExportHeader::MAGIC || header.version != ExportHeader::VERSION) {
+        return false;
+    }
+    os << "SEQUENCE: " << header.sequence << "\n";
+    os << "TIMESTAMP: " << header.timestamp << "\n";
+    for (uint32_t book_index = 0; book_index < header.book_count; ++book_index) {
+        ExportBookRecord book;
+        if (!read(data, size, offset, book)) {
+            return false;
+        }
+        os << "SYMBOL ID : " << book.symbol_id << "\n";
+        os << "LAST TRADED PRICE: " << book.last_traded_price << "\n";
+        os << "ORDERS: " << book.order_count << "\n";
+        for (uint32_t level_index = 0; level_index < book.level_count; ++level_index) {
+            ExportLevelRecord level;
+            if (!read(data, size, offset, level) || static_cast<size_t>(level.kind) >= std::size(LEVEL_KIND_NAMES)) {
+                return false;
+            }
+            os << sideToString(level.side) << " " << LEVEL_KIND_NAMES[static_cast<size_t>(level.kind)] << " "
+                << level.price << " | " << level.volume << "\n";
+            for (uint32_t order_index = 0; order_index < level.order_count; ++order_index) {
+                ExportOrderRecord order;
+                if (!read(data, size, offset, order)) {
+                    return false;
+                }
+                os << "    Order [ID: " << order.id
+                    << ", Type: " << typeToString(order.type)
+                    << ", TIF: " << timeInForceToString(order.time_in_force)
+                    << ", Owner ID: " << order.owner_id
+                    << ", Price: " << order.price
+                    << ", Quantity: " << order.quantity
+                    << ", Open Quantity: " << order.open_quantity
+                    << ", Visible Quantity: " << order.visible_quantity
+                    << ", Timestamp: " << order.timestamp << "]\n";
+            }
+        }
+        os << "\n";
+    }
+    return offset == size;
+}
+}
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include "book_snapshot.h"
+
+namespace QuantaTrader {
+
+namespace {
+// position of a level in export order: its map, buy before sell, then its price
+std::tuple<uint8_t, bool, uint64_t> exportPosition(const ExportLevelRecord &level) {
+    return {static_cast<uint8_t>(level.kind), level.side == OrderSide::SELL, level.price};
+}
+}
+
+BookSnapshot::BookSnapshot(OrderBook &book, const BookSnapshot *previous, ExportBuffer &scratch) {
+    scratch.begin(0, 0);
+    book.captureChanges(scratch, previous == nullptr);
+    const char *data = scratch.data() + sizeof(ExportHeader);
+    std::memcpy(&record, data, sizeof(record));
+    levels.reserve(record.level_count);
+    size_t offset = sizeof(record);
+    size_t shared = 0;
+    for (uint32_t level_index = 0; level_index < record.level_count; ++level_index) {
+        ExportLevelRecord level;
+        std::memcpy(&level, data + offset, sizeof(level));
+        if (level.reserved == EXPORT_LEVEL_UNCHANGED) {
+            // both captures are in export order, so the previous one is walked once for all the unchanged levels
+            ExportLevelRecord previous_level{};
+            for (; shared < previous->levels.size(); ++shared) {
+                std::memcpy(&previous_level, previous->levels[shared]->data(), sizeof(previous_level));
+                if (exportPosition(previous_level) >= exportPosition(level)) {
+                    break;
+                }
+            }
+            if (shared == previous->levels.size() || exportPosition(previous_level) != exportPosition(level)) {
+                throw std::runtime_error("Unchanged level is missing from the previous capture");
+            }
+            levels.push_back(previous->levels[shared++]);
+            offset += sizeof(level);
+            continue;
+        }
+        size_t size = sizeof(level) + level.order_count * sizeof(ExportOrderRecord);
+        levels.push_back(std::make_shared<const LevelBytes>(data + offset, data + offset + size));
+        offset += size;
+    }
+}
+
+void BookSnapshot::exportBinary(ExportBuffer &buffer) const {
+    buffer.append(record);
+    for (const std::shared_ptr<const LevelBytes> &bytes : levels) {
+        buffer.appendBytes(bytes->data(), bytes->size());
+    }
+}
+
+const BookSnapshot *EngineSnapshot::findBook(uint32_t symbol_id) const {
+    return shareBook(symbol_id).get();
+}
+
+std::shared_ptr<const BookSnapshot> EngineSnapshot::shareBook(uint32_t symbol_id) const {
+    auto it = std::lower_bound(books.begin(), books.end(), symbol_id,
+        [](const std::shared_ptr<const BookSnapshot> &book, uint32_t id) { return book->getSymbolId() < id; });
+    return it != books.end() && (*it)->getSymbolId() == symbol_id ? *it : nullptr;
+}
+
+void EngineSnapshot::exportBinary(ExportBuffer &buffer) const {
+    buffer.begin(sequence, timestamp);
+    for (const std::shared_ptr<const BookSnapshot> &book : books) {
+        book->exportBinary(buffer);
+        buffer.endBook();
+    }
+}
+}
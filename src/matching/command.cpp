@@ -0,0 +1,73 @@
+#include "command.h"
+
+namespace QuantaTrader {
+
+Command Command::addOrder(const Order &order) {
+    Command command{};
+    command.type = CommandType::ADD_ORDER;
+    command.symbol_id = order.getSymbolId();
+    command.order_id = order.getId();
+    command.order = order;
+    return command;
+}
+
+Command Command::deleteOrder(uint32_t symbol_id, uint64_t order_id) {
+    Command command{};
+    command.type = CommandType::DELETE_ORDER;
+    command.symbol_id = symbol_id;
+    command.order_id = order_id;
+    return command;
+}
+
+Command Command::cancelOrder(uint32_t symbol_id, uint64_t order_id, uint64_t cancelled_quantity) {
+    Command command{};
+    command.type = CommandType::CANCEL_ORDER;
+    command.symbol_id = symbol_id;
+    command.order_id = order_id;
+    command.quantity = cancelled_quantity;
+    return command;
+}
+
+Command Command::modifyOrder(uint32_t symbol_id, uint64_t order_id, uint64_t new_order_id, uint64_t new_price) {
+    Command command{};
+    command.type = CommandType::MODIFY_ORDER;
+    command.symbol_id = symbol_id;
+    command.order_id = order_id;
+    command.new_order_id = new_order_id;
+    command.price = new_price;
+    return command;
+}
+
+Command Command::executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quantity, uint64_t price) {
+    Command command{};
+    command.type = CommandType::EXECUTE_ORDER_AT_PRICE;
+    command.symbol_id = symbol_id;
+    command.order_id = order_id;
+    command.quantity = quantity;
+    command.price = price;
+    return command;
+}
+
+Command Command::executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quantity) {
+    Command command{};
+    command.type = CommandType::EXECUTE_ORDER;
+    command.symbol_id = symbol_id;
+    command.order_id = order_id;
+    command.quantity = quantity;
+    return command;
+}
+
+Command Command::startAuction(uint32_t symbol_id) {
+    Command command{};
+    command.type = CommandType::START_AUCTION;
+    command.symbol_id = symbol_id;
+    return command;
+}
+
+Command Command::uncrossAuction(uint32_t symbol_id) {
+    Command command{};
+    command.type = CommandType::UNCROSS_AUCTION;
+    command.symbol_id = symbol_id;
+    return command;
+}
+}
@@ -1,18 +1,37 @@
+#include <algorithm>
 #include <sstream>
 #include <fstream>
 #include "engine.h"
 #include "price_level_order_book.h"
+#include "numa.h"
 
 namespace QuantaTrader {
-OrderBookHandler::OrderBookHandler(std::unique_ptr<EventHandler> event_handler): event_handler(std::move(event_handler)) {}
+OrderBookHandler::OrderBookHandler(std::unique_ptr<EventHandler> event_handler, Clock &clock, RiskCheck *risk_check, int cpu,
+    bool route_orders)
+    : route_orders(route_orders), cpu(cpu), arena(HUGE_PAGE_SIZE, numaNodeOfCpu(cpu)), event_handler(std::move(event_handler)), clock(clock),
+    risk_check(risk_check) {
+    if (risk_check != nullptr) {
+        // the books report to the risk check first
+        this->event_handler = std::make_unique<RiskEventHandler>(std::move(this->event_handler), *risk_check);
+    }
+}
 
 void OrderBookHandler::addOrderBook(uint32_t symbol_id, std::string symbol_name) {
     auto it = symbol_to_order_book.find(symbol_id);
     if (it != symbol_to_order_book.end()) {
         throw std::runtime_error("Symbol already exists in the book");
     }
-    symbol_to_order_book.insert({symbol_id, std::make_unique<PriceLevelOrderBook>(symbol_id, *event_handler)});
-    SymbolAdded symbol_added_event(symbol_id, std::move(symbol_name));
+    std::unique_ptr<PriceLevelOrderBook> book;
+    // first touched on the engine's cpu, so the parts of the book outside the arena land on its node too
+    runOnCpu(cpu, [&] {
+        book = std::make_unique<PriceLevelOrderBook>(symbol_id, *event_handler, clock, &sequencer, &arena);
+    });
+    if (route_orders) {
+        book->setRouter(&router);
+    }
+    symbol_to_order_book.insert({symbol_id, std::move(book)});
+    symbol_owners[symbol_id];
+    SymbolAdded symbol_added_event(symbol_id, std::move(symbol_name), stamp());
     event_handler->handleSymbolAdded(symbol_added_event);
 }
 
@@ -22,17 +41,31 @@ void OrderBookHandler::deleteOrderBook(uint32_t symbol_id, std::string symbol_na
         throw std::runtime_error("Symbol does not exist in the book");
     }
     symbol_to_order_book.erase(it);
-    SymbolDeleted symbol_deleted_event(symbol_id, std::move(symbol_name));
+    symbol_owners.erase(symbol_id);
+    deleted_symbols.push_back(symbol_id);
+    SymbolDeleted symbol_deleted_event(symbol_id, std::move(symbol_name), stamp());
     event_handler->handleSymbolDeleted(symbol_deleted_event);
 }
 
-void OrderBookHandler::addOrder(const Order &order) {
+bool OrderBookHandler::addOrder(const Order &order) {
     auto it = symbol_to_order_book.find(order.getSymbolId());
     if (it == symbol_to_order_book.end()) {
         throw std::runtime_error("Symbol does not exist in the book");
     }
     OrderBook *book = it->second.get();
-    book->addOrder(order);
+    RejectReason reason;
+    if (risk_check != nullptr && !risk_check->check(order, *book, reason)) {
+        // stamped by the book, the engine's own stream is not written from matching threads
+        book->rejectOrder(order, reason);
+        return false;
+    }
+    if (!book->addOrder(order)) {
+        return false;
+    }
+    if (order.getOwnerId() != 0) {
+        symbol_owners.find(order.getSymbolId())->second.insert(order.getOwnerId());
+    }
+    return true;
 }
 
 void OrderBookHandler::deleteOrder(uint32_t symbol_id, uint64_t order_id) {
@@ -50,6 +83,9 @@ void OrderBookHandler::cancelOrder(uint32_t symbol_id, uint64_t order_id, uint64
         throw std::runtime_error("Symbol does not exist in the book");
     }
     OrderBook *book = it->second.get();
+    if (risk_check != nullptr) {
+        risk_check->orderResized(book->getOrder(order_id), cancelled_quantity);
+    }
     book->cancelOrder(order_id, cancelled_quantity);
 }
 
@@ -80,6 +116,163 @@ void OrderBookHandler::executeOrder(uint32_t symbol_id, uint64_t order_id, uint6
     book->executeOrder(order_id, quantity);
 }
 
+void OrderBookHandler::startAuction(uint32_t symbol_id) {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    OrderBook *book = it->second.get();
+    book->startAuction();
+}
+
+void OrderBookHandler::uncrossAuction(uint32_t symbol_id) {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    OrderBook *book = it->second.get();
+    book->uncross();
+}
+
+size_t OrderBookHandler::cancelAllOrders(uint32_t symbol_id) {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    OrderBook *book = it->second.get();
+    return book->cancelAllOrders();
+}
+
+size_t OrderBookHandler::cancelSideOrders(uint32_t symbol_id, OrderSide side) {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    OrderBook *book = it->second.get();
+    return book->cancelSideOrders(side);
+}
+
+size_t OrderBookHandler::cancelPriceRange(uint32_t symbol_id, OrderSide side, uint64_t low, uint64_t high) {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    OrderBook *book = it->second.get();
+    return book->cancelPriceRange(side, low, high);
+}
+
+size_t OrderBookHandler::cancelOwnerOrders(uint32_t symbol_id, uint32_t owner_id) {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    OrderBook *book = it->second.get();
+    return book->cancelOwnerOrders(owner_id);
+}
+
+size_t OrderBookHandler::cancelOwnerOrders(uint32_t owner_id) {
+    size_t cancelled = 0;
+    for (auto &[symbol_id, owners] : symbol_owners) {
+        if (owners.erase(owner_id) != 0) {
+            cancelled += symbol_to_order_book.find(symbol_id)->second->cancelOwnerOrders(owner_id);
+        }
+    }
+    return cancelled;
+}
+
+std::vector<uint64_t> OrderBookHandler::getOwnerOrderIds(uint32_t symbol_id, uint32_t owner_id) const {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    return it->second->getOwnerOrderIds(owner_id);
+}
+
+OwnerExposure OrderBookHandler::getOwnerExposure(uint32_t symbol_id, uint32_t owner_id) const {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    return it->second->getOwnerExposure(owner_id);
+}
+
+OwnerExposure OrderBookHandler::getOwnerExposure(uint32_t owner_id) const {
+    OwnerExposure total{};
+    for (const auto &[symbol_id, owners] : symbol_owners) {
+        if (owners.count(owner_id) == 0) {
+            continue;
+        }
+        OwnerExposure exposure = symbol_to_order_book.find(symbol_id)->second->getOwnerExposure(owner_id);
+        total.order_count += exposure.order_count;
+        total.buy_quantity += exposure.buy_quantity;
+        total.sell_quantity += exposure.sell_quantity;
+        total.buy_notional += exposure.buy_notional;
+        total.sell_notional += exposure.sell_notional;
+    }
+    return total;
+}
+
+std::vector<uint32_t> OrderBookHandler::getOwnerSymbols(uint32_t owner_id) const {
+    std::vector<uint32_t> symbols;
+    for (const auto &[symbol_id, owners] : symbol_owners) {
+        if (owners.count(owner_id) != 0) {
+            symbols.push_back(symbol_id);
+        }
+    }
+    return symbols;
+}
+
+void OrderBookHandler::exportBinary(ExportBuffer &buffer) const {
+    buffer.begin(sequencer.getLast(), clock.now());
+    for (const auto& [symbol_id, book_ptr] : symbol_to_order_book) {
+        book_ptr->exportBinary(buffer);
+    }
+}
+
+void OrderBookHandler::setSequencer(uint32_t symbol_id, EventSequencer *sequencer) {
+    auto it = symbol_to_order_book.find(symbol_id);
+    if (it == symbol_to_order_book.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    it->second->setSequencer(sequencer != nullptr ? sequencer : &this->sequencer);
+}
+
+uint32_t OrderBookHandler::routeOrder(uint64_t order_id) const {
+    if (!route_orders) {
+        throw std::runtime_error("Orders are not routed by id in this engine");
+    }
+    uint32_t symbol_id;
+    if (!router.find(order_id, symbol_id)) {
+        throw std::runtime_error("Order does not exist in the engine");
+    }
+    return symbol_id;
+}
+
+uint64_t OrderBookHandler::publishSnapshot() {
+    std::shared_ptr<const EngineSnapshot> previous = std::atomic_load(&snapshot);
+    uint64_t epoch = previous ? previous->getEpoch() + 1 : 1;
+    auto next = std::make_shared<EngineSnapshot>(epoch, sequencer.getLast(), clock.now());
+    next->books.reserve(symbol_to_order_book.size());
+    for (const auto& [symbol_id, book_ptr] : symbol_to_order_book) {
+        std::shared_ptr<const BookSnapshot> captured = previous ? previous->shareBook(symbol_id) : nullptr;
+        if (std::find(deleted_symbols.begin(), deleted_symbols.end(), symbol_id) != deleted_symbols.end()) {
+            captured = nullptr; // the capture is of a book since deleted, not of this one
+        }
+        if (!captured || captured->getSymbolSequence() != book_ptr->getSymbolSequence()) {
+            // the book changed, copy the levels that did and share the rest with its last capture
+            captured = std::make_shared<const BookSnapshot>(*book_ptr, captured.get(), snapshot_buffer);
+        }
+        next->books.push_back(std::move(captured));
+    }
+    std::sort(next->books.begin(), next->books.end(),
+        [](const std::shared_ptr<const BookSnapshot> &a, const std::shared_ptr<const BookSnapshot> &b) {
+            return a->getSymbolId() < b->getSymbolId();
+        });
+    deleted_symbols.clear();
+    std::atomic_store(&snapshot, std::shared_ptr<const EngineSnapshot>(std::move(next)));
+    return epoch;
+}
+
 std::string OrderBookHandler::toString() {
     std::ostringstream oss;
 
@@ -96,7 +289,8 @@ std::string OrderBookHandler::toString() {
 }
 
 // constructor 
-Engine::Engine(std::unique_ptr<EventHandler> event_handler): orderbook_handler(std::make_unique<OrderBookHandler>(std::move(event_handler))) {}
+Engine::Engine(std::unique_ptr<EventHandler> event_handler, Clock &clock, RiskCheck *risk_check, int cpu, bool route_orders)
+    : orderbook_handler(std::make_unique<OrderBookHandler>(std::move(event_handler), clock, risk_check, cpu, route_orders)) {}
 
 void Engine::addSymbol(uint32_t symbol_id, const std::string &symbol_name) {
     symbol_id_to_symbol[symbol_id] = std::make_unique<Symbol>(symbol_id, symbol_name);
@@ -115,8 +309,8 @@ bool Engine::hasSymbol(uint32_t symbol_id) const {
     return symbol_id_to_symbol.count(symbol_id) > 0;
 }
 
-void Engine::addOrder(const Order &order) {
-    orderbook_handler->addOrder(order);
+bool Engine::addOrder(const Order &order) {
+    return orderbook_handler->addOrder(order);
 }
 
 void Engine::deleteOrder(uint32_t symbol_id, uint64_t order_id) {
@@ -139,6 +333,119 @@ void Engine::executeOrder(uint32_t symbol_id, uint64_t order_id, uint64_t quanti
     orderbook_handler->executeOrder(symbol_id, order_id, quantity);
 }
 
+void Engine::deleteOrderById(uint64_t order_id) {
+    orderbook_handler->deleteOrder(orderbook_handler->routeOrder(order_id), order_id);
+}
+
+void Engine::cancelOrderById(uint64_t order_id, uint64_t cancelled_quantity) {
+    orderbook_handler->cancelOrder(orderbook_handler->routeOrder(order_id), order_id, cancelled_quantity);
+}
+
+void Engine::modifyOrderById(uint64_t order_id, uint64_t new_order_id, uint64_t new_price) {
+    orderbook_handler->modifyOrder(orderbook_handler->routeOrder(order_id), order_id, new_order_id, new_price);
+}
+
+void Engine::executeOrderById(uint64_t order_id, uint64_t quantity, uint64_t price) {
+    orderbook_handler->executeOrder(orderbook_handler->routeOrder(order_id), order_id, quantity, price);
+}
+
+void Engine::executeOrderById(uint64_t order_id, uint64_t quantity) {
+    orderbook_handler->executeOrder(orderbook_handler->routeOrder(order_id), order_id, quantity);
+}
+
+bool Engine::findOrderSymbol(uint64_t order_id, uint32_t &symbol_id) const {
+    return orderbook_handler->findOrderSymbol(order_id, symbol_id);
+}
+
+void Engine::startAuction(uint32_t symbol_id) {
+    orderbook_handler->startAuction(symbol_id);
+}
+
+void Engine::uncrossAuction(uint32_t symbol_id) {
+    orderbook_handler->uncrossAuction(symbol_id);
+}
+
+size_t Engine::cancelAllOrders(uint32_t symbol_id) {
+    return orderbook_handler->cancelAllOrders(symbol_id);
+}
+
+size_t Engine::cancelSideOrders(uint32_t symbol_id, OrderSide side) {
+    return orderbook_handler->cancelSideOrders(symbol_id, side);
+}
+
+size_t Engine::cancelPriceRange(uint32_t symbol_id, OrderSide side, uint64_t low, uint64_t high) {
+    return orderbook_handler->cancelPriceRange(symbol_id, side, low, high);
+}
+
+size_t Engine::cancelOwnerOrders(uint32_t symbol_id, uint32_t owner_id) {
+    return orderbook_handler->cancelOwnerOrders(symbol_id, owner_id);
+}
+
+size_t Engine::cancelOwnerOrders(uint32_t owner_id) {
+    return orderbook_handler->cancelOwnerOrders(owner_id);
+}
+
+std::vector<uint64_t> Engine::getOwnerOrderIds(uint32_t symbol_id, uint32_t owner_id) const {
+    return orderbook_handler->getOwnerOrderIds(symbol_id, owner_id);
+}
+
+OwnerExposure Engine::getOwnerExposure(uint32_t symbol_id, uint32_t owner_id) const {
+    return orderbook_handler->getOwnerExposure(symbol_id, owner_id);
+}
+
+OwnerExposure Engine::getOwnerExposure(uint32_t owner_id) const {
+    return orderbook_handler->getOwnerExposure(owner_id);
+}
+
+std::vector<uint32_t> Engine::getOwnerSymbols(uint32_t owner_id) const {
+    return orderbook_handler->getOwnerSymbols(owner_id);
+}
+
+uint64_t Engine::getLastSequence() const {
+    return orderbook_handler->getLastSequence();
+}
+
+void Engine::setSequencer(uint32_t symbol_id, EventSequencer *sequencer) {
+    orderbook_handler->setSequencer(symbol_id, sequencer);
+}
+
+ArenaStats Engine::getArenaStats() const {
+    return orderbook_handler->getArenaStats();
+}
+
+int Engine::getCpu() const {
+    return orderbook_handler->getCpu();
+}
+
+bool Engine::process(const Command &command) {
+    switch (command.type) {
+        case CommandType::ADD_ORDER:
+            return addOrder(command.order);
+        case CommandType::DELETE_ORDER:
+            deleteOrder(command.symbol_id, command.order_id);
+            break;
+        case CommandType::CANCEL_ORDER:
+            cancelOrder(command.symbol_id, command.order_id, command.quantity);
+            break;
+        case CommandType::MODIFY_ORDER:
+            modifyOrder(command.symbol_id, command.order_id, command.new_order_id, command.price);
+            break;
+        case CommandType::EXECUTE_ORDER:
+            executeOrder(command.symbol_id, command.order_id, command.quantity);
+            break;
+        case CommandType::EXECUTE_ORDER_AT_PRICE:
+            executeOrder(command.symbol_id, command.order_id, command.quantity, command.price);
+            break;
+        case CommandType::START_AUCTION:
+            startAuction(command.symbol_id);
+            break;
+        case CommandType::UNCROSS_AUCTION:
+            uncrossAuction(command.symbol_id);
+            break;
+    }
+    return true;
+}
+
 std::string Engine::toString() const {
     return orderbook_handler->toString();
 }
@@ -148,9 +455,27 @@ std::ostream &operator<<(std::ostream &os, const Engine &engine) {
     return os;
 }
 
+void Engine::exportBinary(ExportBuffer &buffer) const {
+    orderbook_handler->exportBinary(buffer);
+}
+
 void Engine::exportEngine(const std::string &name) const {
-    std::ofstream file(name);
-    file << *this;
-    file.close();
+    ExportBuffer buffer;
+    exportBinary(buffer);
+    buffer.writeFile(name);
+}
+
+uint64_t Engine::publishSnapshot() {
+    return orderbook_handler->publishSnapshot();
+}
+
+std::shared_ptr<const EngineSnapshot> Engine::getSnapshot() const {
+    return orderbook_handler->getSnapshot();
+}
+
+void Engine::exportEngine(BookExporter &exporter, const std::string &name) const {
+    std::unique_ptr<ExportBuffer> buffer = exporter.acquire();
+    exportBinary(*buffer);
+    exporter.submit(std::move(buffer), name);
 }
 }
\ No newline at end of file
@@ -3,78 +3,192 @@
 #include "order.h"
 
 namespace QuantaTrader {
-Level::Level(uint64_t price, LevelSide side, uint32_t symbol_id) {
+Level::Level(uint64_t price, LevelSide side, uint32_t symbol_id, RestingOrderTable *order_table, VolumeLadder *ladder,
+    HugePageArena *arena)
+    : removed_behind_front(ArenaAllocator<uint64_t>(arena)) {
     this->price = price;
+    this->order_table = order_table;
     this->side = side;
     this->symbol_id = symbol_id;
     this->volume = 0;
+    this->ladder = ladder;
+    this->changed = true;
+    this->queue_tail = 0;
+    this->queue_head = 0;
+    this->next_slot = 0;
 }
 
-const list<Order> &Level::getOrders() const {
+const list<RestingOrder> &Level::getOrders() const {
     return orders;
 }
 
-list<Order> &Level::getOrders() {
+list<RestingOrder> &Level::getOrders() {
     return orders;
 }
 
-Order &Level::front() {
+uint64_t Level::getQuantityAhead(const RestingOrder &order) const {
+    if (&orders.front() == &order) {
+        return 0;
+    }
+    const OrderCold &order_cold = cold(order);
+    uint64_t removed = queue_head + removedBefore(order_cold.queue_slot);
+    return order_cold.queue_entry > removed ? order_cold.queue_entry - removed : 0;
+}
+
+RestingOrder &Level::front() {
     assert(!orders.empty());
     return orders.front();
 }
 
-Order &Level::back() {
+RestingOrder &Level::back() {
     assert(!orders.empty());
     return orders.back();
 }
 
 void Level::removeFront() {
+    changed = true;
     assert(!orders.empty());
-    Order &remove = orders.front();
-    volume -= remove.getOpenQuantity();
+    RestingOrder &remove = orders.front();
+    dequeue(remove, remove.getVisibleQuantity());
+    subtractVolume(remove.getVisibleQuantity());
     orders.pop_front();
 }
 
 void Level::removeBack() {
+    changed = true;
     assert(!orders.empty());
-    Order &remove = orders.back();
-    volume -= remove.getOpenQuantity();
+    RestingOrder &remove = orders.back();
+    dequeue(remove, remove.getVisibleQuantity());
+    subtractVolume(remove.getVisibleQuantity());
     orders.pop_back();
 }
 
-void Level::addOrder(Order &order) {
+void Level::addOrder(RestingOrder &order) {
     if (order.getSide() == OrderSide::SELL) {
         assert(side == LevelSide::SELL);
     } else {
         assert(side == LevelSide::BUY);
     }
     assert(order.getSymbolId() == symbol_id);
-    volume += order.getOpenQuantity();
+    changed = true;
+    if (orders.empty()) {
+        // nothing is ahead of anyone, start counting from scratch
+        queue_tail = 0;
+        queue_head = 0;
+        next_slot = 0;
+        removed_behind_front.clear(); // the tree is rebuilt when a second order joins
+    } else if (next_slot + 1 >= removed_behind_front.size()) {
+        compactQueue();
+    }
+    OrderCold &order_cold = cold(order);
+    order_cold.queue_entry = queue_tail;
+    order_cold.queue_slot = next_slot++;
+    queue_tail += order.getVisibleQuantity();
+    addVolume(order.getVisibleQuantity());
     orders.push_back(order);
 }
 
-void Level::deleteOrder(const Order &order) {
-    volume -= order.getOpenQuantity();
-    orders.erase(boost::intrusive::list<Order>::s_iterator_to(order));
+void Level::deleteOrder(const RestingOrder &order) {
+    changed = true;
+    dequeue(order, order.getVisibleQuantity());
+    subtractVolume(order.getVisibleQuantity());
+    orders.erase(boost::intrusive::list<RestingOrder>::s_iterator_to(order));
+}
+
+void Level::clear() {
+    changed = true;
+    subtractVolume(volume);
+    orders.clear();
+    queue_tail = 0;
+    queue_head = 0;
+    next_slot = 0;
+    removed_behind_front.clear();
+}
+
+void Level::replenish(RestingOrder &order) {
+    assert(order.getVisibleQuantity() == 0);
+    // a fresh peak loses its time priority, the order moves to the back without leaving the book
+    orders.erase(boost::intrusive::list<RestingOrder>::s_iterator_to(order));
+    OrderRef(order, cold(order)).replenish();
+    addOrder(order);
 }
 
-void Level::reduceVolume(uint64_t amount) {
+void Level::reduceVolume(const RestingOrder &order, uint64_t amount) {
+    changed = true;
     assert(volume >= amount);
-    volume -= amount;
+    dequeue(order, amount);
+    subtractVolume(amount);
 }
 
 void Level::popFront() {
-    Order &order_to_remove = orders.front();
-    volume -= order_to_remove.getOpenQuantity();
+    changed = true;
+    RestingOrder &order_to_remove = orders.front();
+    dequeue(order_to_remove, order_to_remove.getVisibleQuantity());
+    subtractVolume(order_to_remove.getVisibleQuantity());
     orders.pop_front();
 };
 
 void Level::popBack() {
-    Order &order_to_remove = orders.back();
-    volume -= order_to_remove.getOpenQuantity();
+    changed = true;
+    RestingOrder &order_to_remove = orders.back();
+    dequeue(order_to_remove, order_to_remove.getVisibleQuantity());
+    subtractVolume(order_to_remove.getVisibleQuantity());
     orders.pop_back();
 }
 
+void Level::addVolume(uint64_t amount) {
+    volume += amount;
+    if (ladder != nullptr) {
+        ladder->add(price, amount);
+    }
+}
+
+void Level::subtractVolume(uint64_t amount) {
+    volume -= amount;
+    if (ladder != nullptr) {
+        ladder->remove(price, amount);
+    }
+}
+
+OrderCold &Level::cold(const RestingOrder &order) const {
+    return order_table->cold(order).cold;
+}
+
+void Level::dequeue(const RestingOrder &order, uint64_t amount) {
+    if (&orders.front() == &order) {
+        queue_head += amount;
+        return;
+    }
+    for (size_t i = cold(order).queue_slot + 1; i < removed_behind_front.size(); i += i & (~i + 1)) {
+        removed_behind_front[i] += amount;
+    }
+}
+
+uint64_t Level::removedBefore(uint32_t slot) const {
+    uint64_t removed = 0;
+    for (size_t i = slot; i > 0; i -= i & (~i + 1)) {
+        removed += removed_behind_front[i];
+    }
+    return removed;
+}
+
+void Level::compactQueue() {
+    // renumber the resting orders from slot 0, their quantity ahead is exact after the walk
+    uint64_t enqueued = 0;
+    uint32_t slot = 0;
+    for (RestingOrder &order : orders) {
+        OrderCold &order_cold = cold(order);
+        order_cold.queue_entry = enqueued;
+        order_cold.queue_slot = slot++;
+        enqueued += order.getVisibleQuantity();
+    }
+    queue_tail = enqueued;
+    queue_head = 0;
+    next_slot = slot;
+    // leave room for as many enqueues as there are resting orders before the next walk
+    removed_behind_front.assign(std::max<size_t>(16, 2 * (static_cast<size_t>(slot) + 1)), 0);
+}
+
 std::string Level::toString() const {
     std::string out;
     out += std::to_string(price) + " | " + std::to_string(volume) + "\n";
@@ -85,4 +199,4 @@ std::ostream &operator<<(std::ostream &os, const Level &level) {
     os << level.toString();
     return os;
 }
-}
\ No newline at end of file
+}
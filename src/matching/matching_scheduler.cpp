@@ -0,0 +1,238 @@
+#include <stdexcept>
+#include <mutex>
+#include "matching_scheduler.h"
+
+namespace QuantaTrader {
+
+namespace {
+uint64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+}
+
+MatchingScheduler::MatchingScheduler(Engine &engine, size_t num_workers, size_t symbol_queue_capacity, size_t batch_size)
+    : engine(engine),
+    symbol_queue_capacity(symbol_queue_capacity),
+    batch_size(batch_size),
+    running(false),
+    run_ns(0) {
+    if (num_workers == 0) {
+        throw std::runtime_error("Scheduler needs at least one worker");
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers.push_back(std::make_unique<Worker>(static_cast<uint16_t>(i + 1)));
+    }
+}
+
+MatchingScheduler::~MatchingScheduler() {
+    stop();
+}
+
+void MatchingScheduler::addSymbol(uint32_t symbol_id) {
+    if (running.load(std::memory_order_acquire)) {
+        throw std::runtime_error("Symbols must be added before the scheduler starts");
+    }
+    if (!engine.hasSymbol(symbol_id)) {
+        throw std::runtime_error("Symbol does not exist in the engine");
+    }
+    if (symbol_to_queue.count(symbol_id) > 0) {
+        throw std::runtime_error("Symbol already exists in the scheduler");
+    }
+    // spread home workers round robin, stealing evens out whatever skew is left
+    uint32_t home_worker = static_cast<uint32_t>(symbol_queues.size() % workers.size());
+    symbol_queues.push_back(std::make_unique<SymbolQueue>(symbol_id, home_worker, symbol_queue_capacity));
+    symbol_to_queue[symbol_id] = symbol_queues.back().get();
+}
+
+uint32_t MatchingScheduler::registerProducer(size_t response_capacity) {
+    if (running.load(std::memory_order_acquire)) {
+        throw std::runtime_error("Producers must be registered before the scheduler starts");
+    }
+    responses.push_back(std::make_unique<MpscQueue<CommandAck>>(response_capacity));
+    return static_cast<uint32_t>(responses.size() - 1);
+}
+
+void MatchingScheduler::start() {
+    if (running.exchange(true)) {
+        throw std::runtime_error("Scheduler is already running");
+    }
+    start_time = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < workers.size(); ++i) {
+        workers[i]->thread = std::thread(&MatchingScheduler::run, this, i);
+    }
+}
+
+void MatchingScheduler::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    for (auto &worker : workers) {
+        worker->thread.join();
+    }
+    run_ns = elapsedNs(start_time);
+    // the workers are gone, the books go back to the engine's stream and the leftovers are applied on this
+    // thread in per symbol order
+    for (auto &queue : symbol_queues) {
+        if (queue->sequencer != nullptr && engine.hasSymbol(queue->symbol_id)) {
+            engine.setSequencer(queue->symbol_id, nullptr);
+        }
+        queue->sequencer = nullptr;
+        Command command;
+        while (queue->commands.tryPop(command)) {
+            apply(command);
+        }
+        queue->scheduled.store(false, std::memory_order_relaxed);
+    }
+    for (auto &worker : workers) {
+        worker->ready.clear();
+        worker->ready_count.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool MatchingScheduler::submit(uint32_t producer_id, Command command) {
+    auto it = symbol_to_queue.find(command.symbol_id);
+    if (it == symbol_to_queue.end()) {
+        throw std::runtime_error("Symbol does not exist in the scheduler");
+    }
+    SymbolQueue &queue = *it->second;
+    command.producer_id = producer_id;
+    if (!queue.commands.tryPush(command)) {
+        return false;
+    }
+    // pairs with the fence in drain() so either we see the queue unscheduled or the worker sees our command
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    schedule(queue, queue.home_worker);
+    return true;
+}
+
+bool MatchingScheduler::pollAck(uint32_t producer_id, CommandAck &ack) {
+    return responses[producer_id]->tryPop(ack);
+}
+
+std::vector<WorkerStats> MatchingScheduler::getWorkerStats() const {
+    uint64_t elapsed = running.load(std::memory_order_acquire) ? elapsedNs(start_time) : run_ns;
+    std::vector<WorkerStats> stats;
+    stats.reserve(workers.size());
+    for (const auto &worker : workers) {
+        WorkerStats worker_stats{};
+        worker_stats.commands = worker->commands.load(std::memory_order_relaxed);
+        worker_stats.batches = worker->batches.load(std::memory_order_relaxed);
+        worker_stats.steals = worker->steals.load(std::memory_order_relaxed);
+        worker_stats.busy_ns = worker->busy_ns.load(std::memory_order_relaxed);
+        worker_stats.elapsed_ns = elapsed;
+        worker_stats.utilization = elapsed == 0 ? 0.0 : static_cast<double>(worker_stats.busy_ns) / elapsed;
+        stats.push_back(worker_stats);
+    }
+    return stats;
+}
+
+uint64_t MatchingScheduler::getLastSequence(uint32_t worker_id) const {
+    if (worker_id >= workers.size()) {
+        throw std::runtime_error("Worker does not exist");
+    }
+    return workers[worker_id]->sequencer.getLast();
+}
+
+void MatchingScheduler::schedule(SymbolQueue &queue, uint32_t worker_id) {
+    if (queue.scheduled.exchange(true, std::memory_order_acq_rel)) {
+        return; // already on a deque or being drained
+    }
+    Worker &worker = *workers[worker_id];
+    std::lock_guard<SpinLock> guard(worker.lock);
+    worker.ready.push_back(&queue);
+    worker.ready_count.fetch_add(1, std::memory_order_release);
+}
+
+MatchingScheduler::SymbolQueue *MatchingScheduler::popLocal(uint32_t worker_id) {
+    Worker &worker = *workers[worker_id];
+    if (worker.ready_count.load(std::memory_order_acquire) == 0) {
+        return nullptr;
+    }
+    std::lock_guard<SpinLock> guard(worker.lock);
+    if (worker.ready.empty()) {
+        return nullptr;
+    }
+    SymbolQueue *queue = worker.ready.front();
+    worker.ready.pop_front();
+    worker.ready_count.fetch_sub(1, std::memory_order_relaxed);
+    return queue;
+}
+
+MatchingScheduler::SymbolQueue *MatchingScheduler::steal(uint32_t worker_id) {
+    for (size_t offset = 1; offset < workers.size(); ++offset) {
+        Worker &victim = *workers[(worker_id + offset) % workers.size()];
+        // don't bother a victim with nothing to give or whose lock is taken
+        if (victim.ready_count.load(std::memory_order_acquire) == 0 || !victim.lock.try_lock()) {
+            continue;
+        }
+        SymbolQueue *queue = nullptr;
+        if (!victim.ready.empty()) {
+            queue = victim.ready.back();
+            victim.ready.pop_back();
+            victim.ready_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+        victim.lock.unlock();
+        if (queue != nullptr) {
+            workers[worker_id]->steals.fetch_add(1, std::memory_order_relaxed);
+            return queue;
+        }
+    }
+    return nullptr;
+}
+
+void MatchingScheduler::run(uint32_t worker_id) {
+    uint32_t idle_spins = 0;
+    while (running.load(std::memory_order_acquire)) {
+        SymbolQueue *queue = popLocal(worker_id);
+        if (queue == nullptr) {
+            queue = steal(worker_id);
+        }
+        if (queue == nullptr) {
+            if (++idle_spins > 1024) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        idle_spins = 0;
+        drain(*queue, worker_id);
+    }
+}
+
+void MatchingScheduler::drain(SymbolQueue &queue, uint32_t worker_id) {
+    Worker &worker = *workers[worker_id];
+    auto start = std::chrono::steady_clock::now();
+    size_t count = 0;
+    Command command;
+    if (queue.sequencer != &worker.sequencer) {
+        // the book was last drained by another worker, its events carry on in this one's stream
+        engine.setSequencer(queue.symbol_id, &worker.sequencer);
+        queue.sequencer = &worker.sequencer;
+    }
+    while (count < batch_size && queue.commands.tryPop(command)) {
+        apply(command);
+        ++count;
+    }
+    worker.busy_ns.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+    worker.commands.fetch_add(count, std::memory_order_relaxed);
+    worker.batches.fetch_add(1, std::memory_order_relaxed);
+
+    queue.scheduled.store(false, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (queue.commands.size() != 0) {
+        // more work arrived or the batch was cut short, keep the symbol on this worker
+        schedule(queue, worker_id);
+    }
+}
+
+void MatchingScheduler::apply(const Command &command) {
+    CommandAck ack{command.request_id, command.order_id, command.type, CommandStatus::ACCEPTED};
+    try {
+        if (!engine.process(command)) {
+            ack.status = CommandStatus::REJECTED;
+        }
+    } catch (const std::exception &) {
+        ack.status = CommandStatus::REJECTED;
+    }
+    responses[command.producer_id]->push(ack);
+}
+}
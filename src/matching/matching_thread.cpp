@@ -0,0 +1,109 @@
+#include <stdexcept>
+#include "matching_thread.h"
+#include "numa.h"
+
+namespace QuantaTrader {
+MatchingThread::MatchingThread(Engine &engine, size_t ingress_capacity, size_t batch_size)
+    : engine(engine),
+    cpu(engine.getCpu()),
+    batch_size(batch_size),
+    batch_clock(nullptr),
+    running(false),
+    processed(0) {
+    // the queue's slots are first written on the matching thread's cpu, so they are placed on its node
+    runOnCpu(cpu, [&] { ingress = std::make_unique<MpscQueue<Command>>(ingress_capacity); });
+}
+
+MatchingThread::~MatchingThread() {
+    stop();
+}
+
+uint32_t MatchingThread::registerProducer(size_t response_capacity, int producer_cpu) {
+    if (thread.joinable()) {
+        throw std::runtime_error("Producers must be registered before the matching thread starts");
+    }
+    std::unique_ptr<SpscQueue<CommandAck>> response;
+    runOnCpu(producer_cpu, [&] { response = std::make_unique<SpscQueue<CommandAck>>(response_capacity); });
+    responses.push_back(std::move(response));
+    return static_cast<uint32_t>(responses.size() - 1);
+}
+
+void MatchingThread::setBatchClock(CoarseClock &clock) {
+    batch_clock = &clock;
+}
+
+void MatchingThread::start() {
+    if (thread.joinable()) {
+        throw std::runtime_error("Matching thread is already running");
+    }
+    running.store(true, std::memory_order_release);
+    thread = std::thread(&MatchingThread::run, this);
+}
+
+void MatchingThread::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    running.store(false, std::memory_order_release);
+    thread.join();
+}
+
+bool MatchingThread::submit(uint32_t producer_id, Command command) {
+    // checked here, the matching thread answers on the producer's ring without looking
+    if (producer_id >= responses.size()) {
+        throw std::runtime_error("Producer does not exist");
+    }
+    command.producer_id = producer_id;
+    return ingress->tryPush(command);
+}
+
+bool MatchingThread::pollAck(uint32_t producer_id, CommandAck &ack) {
+    if (producer_id >= responses.size()) {
+        throw std::runtime_error("Producer does not exist");
+    }
+    return responses[producer_id]->tryPop(ack);
+}
+
+void MatchingThread::run() {
+    pinCurrentThread(cpu);
+    std::vector<Command> batch(batch_size);
+    uint32_t idle_spins = 0;
+    while (running.load(std::memory_order_acquire)) {
+        if (drainBatch(batch) != 0) {
+            idle_spins = 0;
+        } else if (++idle_spins > 1024) {
+            std::this_thread::yield();
+        }
+    }
+    // finish whatever was submitted before stop()
+    while (drainBatch(batch) != 0) {
+    }
+}
+
+size_t MatchingThread::drainBatch(std::vector<Command> &batch) {
+    size_t count = ingress->popBatch(batch.data(), batch.size());
+    if (count == 0) {
+        return 0;
+    }
+    if (batch_clock != nullptr) {
+        batch_clock->refresh();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const Command &command = batch[i];
+        CommandAck ack{command.request_id, command.order_id, command.type, CommandStatus::ACCEPTED};
+        try {
+            if (!engine.process(command)) {
+                ack.status = CommandStatus::REJECTED;
+            }
+        } catch (const std::exception &) {
+            ack.status = CommandStatus::REJECTED;
+        }
+        SpscQueue<CommandAck> &response = *responses[command.producer_id];
+        while (!response.tryPush(ack)) {
+            // the producer is behind on its acks, wait for it to make room
+        }
+    }
+    processed.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+}
@@ -1,82 +1,119 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <ctime>
 #include "order.h"
 
 namespace QuantaTrader {
 
 // Order constructor
 Order::Order(uint64_t id, OrderType type, OrderSide side, OrderTimeInForce time_in_force, uint32_t symbol_id, uint64_t price, uint64_t stop_price, 
-    uint64_t trail_amount, uint64_t quantity, std::chrono::time_point<std::chrono::system_clock> timestamp)
-    : id(id),
-    type(type), 
-    side(side), 
-    time_in_force(time_in_force), 
-    symbol_id(symbol_id), 
-    price(price), 
-    stop_price(stop_price), 
-    trail_amount(trail_amount), 
-    quantity(quantity), 
-    timestamp(timestamp) {
-        last_executed_price = 0;
-        executed_quantity = 0;
-        open_quantity = quantity;
-        last_executed_price = 0;
-        last_executed_quantity = 0;
-    }
+    uint64_t trail_amount, uint64_t quantity, Timestamp timestamp)
+    : hot{id, price, quantity, quantity, symbol_id, 0, 0, type, side, time_in_force, SelfTradePrevention::NONE},
+    cold{quantity, 0, stop_price, trail_amount, quantity, 0, 0, 0, timestamp, 0, 0} {}
 
 // Market Orders
-Order Order::marketSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::MARKET, OrderSide::SELL, time_in_force, symbol_id, 0, 0, 0, quantity, std::chrono::system_clock::now());
+Order Order::marketSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::MARKET, OrderSide::SELL, time_in_force, symbol_id, 0, 0, 0, quantity, clock.now());
 }
 
-Order Order::marketBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::MARKET, OrderSide::BUY, time_in_force, symbol_id, 0, 0, 0, quantity, std::chrono::system_clock::now());
+Order Order::marketBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::MARKET, OrderSide::BUY, time_in_force, symbol_id, 0, 0, 0, quantity, clock.now());
 }
 
 // Limit Orders
-Order Order::limitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::LIMIT, OrderSide::SELL, time_in_force, symbol_id, price, 0, 0, quantity, std::chrono::system_clock::now());
+Order Order::limitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::LIMIT, OrderSide::SELL, time_in_force, symbol_id, price, 0, 0, quantity, clock.now());
+}
+
+Order Order::limitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::LIMIT, OrderSide::BUY, time_in_force, symbol_id, price, 0, 0, quantity, clock.now());
+}
+
+// Iceberg Orders
+Order Order::icebergSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t peak_quantity, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    Order order(order_id, OrderType::ICEBERG, OrderSide::SELL, time_in_force, symbol_id, price, 0, 0, quantity, clock.now());
+    order.cold.peak_quantity = std::max<uint64_t>(1, std::min(peak_quantity, quantity));
+    return order;
+}
+
+Order Order::icebergBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t peak_quantity, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    Order order(order_id, OrderType::ICEBERG, OrderSide::BUY, time_in_force, symbol_id, price, 0, 0, quantity, clock.now());
+    order.cold.peak_quantity = std::max<uint64_t>(1, std::min(peak_quantity, quantity));
+    return order;
+}
+
+// Pegged Orders
+Order Order::primaryPegSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    Order order(order_id, OrderType::PEG_PRIMARY, OrderSide::SELL, time_in_force, symbol_id, 0, 0, 0, quantity, clock.now());
+    order.cold.peg_offset = offset;
+    return order;
+}
+
+Order Order::primaryPegBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    Order order(order_id, OrderType::PEG_PRIMARY, OrderSide::BUY, time_in_force, symbol_id, 0, 0, 0, quantity, clock.now());
+    order.cold.peg_offset = offset;
+    return order;
+}
+
+Order Order::midpointPegSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    Order order(order_id, OrderType::PEG_MIDPOINT, OrderSide::SELL, time_in_force, symbol_id, 0, 0, 0, quantity, clock.now());
+    order.cold.peg_offset = offset;
+    return order;
+}
+
+Order Order::midpointPegBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    Order order(order_id, OrderType::PEG_MIDPOINT, OrderSide::BUY, time_in_force, symbol_id, 0, 0, 0, quantity, clock.now());
+    order.cold.peg_offset = offset;
+    return order;
+}
+
+Order Order::marketPegSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    Order order(order_id, OrderType::PEG_MARKET, OrderSide::SELL, time_in_force, symbol_id, 0, 0, 0, quantity, clock.now());
+    order.cold.peg_offset = offset;
+    return order;
 }
 
-Order Order::limitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::LIMIT, OrderSide::BUY, time_in_force, symbol_id, price, 0, 0, quantity, std::chrono::system_clock::now());
+Order Order::marketPegBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t offset, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    Order order(order_id, OrderType::PEG_MARKET, OrderSide::BUY, time_in_force, symbol_id, 0, 0, 0, quantity, clock.now());
+    order.cold.peg_offset = offset;
+    return order;
 }
 
 // Stop Orders
-Order Order::stopSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::STOP, OrderSide::SELL, time_in_force, symbol_id, 0, stop_price, 0, quantity, std::chrono::system_clock::now());
+Order Order::stopSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::STOP, OrderSide::SELL, time_in_force, symbol_id, 0, stop_price, 0, quantity, clock.now());
 }
 
-Order Order::stopBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::STOP, OrderSide::BUY, time_in_force, symbol_id, 0, stop_price, 0, quantity, std::chrono::system_clock::now());
+Order Order::stopBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::STOP, OrderSide::BUY, time_in_force, symbol_id, 0, stop_price, 0, quantity, clock.now());
 }
 
 // Stop Limit Orders
-Order Order::stopLimitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::STOP_LIMIT, OrderSide::SELL, time_in_force, symbol_id, price, stop_price, 0, quantity, std::chrono::system_clock::now());
+Order Order::stopLimitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::STOP_LIMIT, OrderSide::SELL, time_in_force, symbol_id, price, stop_price, 0, quantity, clock.now());
 }
 
-Order Order::stopLimitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::STOP_LIMIT, OrderSide::BUY, time_in_force, symbol_id, price, stop_price, 0, quantity, std::chrono::system_clock::now());
+Order Order::stopLimitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t stop_price, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::STOP_LIMIT, OrderSide::BUY, time_in_force, symbol_id, price, stop_price, 0, quantity, clock.now());
 }
 
 // Trailing Stop Orders
-Order Order::trailingStopSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::TRAILING_STOP, OrderSide::SELL, time_in_force, symbol_id, 0, 0, trail_amount, quantity, std::chrono::system_clock::now());
+Order Order::trailingStopSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::TRAILING_STOP, OrderSide::SELL, time_in_force, symbol_id, 0, 0, trail_amount, quantity, clock.now());
 }
 
-Order Order::trailingStopBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::TRAILING_STOP, OrderSide::BUY, time_in_force, symbol_id, 0, 0, trail_amount, quantity, std::chrono::system_clock::now());
+Order Order::trailingStopBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::TRAILING_STOP, OrderSide::BUY, time_in_force, symbol_id, 0, 0, trail_amount, quantity, clock.now());
 }
 
 // Trailing Stop Limit Orders
-Order Order::trailingStopLimitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::TRAILING_STOP_LIMIT, OrderSide::SELL, time_in_force, symbol_id, price, 0, trail_amount, quantity, std::chrono::system_clock::now());
+Order Order::trailingStopLimitSellOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::TRAILING_STOP_LIMIT, OrderSide::SELL, time_in_force, symbol_id, price, 0, trail_amount, quantity, clock.now());
 }
 
-Order Order::trailingStopLimitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force) {
-    return Order(order_id, OrderType::TRAILING_STOP_LIMIT, OrderSide::BUY, time_in_force, symbol_id, price, 0, trail_amount, quantity, std::chrono::system_clock::now());
+Order Order::trailingStopLimitBuyOrder(uint64_t order_id, uint32_t symbol_id, uint64_t price, uint64_t trail_amount, uint64_t quantity, OrderTimeInForce time_in_force, Clock &clock) {
+    return Order(order_id, OrderType::TRAILING_STOP_LIMIT, OrderSide::BUY, time_in_force, symbol_id, price, 0, trail_amount, quantity, clock.now());
 }
 
 std::string typeToString(OrderType type) {
@@ -93,6 +130,14 @@ std::string typeToString(OrderType type) {
             return "TRAILING_STOP";
         case OrderType::TRAILING_STOP_LIMIT:
             return "TRAILING_STOP_LIMIT";
+        case OrderType::ICEBERG:
+            return "ICEBERG";
+        case OrderType::PEG_PRIMARY:
+            return "PEG_PRIMARY";
+        case OrderType::PEG_MIDPOINT:
+            return "PEG_MIDPOINT";
+        case OrderType::PEG_MARKET:
+            return "PEG_MARKET";
         default:
             return "UNKNOWN";
     }
@@ -128,17 +173,19 @@ std::string Order::toString() const {
     std::ostringstream oss;
 
     // Convert timestamp to a time format string
-    auto time_t = std::chrono::system_clock::to_time_t(timestamp);
+    auto time_t = static_cast<std::time_t>(cold.timestamp / 1000000000);
     oss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
 
-    oss << "Order [ID: " << id 
-        << ", Type: " << typeToString(type) 
-        << ", Side: " << sideToString(side) 
-        << ", TIF: " << timeInForceToString(time_in_force)
-        << ", Symbol ID: " << symbol_id 
-        << ", Price: " << price 
-        << ", Quantity: " << quantity 
-        << ", Open Quantity: " << open_quantity
+    oss << "Order [ID: " << hot.id 
+        << ", Type: " << typeToString(hot.type) 
+        << ", Side: " << sideToString(hot.side) 
+        << ", TIF: " << timeInForceToString(hot.time_in_force)
+        << ", Symbol ID: " << hot.symbol_id 
+        << ", Owner ID: " << hot.owner_id
+        << ", Price: " << hot.price 
+        << ", Quantity: " << cold.quantity 
+        << ", Open Quantity: " << hot.open_quantity
+        << ", Visible Quantity: " << hot.visible_quantity
         << ", Timestamp: " << oss.str() << "]";
 
     return oss.str();
@@ -0,0 +1,52 @@
+#include <mutex>
+#include "order_router.h"
+
+namespace QuantaTrader {
+
+OrderRouter::OrderRouter(size_t capacity) : overflowed(0) {
+    size_t rounded = 2;
+    shift = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+        ++shift;
+    }
+    mask = rounded - 1;
+    words = std::unique_ptr<std::atomic<uint64_t>[]>(new std::atomic<uint64_t>[rounded]);
+    for (size_t i = 0; i < rounded; ++i) {
+        words[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void OrderRouter::add(uint64_t order_id, uint32_t symbol_id) {
+    uint64_t empty = 0;
+    if (words[order_id & mask].compare_exchange_strong(empty, pack(order_id, symbol_id), std::memory_order_release,
+            std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<SpinLock> guard(overflow_lock);
+    if (overflow.emplace(order_id, symbol_id).second) {
+        overflowed.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void OrderRouter::remove(uint64_t order_id, uint32_t symbol_id) {
+    uint64_t routed = pack(order_id, symbol_id);
+    if (words[order_id & mask].compare_exchange_strong(routed, 0, std::memory_order_release, std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<SpinLock> guard(overflow_lock);
+    if (overflow.erase(order_id) != 0) {
+        overflowed.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+bool OrderRouter::findOverflow(uint64_t order_id, uint32_t &symbol_id) const {
+    std::lock_guard<SpinLock> guard(overflow_lock);
+    auto it = overflow.find(order_id);
+    if (it == overflow.end()) {
+        return false;
+    }
+    symbol_id = it->second;
+    return true;
+}
+}
@@ -2,27 +2,93 @@
 #include <fstream>
 #include <sstream>
 #include <limits.h>
+#include <algorithm>
+#include <vector>
 #include "price_level_order_book.h"
 #include "event.h"
 
 namespace QuantaTrader {
-PriceLevelOrderBook::PriceLevelOrderBook(uint32_t symbol_id, EventHandler &event_handler) 
+
+namespace {
+// all or none limit orders rest in the book's all or none levels rather than the regular ones
+template <typename Parts>
+bool isRestingAon(const OrderFields<Parts> &order) {
+    return (order.getType() == OrderType::LIMIT || order.getType() == OrderType::ICEBERG) && order.getTimeInForce() == OrderTimeInForce::AON;
+}
+
+size_t pegIndex(OrderType type) {
+    return static_cast<size_t>(type) - static_cast<size_t>(OrderType::PEG_PRIMARY);
+}
+
+OrderType pegType(size_t index) {
+    return static_cast<OrderType>(static_cast<size_t>(OrderType::PEG_PRIMARY) + index);
+}
+
+const char *PEG_NAMES[] = {"PRIMARY", "MIDPOINT", "MARKET"};
+}
+
+PriceLevelOrderBook::PriceLevelOrderBook(uint32_t symbol_id, EventHandler &event_handler, Clock &clock, EventSequencer *sequencer,
+    HugePageArena *arena)
     : symbol_id(symbol_id),
-    event_handler(event_handler) {
+    event_handler(event_handler),
+    clock(clock),
+    command_time(0),
+    command_depth(0),
+    sequencer(sequencer),
+    symbol_sequence(0),
+    arena(arena),
+    orders(arena),
+    router(nullptr) {
+        LevelMap::allocator_type allocator(arena);
+        for (LevelMap *levels : {&sell_levels, &buy_levels, &aon_sell_levels, &aon_buy_levels, &stop_sell_levels,
+                &stop_buy_levels, &trailing_stop_sell_levels, &trailing_stop_buy_levels}) {
+            *levels = LevelMap(allocator);
+        }
+        for (size_t i = 0; i < PEG_TYPES; ++i) {
+            pegged_sell_levels[i] = LevelMap(allocator);
+            pegged_buy_levels[i] = LevelMap(allocator);
+            pegged_sell_ladders[i] = VolumeLadder(VolumeLadder::DEFAULT_MAX_SPAN, arena);
+            pegged_buy_ladders[i] = VolumeLadder(VolumeLadder::DEFAULT_MAX_SPAN, arena);
+        }
+        sell_ladder = VolumeLadder(VolumeLadder::DEFAULT_MAX_SPAN, arena);
+        buy_ladder = VolumeLadder(VolumeLadder::DEFAULT_MAX_SPAN, arena);
+        aon_sell_sizes = AonSizeMap(allocator);
+        aon_buy_sizes = AonSizeMap(allocator);
         last_traded_price = 0;
         trailing_buy_price = 0;
         trailing_sell_price = std::numeric_limits<uint64_t>::max();
+        sell_replenished = false;
+        buy_replenished = false;
+        in_auction = false;
+        next_trade_id = 1;
+        match_depth = 0;
     }
 
-void PriceLevelOrderBook::addOrder(Order order) {
-    event_handler.handleOrderAdded(OrderAdded{order});
+PriceLevelOrderBook::~PriceLevelOrderBook() {
+    setRouter(nullptr);
+}
+
+bool PriceLevelOrderBook::addOrder(Order order) {
+    CommandTime command(*this);
+    // a market order has no price to rest at for the uncross
+    if (in_auction && order.getType() == OrderType::MARKET) {
+        rejectOrder(order, RejectReason::AUCTION);
+        return false;
+    }
+    event_handler.handleOrderAdded(OrderAdded{order, stamp()});
     switch (order.getType()) {
         case OrderType::MARKET:
             addMarketOrder(order);
             break;
         case OrderType::LIMIT:
+        case OrderType::ICEBERG:
             addLimitOrder(order);
             break;
+        case OrderType::PEG_PRIMARY:
+        case OrderType::PEG_MIDPOINT:
+        case OrderType::PEG_MARKET:
+            addPeggedOrder(order);
+            break;
         case OrderType::STOP:
         case OrderType::STOP_LIMIT:
         case OrderType::TRAILING_STOP:
@@ -31,13 +97,28 @@ void PriceLevelOrderBook::addOrder(Order order) {
             break;
     }
     activateStopOrders();
+    return true;
+}
+
+void PriceLevelOrderBook::rejectOrder(const Order &order, RejectReason reason) {
+    event_handler.handleOrderRejected(OrderRejected{order, reason, stamp()});
 }
 
 void PriceLevelOrderBook::deleteOrder(uint64_t order_id) {
-    auto orders_it = orders.find(order_id);
-    auto &levels_it = orders_it->second.level_it;
-    Order &order_to_delete = orders_it->second.order;
-    event_handler.handleOrderDeleted(OrderDeleted{orders_it->second.order});
+    CommandTime command(*this);
+    auto orders_it = findOrder(order_id);
+    event_handler.handleOrderDeleted(OrderDeleted{toOrder(*orders_it), stamp()});
+    removeOrder(orders_it);
+    activateStopOrders();
+}
+
+void PriceLevelOrderBook::removeOrder(RestingOrderTable::iterator orders_it) {
+    auto levels_it = orders.cold(*orders_it).level_it;
+    RestingOrder &order_to_delete = *orders_it;
+    if (isRestingAon(order_to_delete)) {
+        unindexAonOrder(order_to_delete);
+    }
+    unindexOrder(order_to_delete);
     levels_it->second.deleteOrder(order_to_delete);
     if (levels_it->second.empty()) {
         // delete from appropriate order side the relevant order type
@@ -45,7 +126,10 @@ void PriceLevelOrderBook::deleteOrder(uint64_t order_id) {
         switch (order_to_delete.getType()) {
             case OrderType::MARKET:
             case OrderType::LIMIT:
-                if (isSell) {
+            case OrderType::ICEBERG:
+                if (order_to_delete.getTimeInForce() == OrderTimeInForce::AON) {
+                    (isSell ? aon_sell_levels : aon_buy_levels).erase(levels_it);
+                } else if (isSell) {
                     sell_levels.erase(levels_it);
                 } else {
                     buy_levels.erase(levels_it);
@@ -67,15 +151,192 @@ void PriceLevelOrderBook::deleteOrder(uint64_t order_id) {
                     trailing_stop_buy_levels.erase(levels_it);
                 }
                 break;
+            case OrderType::PEG_PRIMARY:
+            case OrderType::PEG_MIDPOINT:
+            case OrderType::PEG_MARKET:
+                (isSell ? pegged_sell_levels : pegged_buy_levels)[pegIndex(order_to_delete.getType())].erase(levels_it);
+                break;
         }
     }
     orders.erase(orders_it);
+}
+
+RestingOrder &PriceLevelOrderBook::restOrder(const Order &order, LevelMap::iterator level_it) {
+    RestingOrder &resting = *orders.emplace(order.getId(), RestingOrder(order.hot), RestingOrderCold{order.cold, nullptr, level_it}).first;
+    orders.cold(resting).order = &resting;
+    level_it->second.addOrder(resting);
+    indexOrder(resting);
+    return resting;
+}
+
+void PriceLevelOrderBook::indexOrder(RestingOrder &order) {
+    if (order.getOwnerId() != 0) {
+        owner_orders[order.getOwnerId()].push_back(orders.cold(order));
+    }
+    if (router != nullptr) {
+        router->add(order.getId(), symbol_id);
+    }
+}
+
+void PriceLevelOrderBook::unindexOrder(RestingOrder &order) {
+    // the hook unlinks without the owner's list, an owner with no orders keeps its empty list
+    // until a mass cancel by owner drops it
+    RestingOrderCold &order_cold = orders.cold(order);
+    if (order_cold.owner_hook.is_linked()) {
+        order_cold.owner_hook.unlink();
+    }
+    if (router != nullptr) {
+        router->remove(order.getId(), symbol_id);
+    }
+}
+
+void PriceLevelOrderBook::setRouter(OrderRouter *router) {
+    if (this->router != nullptr) {
+        orders.forEach([&](const auto &entry) { this->router->remove(entry.getId(), symbol_id); });
+    }
+    this->router = router;
+    if (router != nullptr) {
+        orders.forEach([&](const auto &entry) { router->add(entry.getId(), symbol_id); });
+    }
+}
+
+size_t PriceLevelOrderBook::cancelAllOrders() {
+    CommandTime command(*this);
+    mass_cancelled.clear();
+    cancelSide(OrderSide::SELL);
+    cancelSide(OrderSide::BUY);
+    return finishMassCancel();
+}
+
+size_t PriceLevelOrderBook::cancelSideOrders(OrderSide side) {
+    CommandTime command(*this);
+    mass_cancelled.clear();
+    cancelSide(side);
+    return finishMassCancel();
+}
+
+size_t PriceLevelOrderBook::cancelPriceRange(OrderSide side, uint64_t low, uint64_t high) {
+    CommandTime command(*this);
+    mass_cancelled.clear();
+    if (low <= high) {
+        bool is_sell = side == OrderSide::SELL;
+        LevelMap &levels = is_sell ? sell_levels : buy_levels;
+        LevelMap &aon_levels = is_sell ? aon_sell_levels : aon_buy_levels;
+        cancelLevels(levels, levels.lower_bound(low), levels.upper_bound(high));
+        cancelLevels(aon_levels, aon_levels.lower_bound(low), aon_levels.upper_bound(high));
+    }
+    return finishMassCancel();
+}
+
+size_t PriceLevelOrderBook::cancelOwnerOrders(uint32_t owner_id) {
+    CommandTime command(*this);
+    mass_cancelled.clear();
+    auto owner_it = owner_orders.find(owner_id);
+    if (owner_it != owner_orders.end()) {
+        RestingOrderCold::OwnerList &owned = owner_it->second;
+        Timestamp now = eventTime();
+        while (!owned.empty()) {
+            RestingOrder *order = owned.front().order;
+            mass_cancelled.emplace_back(toOrder(*order), now);
+            removeOrder(order);
+        }
+        owner_orders.erase(owner_it);
+    }
+    return finishMassCancel();
+}
+
+std::vector<uint64_t> PriceLevelOrderBook::getOwnerOrderIds(uint32_t owner_id) const {
+    std::vector<uint64_t> order_ids;
+    auto owner_it = owner_orders.find(owner_id);
+    if (owner_it != owner_orders.end()) {
+        for (const RestingOrderCold &order_cold : owner_it->second) {
+            order_ids.push_back(order_cold.order->getId());
+        }
+    }
+    return order_ids;
+}
+
+OwnerExposure PriceLevelOrderBook::getOwnerExposure(uint32_t owner_id) const {
+    OwnerExposure exposure{};
+    auto owner_it = owner_orders.find(owner_id);
+    if (owner_it == owner_orders.end()) {
+        return exposure;
+    }
+    for (const RestingOrderCold &order_cold : owner_it->second) {
+        const RestingOrder &order = *order_cold.order;
+        bool is_sell = order.getSide() == OrderSide::SELL;
+        ++exposure.order_count;
+        (is_sell ? exposure.sell_quantity : exposure.buy_quantity) += order.getOpenQuantity();
+        // market stops and pegged orders have no price of their own to value them at
+        switch (order.getType()) {
+            case OrderType::LIMIT:
+            case OrderType::ICEBERG:
+            case OrderType::STOP_LIMIT:
+            case OrderType::TRAILING_STOP_LIMIT:
+                (is_sell ? exposure.sell_notional : exposure.buy_notional) += order.getOpenQuantity() * order.getPrice();
+                break;
+            default:
+                break;
+        }
+    }
+    return exposure;
+}
+
+void PriceLevelOrderBook::cancelSide(OrderSide side) {
+    bool is_sell = side == OrderSide::SELL;
+    LevelMap &levels = is_sell ? sell_levels : buy_levels;
+    LevelMap &aon_levels = is_sell ? aon_sell_levels : aon_buy_levels;
+    LevelMap &stop_levels = is_sell ? stop_sell_levels : stop_buy_levels;
+    LevelMap &trailing_stop_levels = is_sell ? trailing_stop_sell_levels : trailing_stop_buy_levels;
+    cancelLevels(levels, levels.begin(), levels.end());
+    cancelLevels(aon_levels, aon_levels.begin(), aon_levels.end());
+    for (size_t index = 0; index < PEG_TYPES; ++index) {
+        LevelMap &pegged_levels = is_sell ? pegged_sell_levels[index] : pegged_buy_levels[index];
+        cancelLevels(pegged_levels, pegged_levels.begin(), pegged_levels.end());
+    }
+    cancelLevels(stop_levels, stop_levels.begin(), stop_levels.end());
+    cancelLevels(trailing_stop_levels, trailing_stop_levels.begin(), trailing_stop_levels.end());
+}
+
+void PriceLevelOrderBook::cancelLevels(LevelMap &levels, LevelMap::iterator first,
+    LevelMap::iterator last) {
+    if (first == last) {
+        return;
+    }
+    Timestamp now = eventTime();
+    for (auto level_it = first; level_it != last; ++level_it) {
+        Level &level = level_it->second;
+        size_t level_start = mass_cancelled.size();
+        for (RestingOrder &order : level.getOrders()) {
+            if (isRestingAon(order)) {
+                unindexAonOrder(order);
+            }
+            unindexOrder(order);
+            mass_cancelled.emplace_back(toOrder(order), now);
+        }
+        // unlink the level in one go, the orders can only leave the book once they are off its list
+        level.clear();
+        for (size_t i = level_start; i < mass_cancelled.size(); ++i) {
+            orders.erase(mass_cancelled[i].order.getId());
+        }
+    }
+    levels.erase(first, last);
+}
+
+size_t PriceLevelOrderBook::finishMassCancel() {
+    if (mass_cancelled.empty()) {
+        return 0;
+    }
+    sequenceBatch(mass_cancelled);
+    event_handler.handleOrderDeletedBatch(mass_cancelled);
     activateStopOrders();
+    return mass_cancelled.size();
 }
 
 void PriceLevelOrderBook::modifyOrder(uint64_t order_id, uint64_t new_order_id, uint64_t new_price) {
-    auto orders_it = orders.find(order_id);
-    Order new_order = orders_it->second.order;
+    CommandTime command(*this);
+    auto orders_it = findOrder(order_id);
+    Order new_order = toOrder(*orders_it);
     new_order.setId(new_order_id);
     new_order.setPrice(new_price);
     deleteOrder(order_id);
@@ -84,48 +345,76 @@ void PriceLevelOrderBook::modifyOrder(uint64_t order_id, uint64_t new_order_id,
 }
 
 void PriceLevelOrderBook::cancelOrder(uint64_t order_id, uint64_t quantity) {
-    auto orders_it = orders.find(order_id);
-    auto &level_it = orders_it->second.level_it;
-    Level &level_to_cancel = level_it->second;
-    Order &order_to_cancel = orders_it->second.order;
-    uint64_t quantity_before_cancel = order_to_cancel.getOpenQuantity();
-    order_to_cancel.setQuantity(quantity);
-    event_handler.handleOrderUpdated(OrderUpdated{order_to_cancel});
-    level_to_cancel.reduceVolume(quantity_before_cancel - order_to_cancel.getOpenQuantity());
+    CommandTime command(*this);
+    auto orders_it = findOrder(order_id);
+    RestingOrder &order_to_cancel = *orders_it;
+    Level &level_to_cancel = orders.cold(order_to_cancel).level_it->second;
+    uint64_t visible_before_cancel = order_to_cancel.getVisibleQuantity();
+    bool resting_aon = isRestingAon(order_to_cancel);
+    if (resting_aon) {
+        unindexAonOrder(order_to_cancel);
+    }
+    resting(order_to_cancel).setQuantity(quantity);
+    event_handler.handleOrderUpdated(OrderUpdated{toOrder(order_to_cancel), stamp()});
+    level_to_cancel.reduceVolume(order_to_cancel, visible_before_cancel - order_to_cancel.getVisibleQuantity());
+    OrderSide side = order_to_cancel.getSide();
     if (order_to_cancel.getOpenQuantity() == 0) {
         deleteOrder(order_id);
+    } else if (resting_aon) {
+        // a smaller all or none order may fit the liquidity that is already resting
+        auto &aon_sizes = side == OrderSide::SELL ? aon_sell_sizes : aon_buy_sizes;
+        aon_sizes.emplace(std::make_pair(order_to_cancel.getOpenQuantity(), order_id), &order_to_cancel);
+        activateAonOrders(side == OrderSide::SELL ? OrderSide::BUY : OrderSide::SELL);
     }
     activateStopOrders();
 }
 
 void PriceLevelOrderBook::executeOrder(uint64_t order_id, uint64_t quantity, uint64_t price) {
-    auto orders_it = orders.find(order_id);
-    Order &order_to_execute = orders_it->second.order;
+    CommandTime command(*this);
+    auto orders_it = findOrder(order_id);
+    RestingOrder &order_to_execute = *orders_it;
     uint64_t executing_quantity = std::min(quantity, order_to_execute.getOpenQuantity());
-    order_to_execute.execute(price, executing_quantity);
+    if (isRestingAon(order_to_execute)) {
+        unindexAonOrder(order_to_execute);
+    }
+    uint64_t visible_before_execute = order_to_execute.getVisibleQuantity();
+    resting(order_to_execute).execute(price, executing_quantity);
     last_traded_price = price;
-    event_handler.handleOrderExecuted(OrderExecuted{order_to_execute});
-    Level &level_to_execute = orders_it->second.level_it->second;
-    level_to_execute.reduceVolume(order_to_execute.getLastExecutedQuantity());
+    event_handler.handleOrderExecuted(OrderExecuted{toOrder(order_to_execute), stamp()});
+    Level &level_to_execute = orders.cold(order_to_execute).level_it->second;
+    reduceRestingOrder(level_to_execute, order_to_execute, visible_before_execute);
     if (order_to_execute.getOpenQuantity() == 0) {
         deleteOrder(order_id);
+    } else if (isRestingAon(order_to_execute)) {
+        auto &aon_sizes = order_to_execute.getSide() == OrderSide::SELL ? aon_sell_sizes : aon_buy_sizes;
+        aon_sizes.emplace(std::make_pair(order_to_execute.getOpenQuantity(), order_id), &order_to_execute);
     }
+    activateReplenishedAonOrders();
     activateStopOrders();
 }
 
 void PriceLevelOrderBook::executeOrder(uint64_t order_id, uint64_t quantity) {
-    auto orders_it = orders.find(order_id);
-    Order &order_to_execute = orders_it->second.order;
+    CommandTime command(*this);
+    auto orders_it = findOrder(order_id);
+    RestingOrder &order_to_execute = *orders_it;
     uint64_t executing_quantity = std::min(quantity, order_to_execute.getOpenQuantity());
     uint64_t executing_price = order_to_execute.getPrice();
-    order_to_execute.execute(executing_price, executing_quantity);
+    if (isRestingAon(order_to_execute)) {
+        unindexAonOrder(order_to_execute);
+    }
+    uint64_t visible_before_execute = order_to_execute.getVisibleQuantity();
+    resting(order_to_execute).execute(executing_price, executing_quantity);
     last_traded_price = executing_price;
-    event_handler.handleOrderExecuted(OrderExecuted{order_to_execute});
-    Level &level_to_execute = orders_it->second.level_it->second;
-    level_to_execute.reduceVolume(order_to_execute.getLastExecutedQuantity());
+    event_handler.handleOrderExecuted(OrderExecuted{toOrder(order_to_execute), stamp()});
+    Level &level_to_execute = orders.cold(order_to_execute).level_it->second;
+    reduceRestingOrder(level_to_execute, order_to_execute, visible_before_execute);
     if (order_to_execute.getOpenQuantity() == 0) {
         deleteOrder(order_id);
+    } else if (isRestingAon(order_to_execute)) {
+        auto &aon_sizes = order_to_execute.getSide() == OrderSide::SELL ? aon_sell_sizes : aon_buy_sizes;
+        aon_sizes.emplace(std::make_pair(order_to_execute.getOpenQuantity(), order_id), &order_to_execute);
     }
+    activateReplenishedAonOrders();
     activateStopOrders();
 }
 
@@ -137,31 +426,285 @@ void PriceLevelOrderBook::addMarketOrder(Order &order) {
         order.setPrice(std::numeric_limits<uint64_t>::max());
     }
     match(order); // matching takes care of deleting the order as well
-    event_handler.handleOrderDeleted(OrderDeleted{order});
+    event_handler.handleOrderDeleted(OrderDeleted{order, stamp()});
 }
 
 void PriceLevelOrderBook::addLimitOrder(Order &order) {
     match(order);
     // IOC and FOK orders need to be executed immediately
     if (order.getOpenQuantity() != 0 && order.getTimeInForce() != OrderTimeInForce::IOC && order.getTimeInForce() != OrderTimeInForce::FOK) {
+        // an iceberg traded its whole quantity on the way in, only a peak of the rest is displayed
+        order.replenish();
         insertLimitOrder(order);
+        if (order.getTimeInForce() != OrderTimeInForce::AON) {
+            activateAonOrders(order.getSide());
+        }
     } else {
-        event_handler.handleOrderDeleted(OrderDeleted{order});
+        event_handler.handleOrderDeleted(OrderDeleted{order, stamp()});
     }
 }
 
 void PriceLevelOrderBook::insertLimitOrder(const Order &order) {
-    if (order.getSide() == OrderSide::SELL) {
+    if (order.getTimeInForce() == OrderTimeInForce::AON) {
+        insertAonOrder(order);
+    } else if (order.getSide() == OrderSide::SELL) {
         // using C++17 structured binding to hold the return value from emplace() 
         // first value is an iterator, second value is a boolean indicating whether emplace was successful
-        auto [level_it, inserted] = sell_levels.emplace(order.getPrice(), Level(order.getPrice(), LevelSide::SELL, symbol_id));
-        auto [orders_it, success] = orders.emplace(order.getId(), OrderWithLevelIterator{order, level_it});
-        level_it->second.addOrder(orders_it->second.order);
+        auto [level_it, inserted] = sell_levels.emplace(order.getPrice(), Level(order.getPrice(), LevelSide::SELL, symbol_id, &orders, &sell_ladder, arena));
+        restOrder(order, level_it);
     }
     else {
-        auto [level_it, inserted] = buy_levels.emplace(order.getPrice(), Level(order.getPrice(), LevelSide::BUY, symbol_id));
-        auto [orders_it, success] = orders.emplace(order.getId(), OrderWithLevelIterator{order, level_it});
-        level_it->second.addOrder(orders_it->second.order);
+        auto [level_it, inserted] = buy_levels.emplace(order.getPrice(), Level(order.getPrice(), LevelSide::BUY, symbol_id, &orders, &buy_ladder, arena));
+        restOrder(order, level_it);
+    }
+}
+
+void PriceLevelOrderBook::insertAonOrder(const Order &order) {
+    bool is_sell = order.getSide() == OrderSide::SELL;
+    LevelMap &aon_levels = is_sell ? aon_sell_levels : aon_buy_levels;
+    auto [level_it, inserted] = aon_levels.emplace(order.getPrice(), Level(order.getPrice(), is_sell ? LevelSide::SELL : LevelSide::BUY, symbol_id, &orders, nullptr, arena));
+    RestingOrder &resting = restOrder(order, level_it);
+    (is_sell ? aon_sell_sizes : aon_buy_sizes).emplace(std::make_pair(resting.getOpenQuantity(), resting.getId()), &resting);
+}
+
+void PriceLevelOrderBook::unindexAonOrder(const RestingOrder &order) {
+    auto &aon_sizes = order.getSide() == OrderSide::SELL ? aon_sell_sizes : aon_buy_sizes;
+    aon_sizes.erase(std::make_pair(order.getOpenQuantity(), order.getId()));
+}
+
+void PriceLevelOrderBook::matchAonOrders(Order &order, uint64_t through, bool inclusive) {
+    bool is_sell = order.getSide() == OrderSide::SELL;
+    auto &aon_sizes = is_sell ? aon_buy_sizes : aon_sell_sizes;
+    LevelMap &aon_levels = is_sell ? aon_buy_levels : aon_sell_levels;
+    uint32_t stp_owner = order.getSelfTradePrevention() == SelfTradePrevention::NONE ? 0 : order.getOwnerId();
+    // buys are walked from the highest price down, sells from the lowest up
+    auto level_it = is_sell ? (aon_levels.empty() ? aon_levels.end() : std::prev(aon_levels.end())) : aon_levels.begin();
+    while (level_it != aon_levels.end()) {
+        // nothing resting is small enough to be filled whole
+        if (aon_sizes.empty() || aon_sizes.begin()->first.first > order.getOpenQuantity()) {
+            return;
+        }
+        uint64_t price = level_it->first;
+        if (is_sell ? (price < through || (price == through && !inclusive)) : (price > through || (price == through && !inclusive))) {
+            return;
+        }
+        // the level's orders are picked in time order before any of them trade
+        size_t first = aon_candidates.size();
+        for (const RestingOrder &resting : level_it->second.getOrders()) {
+            if (resting.getOpenQuantity() <= order.getOpenQuantity() && (resting.getOwnerId() != stp_owner || stp_owner == 0)) {
+                aon_candidates.push_back(resting.getId());
+            }
+        }
+        for (size_t i = first; i < aon_candidates.size() && order.getOpenQuantity() != 0; ++i) {
+            // earlier fills may have activated stop orders that touched the candidates
+            uint64_t candidate_id = aon_candidates[i];
+            auto orders_it = orders.find(candidate_id);
+            if (orders_it == orders.end() || orders_it->getOpenQuantity() > order.getOpenQuantity()) {
+                continue;
+            }
+            RestingOrder &resting = *orders_it;
+            unindexAonOrder(resting);
+            uint64_t visible_before_execute = resting.getVisibleQuantity();
+            uint64_t executed = is_sell ? executeOrders(order, this->resting(resting), resting.getPrice())
+                : executeOrders(this->resting(resting), order, resting.getPrice());
+            recordTrade(order.getId(), order.getSide(), resting.getId(), resting.getPrice(), executed);
+            reduceRestingOrder(orders.cold(resting).level_it->second, resting, visible_before_execute);
+            deleteOrder(candidate_id);
+        }
+        aon_candidates.resize(first);
+        // the level may be gone, the next one is found by price
+        if (is_sell) {
+            level_it = aon_levels.lower_bound(price);
+            level_it = level_it == aon_levels.begin() ? aon_levels.end() : std::prev(level_it);
+        } else {
+            level_it = aon_levels.upper_bound(price);
+        }
+    }
+}
+
+void PriceLevelOrderBook::activateAonOrders(OrderSide side) {
+    if (in_auction) {
+        return;
+    }
+    auto &aon_sizes = side == OrderSide::SELL ? aon_buy_sizes : aon_sell_sizes;
+    LevelMap &aon_levels = side == OrderSide::SELL ? aon_buy_levels : aon_sell_levels;
+    uint64_t available = (side == OrderSide::SELL ? sell_ladder : buy_ladder).getTotalVolume();
+    for (size_t index = 0; index < PEG_TYPES; ++index) {
+        available += (side == OrderSide::SELL ? pegged_sell_ladders[index] : pegged_buy_ladders[index]).getTotalVolume();
+    }
+    if (aon_sizes.empty() || aon_sizes.begin()->first.first > available) {
+        return;
+    }
+    // walk the levels best price first, in time order within a level. the liquidity an order can reach only
+    // shrinks as its price gets worse, so the walk stops at the first level where not even the smallest
+    // resting order could fill
+    uint64_t smallest = aon_sizes.begin()->first.first;
+    size_t first = aon_candidates.size();
+    auto collect = [&](const Level &level) {
+        uint64_t reachable = matchableVolume(side == OrderSide::SELL ? OrderSide::BUY : OrderSide::SELL, level.getPrice());
+        if (reachable < smallest) {
+            return false;
+        }
+        for (const RestingOrder &order : level.getOrders()) {
+            if (order.getOpenQuantity() <= reachable) {
+                aon_candidates.push_back(order.getId());
+            }
+        }
+        return true;
+    };
+    if (side == OrderSide::SELL) {
+        for (auto level_it = aon_levels.rbegin(); level_it != aon_levels.rend() && collect(level_it->second); ++level_it) {}
+    } else {
+        for (auto level_it = aon_levels.begin(); level_it != aon_levels.end() && collect(level_it->second); ++level_it) {}
+    }
+    for (size_t i = first; i < aon_candidates.size(); ++i) {
+        auto orders_it = orders.find(aon_candidates[i]);
+        if (orders_it == orders.end()) {
+            continue;
+        }
+        // a better placed order may have taken the liquidity
+        Order order = toOrder(*orders_it);
+        if (!canMatchOrder(order)) {
+            continue;
+        }
+        // take the order off the book quietly and match it as if it just arrived, it fills in full
+        removeOrder(orders_it);
+        match(order);
+        event_handler.handleOrderDeleted(OrderDeleted{order, stamp()});
+    }
+    aon_candidates.resize(first);
+}
+
+void PriceLevelOrderBook::addPeggedOrder(Order &order) {
+    uint64_t peg_price = 0;
+    if (pegPrice(order.getType(), order.getSide(), order.getPegOffset(), getBestBuy(), getBestSell(), peg_price)) {
+        order.setPrice(peg_price);
+        match(order);
+    }
+    // IOC and FOK orders need to be executed immediately, a pegged order without a reference price waits for one
+    if (order.getOpenQuantity() != 0 && order.getTimeInForce() != OrderTimeInForce::IOC && order.getTimeInForce() != OrderTimeInForce::FOK) {
+        insertPeggedOrder(order);
+        activateAonOrders(order.getSide());
+    } else {
+        event_handler.handleOrderDeleted(OrderDeleted{order, stamp()});
+    }
+}
+
+void PriceLevelOrderBook::insertPeggedOrder(const Order &order) {
+    bool is_sell = order.getSide() == OrderSide::SELL;
+    size_t index = pegIndex(order.getType());
+    LevelMap &pegged_levels = is_sell ? pegged_sell_levels[index] : pegged_buy_levels[index];
+    VolumeLadder &pegged_ladder = is_sell ? pegged_sell_ladders[index] : pegged_buy_ladders[index];
+    auto [level_it, inserted] = pegged_levels.emplace(order.getPegOffset(),
+        Level(order.getPegOffset(), is_sell ? LevelSide::SELL : LevelSide::BUY, symbol_id, &orders, &pegged_ladder, arena));
+    restOrder(order, level_it);
+}
+
+bool PriceLevelOrderBook::pegReference(OrderType type, OrderSide side, uint64_t best_buy, uint64_t best_sell, uint64_t &reference) {
+    bool has_buy = best_buy != 0;
+    bool has_sell = best_sell != std::numeric_limits<uint64_t>::max();
+    bool is_sell = side == OrderSide::SELL;
+    switch (type) {
+        case OrderType::PEG_PRIMARY:
+            if (is_sell ? !has_sell : !has_buy) {
+                return false;
+            }
+            reference = is_sell ? best_sell : best_buy;
+            return true;
+        case OrderType::PEG_MIDPOINT:
+            if (!has_buy || !has_sell) {
+                return false;
+            }
+            // round away from the opposite side
+            reference = best_buy + (best_sell - best_buy + (is_sell ? 1 : 0)) / 2;
+            return true;
+        case OrderType::PEG_MARKET:
+            if (is_sell ? !has_buy : !has_sell) {
+                return false;
+            }
+            reference = is_sell ? best_buy : best_sell;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool PriceLevelOrderBook::pegPrice(OrderType type, OrderSide side, uint64_t offset, uint64_t best_buy, uint64_t best_sell, uint64_t &price) {
+    uint64_t reference = 0;
+    if (!pegReference(type, side, best_buy, best_sell, reference)) {
+        return false;
+    }
+    bool has_buy = best_buy != 0;
+    bool has_sell = best_sell != std::numeric_limits<uint64_t>::max();
+    // the offset moves the order away from the opposite side, and it never reaches the opposite best price
+    if (side == OrderSide::SELL) {
+        if (offset > std::numeric_limits<uint64_t>::max() - reference) {
+            return false;
+        }
+        price = reference + offset;
+        if (has_buy) {
+            price = std::max(price, best_buy + 1);
+        }
+        return true;
+    }
+    if (offset >= reference) {
+        return false;
+    }
+    price = reference - offset;
+    if (has_sell) {
+        price = std::min(price, best_sell - 1);
+    }
+    return price != 0;
+}
+
+uint64_t PriceLevelOrderBook::crossingPegVolume(OrderSide side, uint64_t price, uint64_t best_buy, uint64_t best_sell) const {
+    uint64_t volume = 0;
+    for (size_t index = 0; index < PEG_TYPES; ++index) {
+        const VolumeLadder &pegged_ladder = side == OrderSide::SELL ? pegged_sell_ladders[index] : pegged_buy_ladders[index];
+        if (pegged_ladder.getTotalVolume() == 0) {
+            continue;
+        }
+        uint64_t reference = 0;
+        if (!pegReference(pegType(index), side, best_buy, best_sell, reference)) {
+            continue;
+        }
+        // a peg's price only gets less aggressive as its offset grows, so the crossing orders are the
+        // offsets up to the one priced exactly at price, provided the clamp against the opposite side allows it
+        if (side == OrderSide::SELL) {
+            if (reference <= price && (best_buy == 0 || best_buy < price)) {
+                volume += pegged_ladder.volumeAtOrBelow(price - reference);
+            }
+        } else {
+            uint64_t lowest = std::max<uint64_t>(price, 1);
+            if (reference >= lowest && (best_sell == std::numeric_limits<uint64_t>::max() || best_sell > lowest)) {
+                volume += pegged_ladder.volumeAtOrBelow(reference - lowest);
+            }
+        }
+    }
+    return volume;
+}
+
+void PriceLevelOrderBook::bestPeggedLevel(OrderSide side, uint64_t limit, uint64_t best_buy, uint64_t best_sell, Level *&level, uint64_t &price) {
+    for (size_t index = 0; index < PEG_TYPES; ++index) {
+        LevelMap &pegged_levels = side == OrderSide::SELL ? pegged_sell_levels[index] : pegged_buy_levels[index];
+        if (pegged_levels.empty()) {
+            continue;
+        }
+        auto &[offset, pegged_level] = *pegged_levels.begin();
+        uint64_t peg_price = 0;
+        if (!pegPrice(pegType(index), side, offset, best_buy, best_sell, peg_price)) {
+            continue;
+        }
+        // strictly better only, displayed orders keep priority at the same price
+        if (side == OrderSide::SELL) {
+            if (peg_price <= limit && (level == nullptr || peg_price < price)) {
+                level = &pegged_level;
+                price = peg_price;
+            }
+        } else if (peg_price >= limit && (level == nullptr || peg_price > price)) {
+            level = &pegged_level;
+            price = peg_price;
+        }
     }
 }
 
@@ -193,7 +736,7 @@ void PriceLevelOrderBook::addStopOrder(Order &order) {
         }
         order.setStopPrice(0);
         order.setTrailAmount(0);
-        event_handler.handleOrderUpdated(OrderUpdated{order});
+        event_handler.handleOrderUpdated(OrderUpdated{order, stamp()});
         if (order.getType() == OrderType::MARKET) {
             addMarketOrder(order);
         } else {
@@ -210,69 +753,45 @@ void PriceLevelOrderBook::addStopOrder(Order &order) {
 
 void PriceLevelOrderBook::insertStopOrder(const Order &order) {
     auto stop_price = order.getStopPrice();
-    auto order_id = order.getId();
 
     if (order.getSide() == OrderSide::SELL) {
         auto level_it = stop_sell_levels.emplace(
             std::piecewise_construct, // to avoid unnecessary copying, gives better performance
             std::make_tuple(stop_price),
-            std::make_tuple(stop_price, LevelSide::SELL, symbol_id)
+            std::make_tuple(stop_price, LevelSide::SELL, symbol_id, &orders, nullptr, arena)
         ).first;
-        
-        auto [orders_it, success] = orders.emplace(
-            order_id, 
-            OrderWithLevelIterator{order, level_it}
-        );
-        level_it->second.addOrder(orders_it->second.order);
+        restOrder(order, level_it);
     } else {
         auto level_it = stop_buy_levels.emplace(
             std::piecewise_construct,
             std::make_tuple(stop_price),
-            std::make_tuple(stop_price, LevelSide::BUY, symbol_id)
+            std::make_tuple(stop_price, LevelSide::BUY, symbol_id, &orders, nullptr, arena)
         ).first;
-        
-        auto [orders_it, success] = orders.emplace(
-            order_id, 
-            OrderWithLevelIterator{order, level_it}
-        );
-        level_it->second.addOrder(orders_it->second.order);
+        restOrder(order, level_it);
     }
 }
 
 void PriceLevelOrderBook::insertTrailingStopOrder(const Order &order) {
     auto stop_price = order.getStopPrice();
-    auto order_id = order.getId();
 
     if (order.getSide() == OrderSide::SELL) {
         auto level_it = trailing_stop_sell_levels.emplace(
             std::piecewise_construct, // to avoid unnecessary copying, gives better performance
             std::make_tuple(stop_price),
-            std::make_tuple(stop_price, LevelSide::SELL, symbol_id)
+            std::make_tuple(stop_price, LevelSide::SELL, symbol_id, &orders, nullptr, arena)
         ).first;
-        
-        auto [orders_it, success] = orders.emplace(
-            order_id, 
-            OrderWithLevelIterator{order, level_it}
-        );
-        level_it->second.addOrder(orders_it->second.order);
-        orders_it->second.level_it = level_it;
+        restOrder(order, level_it);
     } else {
         auto level_it = trailing_stop_buy_levels.emplace(
             std::piecewise_construct,
             std::make_tuple(stop_price),
-            std::make_tuple(stop_price, LevelSide::BUY, symbol_id)
+            std::make_tuple(stop_price, LevelSide::BUY, symbol_id, &orders, nullptr, arena)
         ).first;
-        
-        auto [orders_it, success] = orders.emplace(
-            order_id, 
-            OrderWithLevelIterator{order, level_it}
-        );
-        level_it->second.addOrder(orders_it->second.order);
-        orders_it->second.level_it = level_it;
+        restOrder(order, level_it);
     }
 }
 
-uint64_t PriceLevelOrderBook::calculateStopPrice(Order &order) {
+uint64_t PriceLevelOrderBook::calculateStopPrice(OrderRef order) {
     uint64_t trail_amount = order.getTrailAmount();
     if (order.getSide() == OrderSide::SELL) {
         uint64_t market_price = lastTradedBuyPrice();
@@ -303,20 +822,20 @@ void PriceLevelOrderBook::updateTrailingBuyStopOrders() {
     // if the trailing sell price > last traded sell price, market has moved in the favorable direction for trailing 
     // stop buy orders, we need to update their stop price
     if (trailing_sell_price > lastTradedSellPrice() && !trailing_stop_buy_levels.empty()) {
-        std::map<uint64_t, Level> updated_trailing_levels; // temp map for updated levels 
+        LevelMap updated_trailing_levels(trailing_stop_buy_levels.get_allocator()); // temp map for updated levels
         for (auto& [level_price, level] : trailing_stop_buy_levels) {
             // for each order in the level, calculate the new price, remove the previous order and add the new order
             while (!level.empty()) {
-                Order& stop_order = level.front();
-                uint64_t new_stop_price = calculateStopPrice(stop_order);
+                RestingOrder &stop_order = level.front();
+                uint64_t new_stop_price = calculateStopPrice(resting(stop_order));
 
                 auto updated_level_it = updated_trailing_levels.emplace(
-                    new_stop_price, Level(new_stop_price, LevelSide::BUY, symbol_id)).first;
+                    new_stop_price, Level(new_stop_price, LevelSide::BUY, symbol_id, &orders, nullptr, arena)).first;
                 
-                orders[stop_order.getId()].level_it = updated_level_it;
+                orders.cold(stop_order).level_it = updated_level_it;
                 level.popFront();
                 updated_level_it->second.addOrder(stop_order);
-                event_handler.handleOrderUpdated(OrderUpdated{stop_order});
+                event_handler.handleOrderUpdated(OrderUpdated{toOrder(stop_order), stamp()});
             }
         }
         // swap the old levels with the new ones
@@ -330,19 +849,19 @@ void PriceLevelOrderBook::updateTrailingSellStopOrders() {
     // if the trailing buy price < last traded buy price, market has moved in a favorable direction for trailing
     // stop sell orders, we need to update their stop price
     if (trailing_buy_price < lastTradedBuyPrice() && !trailing_stop_sell_levels.empty()) {
-        std::map<uint64_t, Level> updated_trailing_levels;
+        LevelMap updated_trailing_levels(trailing_stop_sell_levels.get_allocator());
         for (auto& [level_price, level] : trailing_stop_sell_levels) {
             while (!level.empty()) {
-                Order& stop_order = level.front();
-                uint64_t new_stop_price = calculateStopPrice(stop_order);
+                RestingOrder &stop_order = level.front();
+                uint64_t new_stop_price = calculateStopPrice(resting(stop_order));
 
                 auto updated_level_it = updated_trailing_levels.emplace(
-                    new_stop_price, Level(new_stop_price, LevelSide::SELL, symbol_id)).first;
+                    new_stop_price, Level(new_stop_price, LevelSide::SELL, symbol_id, &orders, nullptr, arena)).first;
                 
-                orders[stop_order.getId()].level_it = updated_level_it;
+                orders.cold(stop_order).level_it = updated_level_it;
                 level.popFront();
                 updated_level_it->second.addOrder(stop_order);
-                event_handler.handleOrderUpdated(OrderUpdated{stop_order});
+                event_handler.handleOrderUpdated(OrderUpdated{toOrder(stop_order), stamp()});
             }
         }
         // swap the old levels with the new ones
@@ -372,8 +891,7 @@ bool PriceLevelOrderBook::activateBuyStopOrders() {
     // if the current stop level price <= last sell price, it is eligible for activation
     while (stop_levels_it != stop_buy_levels.end() && stop_levels_it->first <= last_sell_price) {
         activated_orders = true;
-        Order &stop_order = stop_levels_it->second.front();
-        activateStopOrder(stop_order);
+        activateStopOrder(toOrder(stop_levels_it->second.front()));
         // reset level iterator to the beginning to account for any changes in the order book caused by this new activation
         stop_levels_it = stop_buy_levels.begin();
     }
@@ -382,8 +900,7 @@ bool PriceLevelOrderBook::activateBuyStopOrders() {
     last_sell_price = lastTradedSellPrice();
     while (trailing_stop_levels_it != trailing_stop_buy_levels.end() && trailing_stop_levels_it->first <= last_sell_price) {
         activated_orders = true;
-        Order &trailing_stop_order = trailing_stop_levels_it->second.front();
-        activateStopOrder(trailing_stop_order);
+        activateStopOrder(toOrder(trailing_stop_levels_it->second.front()));
         trailing_stop_levels_it = trailing_stop_buy_levels.begin();
     }
     return activated_orders;
@@ -397,8 +914,7 @@ bool PriceLevelOrderBook::activateSellStopOrders() {
     // if the current stop level price >= last buy price, it is eligible for activation
     while (stop_levels_it != stop_sell_levels.rend() && stop_levels_it->first >= last_buy_price) {
         activated_orders = true;
-        Order &stop_order = stop_levels_it->second.front();
-        activateStopOrder(stop_order);
+        activateStopOrder(toOrder(stop_levels_it->second.front()));
         // reset level iterator to the beginning to account for any changes in the order book caused by this new activation
         stop_levels_it = stop_sell_levels.rbegin();
     }
@@ -406,8 +922,7 @@ bool PriceLevelOrderBook::activateSellStopOrders() {
     last_buy_price = lastTradedBuyPrice();
     while (trailing_stop_levels_it != trailing_stop_sell_levels.rend() && trailing_stop_levels_it->first >= last_buy_price) {
         activated_orders = true;
-        Order &trailing_stop_order = trailing_stop_levels_it->second.front();
-        activateStopOrder(trailing_stop_order);
+        activateStopOrder(toOrder(trailing_stop_levels_it->second.front()));
         trailing_stop_levels_it = trailing_stop_sell_levels.rbegin();
     }
     return activated_orders;
@@ -415,116 +930,462 @@ bool PriceLevelOrderBook::activateSellStopOrders() {
 
 // deletes the stop order, instead adds a new market or limit order depending of stop order type
 void PriceLevelOrderBook::activateStopOrder(Order order) {
-    deleteOrder(order.getId());
+    // the stop leaves the book, the update below announces it coming back as a market or limit order. the
+    // delete is emitted here rather than through deleteOrder so no other stop activates in between
+    event_handler.handleOrderDeleted(OrderDeleted{order, stamp()});
+    removeOrder(orders.find(order.getId()));
     order.setStopPrice(0);
     order.setTrailAmount(0);
     if (order.getType() == OrderType::STOP || order.getType() == OrderType::TRAILING_STOP) {
         order.setType(OrderType::MARKET);
-        event_handler.handleOrderUpdated(OrderUpdated{order});
+        event_handler.handleOrderUpdated(OrderUpdated{order, stamp()});
         addMarketOrder(order);
     }
     else {
         order.setType(OrderType::LIMIT);
-        event_handler.handleOrderUpdated(OrderUpdated{order});
+        event_handler.handleOrderUpdated(OrderUpdated{order, stamp()});
         addLimitOrder(order);
     }
 }
 
 void PriceLevelOrderBook::match(Order &order) {
-    //  if order is fill or kill and cannot be filled, nothing happens
-    if (order.getTimeInForce() == OrderTimeInForce::FOK && !canMatchOrder(order)) {
+    // during an auction orders only rest, the crossed book is matched by uncross()
+    if (in_auction) {
         return;
     }
+    //  if order is fill or kill or all or none and cannot be filled, nothing happens
+    if ((order.getTimeInForce() == OrderTimeInForce::FOK || order.getTimeInForce() == OrderTimeInForce::AON) && !canMatchOrder(order)) {
+        return;
+    }
+    // pegged orders are priced off the best prices as they stood when the order arrived
+    uint64_t best_buy = getBestBuy();
+    uint64_t best_sell = getBestSell();
+    ++match_depth;
+    size_t first_trade = trades.size();
+    // owner whose resting orders the incoming order must not trade with, 0 matches no one
+    uint32_t stp_owner = order.getSelfTradePrevention() == SelfTradePrevention::NONE ? 0 : order.getOwnerId();
+    // resting all or none orders priced better than the next regular level fill before it, each price is
+    // checked once
+    bool aon_checked = false;
+    uint64_t aon_checked_price = 0;
     if (order.getSide() == OrderSide::SELL) {
         // since we have a sell order, we would want to match it to some buy order (highest price first)
-        auto buy_levels_it = buy_levels.rbegin();
         Order &sell_order = order;
-        // while the highest buy price >= price of the sell order and the sell order still has open quantity
-        while (buy_levels_it != buy_levels.rend() && buy_levels_it->first >= sell_order.getPrice() && sell_order.getOpenQuantity() != 0) {
-            Level &buy_level = buy_levels_it->second;
+        // while the sell order still has open quantity
+        while (sell_order.getOpenQuantity() != 0) {
+            // the best buy is the highest buy level if its price >= price of the sell order, unless a pegged order beats it
+            Level *buy_level = nullptr;
+            uint64_t executing_price = 0;
+            if (!buy_levels.empty() && buy_levels.rbegin()->first >= sell_order.getPrice()) {
+                buy_level = &buy_levels.rbegin()->second;
+                executing_price = buy_levels.rbegin()->first;
+            }
+            bestPeggedLevel(OrderSide::BUY, sell_order.getPrice(), best_buy, best_sell, buy_level, executing_price);
+            if (buy_level == nullptr) {
+                break;
+            }
+            if (!aon_checked || aon_checked_price != executing_price) {
+                aon_checked = true;
+                aon_checked_price = executing_price;
+                uint64_t open_before = sell_order.getOpenQuantity();
+                matchAonOrders(sell_order, executing_price, false);
+                if (sell_order.getOpenQuantity() != open_before) {
+                    continue; // the fills may have activated stop orders that moved the levels
+                }
+            }
             // get first buy order
-            Order &buy_order = buy_level.front();
-            uint64_t executing_price = buy_order.getPrice();
-            // sell order is matched with the top buy order in the current level
-            executeOrders(sell_order, buy_order, executing_price);
-            buy_level.reduceVolume(buy_order.getLastExecutedQuantity());
+            RestingOrder &buy_order = buy_level->front();
+            if (buy_order.getOwnerId() == stp_owner && stp_owner != 0) {
+                preventSelfTrade(sell_order, *buy_level, buy_order);
+                continue;
+            }
+            buy_order.setPrice(executing_price);
+            // sell order is matched with the displayed quantity of the top buy order in the current level
+            uint64_t visible_before_execute = buy_order.getVisibleQuantity();
+            uint64_t executed = executeOrders(sell_order, resting(buy_order), executing_price, visible_before_execute);
+            recordTrade(sell_order.getId(), OrderSide::SELL, buy_order.getId(), executing_price, executed);
+            reduceRestingOrder(*buy_level, buy_order, visible_before_execute);
             // remove buy order if its now filled
             if (buy_order.getOpenQuantity() == 0)
                 deleteOrder(buy_order.getId());
-            // reset level iterator to the beginning to account for any changes in the order book caused by this new execution
-            buy_levels_it = buy_levels.rbegin();
         }
     }
     if (order.getSide() == OrderSide::BUY) {
         // since we have a buy order, we would want to match it to some sell order (lowest price first)
-        auto sell_levels_it = sell_levels.begin();
         Order &buy_order = order;
-        // while the lowest sell price <= price of the buy order and the buy order still has open quantity
-        while (sell_levels_it != sell_levels.end() && sell_levels_it->first <= buy_order.getPrice() && buy_order.getOpenQuantity() != 0) {
-            Level &sell_level = sell_levels_it->second;
+        // while the buy order still has open quantity
+        while (buy_order.getOpenQuantity() != 0) {
+            // the best sell is the lowest sell level if its price <= price of the buy order, unless a pegged order beats it
+            Level *sell_level = nullptr;
+            uint64_t executing_price = 0;
+            if (!sell_levels.empty() && sell_levels.begin()->first <= buy_order.getPrice()) {
+                sell_level = &sell_levels.begin()->second;
+                executing_price = sell_levels.begin()->first;
+            }
+            bestPeggedLevel(OrderSide::SELL, buy_order.getPrice(), best_buy, best_sell, sell_level, executing_price);
+            if (sell_level == nullptr) {
+                break;
+            }
+            if (!aon_checked || aon_checked_price != executing_price) {
+                aon_checked = true;
+                aon_checked_price = executing_price;
+                uint64_t open_before = buy_order.getOpenQuantity();
+                matchAonOrders(buy_order, executing_price, false);
+                if (buy_order.getOpenQuantity() != open_before) {
+                    continue; // the fills may have activated stop orders that moved the levels
+                }
+            }
             // get first sell order
-            Order &sell_order = sell_level.front();
-            uint64_t executing_price = sell_order.getPrice();
-            // buy order is matched with the top sell order in the current level
-            executeOrders(sell_order, buy_order, executing_price);
-            sell_level.reduceVolume(sell_order.getLastExecutedQuantity());
+            RestingOrder &sell_order = sell_level->front();
+            if (sell_order.getOwnerId() == stp_owner && stp_owner != 0) {
+                preventSelfTrade(buy_order, *sell_level, sell_order);
+                continue;
+            }
+            sell_order.setPrice(executing_price);
+            // buy order is matched with the displayed quantity of the top sell order in the current level
+            uint64_t visible_before_execute = sell_order.getVisibleQuantity();
+            uint64_t executed = executeOrders(resting(sell_order), buy_order, executing_price, visible_before_execute);
+            recordTrade(buy_order.getId(), OrderSide::BUY, sell_order.getId(), executing_price, executed);
+            reduceRestingOrder(*sell_level, sell_order, visible_before_execute);
             // remove the sell order if its now filled
             if (sell_order.getOpenQuantity() == 0)
                 deleteOrder(sell_order.getId());
-            // reset level iterator to the beginning to account for any changes in the order book caused by this new execution
-            sell_levels_it = sell_levels.begin();
         }
     }
+    // whatever is left can fill resting all or none orders up to its own price
+    if (order.getOpenQuantity() != 0) {
+        matchAonOrders(order, order.getPrice(), true);
+    }
+    activateReplenishedAonOrders();
+
+    // stop orders activated on the way matched inside this call, their trades are in the batch as well
+    FillSummary summary{order.getId(), 0, 0, 0, 0, order.getOpenQuantity(), symbol_id, 0, order.getSide()};
+    for (size_t i = first_trade; i < trades.size(); ++i) {
+        const Trade &trade = trades[i];
+        if (trade.aggressor_id != order.getId() || trade.auction) {
+            continue;
+        }
+        if (summary.trade_count == 0) {
+            summary.first_price = trade.price;
+        }
+        summary.last_price = trade.price;
+        summary.quantity += trade.quantity;
+        summary.notional += trade.price * trade.quantity;
+        ++summary.trade_count;
+    }
+    if (summary.trade_count != 0) {
+        fill_summaries.push_back(summary);
+    }
+    if (--match_depth == 0) {
+        flushTrades();
+    }
+}
+
+void PriceLevelOrderBook::recordTrade(uint64_t aggressor_id, OrderSide aggressor_side, uint64_t passive_id, uint64_t price,
+    uint64_t quantity, bool auction) {
+    trades.push_back(Trade{next_trade_id++, aggressor_id, passive_id, price, quantity, eventTime(), 0, 0, symbol_id,
+        0, aggressor_side, auction});
+}
+
+void PriceLevelOrderBook::flushTrades() {
+    if (!trades.empty()) {
+        sequenceBatch(trades);
+        event_handler.handleTrades(trades, fill_summaries);
+    }
+    trades.clear();
+    fill_summaries.clear();
+}
+
+void PriceLevelOrderBook::startAuction() {
+    in_auction = true;
+}
+
+void PriceLevelOrderBook::uncross() {
+    CommandTime command(*this);
+    in_auction = false;
+    uint64_t price = 0;
+    uint64_t volume = 0;
+    if (!buy_levels.empty() && !sell_levels.empty() && buy_levels.rbegin()->first >= sell_levels.begin()->first) {
+        uint64_t low = sell_levels.begin()->first;
+        uint64_t high = buy_levels.rbegin()->first;
+        buildAuctionCurves(low, high);
+        uint64_t reference = last_traded_price != 0 ? last_traded_price : low + (high - low) / 2;
+        size_t equilibrium = findEquilibrium(reference);
+        price = auction_prices[equilibrium];
+        volume = std::min(auction_demand[equilibrium], auction_supply[equilibrium]);
+    }
+
+    // execute in price time priority on both sides, everything at the uncross price. filled orders leave their
+    // levels straight away but their events and removal from the book wait until the batch is out
+    auction_executions.clear();
+    auction_filled.clear();
+    auction_replenished.clear();
+    uint64_t remaining = volume;
+    while (remaining != 0) {
+        auto buy_level_it = std::prev(buy_levels.end());
+        auto sell_level_it = sell_levels.begin();
+        RestingOrder &buy_order = buy_level_it->second.front();
+        RestingOrder &sell_order = sell_level_it->second.front();
+        uint64_t quantity = std::min({remaining, buy_order.getVisibleQuantity(), sell_order.getVisibleQuantity()});
+        uint64_t buy_visible_before = buy_order.getVisibleQuantity();
+        uint64_t sell_visible_before = sell_order.getVisibleQuantity();
+        resting(buy_order).execute(price, quantity);
+        resting(sell_order).execute(price, quantity);
+        recordTrade(buy_order.getId(), OrderSide::BUY, sell_order.getId(), price, quantity, true);
+        Timestamp now = eventTime();
+        auction_executions.emplace_back(toOrder(buy_order), now);
+        auction_executions.emplace_back(toOrder(sell_order), now);
+        remaining -= quantity;
+        reduceRestingOrder(buy_level_it->second, buy_order, buy_visible_before, &auction_replenished);
+        reduceRestingOrder(sell_level_it->second, sell_order, sell_visible_before, &auction_replenished);
+        if (buy_order.getOpenQuantity() == 0) {
+            auction_filled.push_back(buy_order.getId());
+            buy_level_it->second.deleteOrder(buy_order);
+            if (buy_level_it->second.empty()) {
+                buy_levels.erase(buy_level_it);
+            }
+        }
+        if (sell_order.getOpenQuantity() == 0) {
+            auction_filled.push_back(sell_order.getId());
+            sell_level_it->second.deleteOrder(sell_order);
+            if (sell_level_it->second.empty()) {
+                sell_levels.erase(sell_level_it);
+            }
+        }
+    }
+    if (volume != 0) {
+        last_traded_price = price;
+        sequenceBatch(auction_executions);
+        event_handler.handleOrderExecutedBatch(auction_executions);
+        flushTrades();
+    }
+    // icebergs that showed a new peak follow the executions that uncovered it, once each with the peak left
+    // standing. those filled later on are only reported deleted
+    std::sort(auction_replenished.begin(), auction_replenished.end());
+    auction_replenished.erase(std::unique(auction_replenished.begin(), auction_replenished.end()), auction_replenished.end());
+    for (uint64_t order_id : auction_replenished) {
+        const RestingOrder &replenished = *orders.find(order_id);
+        if (replenished.getOpenQuantity() != 0) {
+            event_handler.handleOrderUpdated(OrderUpdated{toOrder(replenished), stamp()});
+        }
+    }
+    for (uint64_t order_id : auction_filled) {
+        auto orders_it = orders.find(order_id);
+        event_handler.handleOrderDeleted(OrderDeleted{toOrder(*orders_it), stamp()});
+        unindexOrder(*orders_it);
+        orders.erase(orders_it);
+    }
+    event_handler.handleAuctionUncrossed(AuctionUncrossed{symbol_id, price, volume, stamp()});
+
+    // back to continuous matching: the new price may trigger stops, and resting all or none orders were
+    // never checked during the call
+    activateStopOrders();
+    activateReplenishedAonOrders();
+    activateAonOrders(OrderSide::SELL);
+    activateAonOrders(OrderSide::BUY);
+}
+
+void PriceLevelOrderBook::buildAuctionCurves(uint64_t low, uint64_t high) {
+    auction_prices.clear();
+    auction_demand.clear();
+    auction_supply.clear();
+    // merge the buy and sell level prices in the crossed range into one ascending price axis
+    auto buy_levels_it = buy_levels.lower_bound(low);
+    auto sell_levels_it = sell_levels.begin();
+    while (buy_levels_it != buy_levels.end() || (sell_levels_it != sell_levels.end() && sell_levels_it->first <= high)) {
+        bool take_buy = buy_levels_it != buy_levels.end();
+        bool take_sell = sell_levels_it != sell_levels.end() && sell_levels_it->first <= high;
+        if (take_buy && take_sell) {
+            take_buy = buy_levels_it->first <= sell_levels_it->first;
+            take_sell = sell_levels_it->first <= buy_levels_it->first;
+        }
+        uint64_t level_price = take_buy ? buy_levels_it->first : sell_levels_it->first;
+        auction_prices.push_back(level_price);
+        auction_demand.push_back(take_buy ? buy_levels_it->second.getVolume() : 0);
+        auction_supply.push_back(take_sell ? sell_levels_it->second.getVolume() : 0);
+        if (take_buy) {
+            ++buy_levels_it;
+        }
+        if (take_sell) {
+            ++sell_levels_it;
+        }
+    }
+    // buys at or above each price are a suffix sum, sells at or below it a prefix sum
+    size_t count = auction_prices.size();
+    for (size_t i = count - 1; i > 0; --i) {
+        auction_demand[i - 1] += auction_demand[i];
+    }
+    for (size_t i = 1; i < count; ++i) {
+        auction_supply[i] += auction_supply[i - 1];
+    }
+}
+
+size_t PriceLevelOrderBook::findEquilibrium(uint64_t reference) const {
+    size_t best = 0;
+    uint64_t best_volume = 0;
+    uint64_t best_imbalance = 0;
+    uint64_t best_distance = 0;
+    for (size_t i = 0; i < auction_prices.size(); ++i) {
+        uint64_t demand = auction_demand[i];
+        uint64_t supply = auction_supply[i];
+        uint64_t executable = std::min(demand, supply);
+        uint64_t imbalance = demand > supply ? demand - supply : supply - demand;
+        uint64_t distance = auction_prices[i] > reference ? auction_prices[i] - reference : reference - auction_prices[i];
+        if (i == 0 || executable > best_volume || (executable == best_volume && (imbalance < best_imbalance
+            || (imbalance == best_imbalance && distance < best_distance)))) {
+            best = i;
+            best_volume = executable;
+            best_imbalance = imbalance;
+            best_distance = distance;
+        }
+    }
+    return best;
 }
 
 // helper method to see whether a FOK order can be matched
 bool PriceLevelOrderBook::canMatchOrder(const Order &order) const {
-    uint64_t price = order.getPrice();
-    uint64_t quantity_required = order.getOpenQuantity();
-    uint64_t quantity_available = 0; // accumulator to see how much maximum quantity can be matched for this order
-    if (order.getSide() == OrderSide::SELL) {
-        // since we have a sell order, we want to match it to buy orders (highest price first)
-        auto buy_levels_it = buy_levels.rbegin();
-        // while buy level's price is greater than or equal to the sell order's price
-        while (buy_levels_it != buy_levels.rend() && buy_levels_it->first >= price) {
-            // check whether the level has enough quantity to fill this order
-            uint64_t level_volume = buy_levels_it->second.getVolume();
-            uint64_t quantity_needed = quantity_required - quantity_available;
-            quantity_available += std::min(level_volume, quantity_needed);
-            if (quantity_available >= quantity_required)
-                return true;
-        }
+    return matchableVolume(order.getSide(), order.getPrice()) >= order.getOpenQuantity();
+}
+
+uint64_t PriceLevelOrderBook::matchableVolume(OrderSide side, uint64_t price) const {
+    uint64_t best_buy = getBestBuy();
+    uint64_t best_sell = getBestSell();
+    if (side == OrderSide::SELL) {
+        // a sell order can match buy orders priced at or above it
+        return buy_ladder.volumeAtOrAbove(price) + crossingPegVolume(OrderSide::BUY, price, best_buy, best_sell);
     }
-    else {
-        // since we have a buy order, we want to match it to a sell order (lowest price first)
-        auto sell_levels_it = sell_levels.begin();
-        // while the sell level's price is lower than or equal to the buy order's price
-        while (sell_levels_it != sell_levels.end() && sell_levels_it->first <= price) {
-            // check whether the level has enough quantity to fill this order
-            uint64_t level_volume = sell_levels_it->second.getVolume();
-            uint64_t quantity_needed = quantity_required - quantity_available;
-            quantity_available += std::min(level_volume, quantity_needed);
-            if (quantity_available >= quantity_required)
-                return true;
+    // a buy order can match sell orders priced at or below it
+    return sell_ladder.volumeAtOrBelow(price) + crossingPegVolume(OrderSide::SELL, price, best_buy, best_sell);
+}
+
+void PriceLevelOrderBook::preventSelfTrade(Order &order, Level &level, RestingOrder &resting) {
+    SelfTradePrevention mode = order.getSelfTradePrevention();
+    if (mode == SelfTradePrevention::DECREMENT) {
+        uint64_t quantity = std::min(order.getOpenQuantity(), resting.getOpenQuantity());
+        order.decrement(quantity);
+        event_handler.handleSelfTradePrevented(SelfTradePrevented{order, quantity, stamp()});
+        uint64_t visible_before = resting.getVisibleQuantity();
+        resting.decrement(quantity);
+        event_handler.handleSelfTradePrevented(SelfTradePrevented{toOrder(resting), quantity, stamp()});
+        reduceRestingOrder(level, resting, visible_before);
+        if (resting.getOpenQuantity() == 0) {
+            deleteOrder(resting.getId());
         }
+        return;
+    }
+    if (mode == SelfTradePrevention::CANCEL_OLDEST || mode == SelfTradePrevention::CANCEL_BOTH) {
+        deleteOrder(resting.getId());
+    }
+    if (mode == SelfTradePrevention::CANCEL_NEWEST || mode == SelfTradePrevention::CANCEL_BOTH) {
+        // the caller reports the order as deleted once matching stops
+        uint64_t quantity = order.getOpenQuantity();
+        order.decrement(quantity);
+        event_handler.handleSelfTradePrevented(SelfTradePrevented{order, quantity, stamp()});
     }
-    return false;
 }
 
-void PriceLevelOrderBook::executeOrders(Order &sell, Order &buy, uint64_t executing_price) {
+uint64_t PriceLevelOrderBook::executeOrders(OrderRef sell, OrderRef buy, uint64_t executing_price, uint64_t max_quantity) {
     // maximum quantity that can be matched between the 2 orders
-    uint64_t quantity = std::min(sell.getOpenQuantity(), buy.getOpenQuantity());
+    uint64_t quantity = std::min({sell.getOpenQuantity(), buy.getOpenQuantity(), max_quantity});
     buy.execute(executing_price, quantity);
     sell.execute(executing_price, quantity);
-    event_handler.handleOrderExecuted(OrderExecuted{buy});
-    event_handler.handleOrderExecuted(OrderExecuted{sell});
+    // both sides of the fill go out in one call
+    Timestamp now = eventTime();
+    fill_executions.clear();
+    fill_executions.emplace_back(buy.toOrder(), now);
+    fill_executions.emplace_back(sell.toOrder(), now);
+    sequenceBatch(fill_executions);
+    event_handler.handleOrderExecutedBatch(fill_executions);
     last_traded_price = executing_price;
+    return quantity;
+}
+
+void PriceLevelOrderBook::reduceRestingOrder(Level &level, RestingOrder &order, uint64_t visible_before,
+    std::vector<uint64_t> *replenished) {
+    level.reduceVolume(order, visible_before - order.getVisibleQuantity());
+    if (order.getVisibleQuantity() == 0 && order.getOpenQuantity() != 0) {
+        // the iceberg's peak filled, show the next one from the reserve
+        level.replenish(order);
+        if (replenished != nullptr) {
+            replenished->push_back(order.getId());
+        } else {
+            event_handler.handleOrderUpdated(OrderUpdated{toOrder(order), stamp()});
+        }
+        (order.getSide() == OrderSide::SELL ? sell_replenished : buy_replenished) = true;
+    }
+}
+
+void PriceLevelOrderBook::activateReplenishedAonOrders() {
+    // a fresh iceberg peak is new displayed liquidity, just like an order coming to rest
+    if (sell_replenished) {
+        sell_replenished = false;
+        activateAonOrders(OrderSide::SELL);
+    }
+    if (buy_replenished) {
+        buy_replenished = false;
+        activateAonOrders(OrderSide::BUY);
+    }
+}
+
+template <typename Book, typename Visit>
+void PriceLevelOrderBook::forEachLevelMap(Book &book, Visit visit) {
+    visit(book.buy_levels, ExportLevelKind::LIMIT, OrderSide::BUY);
+    visit(book.sell_levels, ExportLevelKind::LIMIT, OrderSide::SELL);
+    visit(book.aon_buy_levels, ExportLevelKind::ALL_OR_NONE, OrderSide::BUY);
+    visit(book.aon_sell_levels, ExportLevelKind::ALL_OR_NONE, OrderSide::SELL);
+    for (size_t index = 0; index < PEG_TYPES; ++index) {
+        ExportLevelKind kind = static_cast<ExportLevelKind>(static_cast<size_t>(ExportLevelKind::PEG_PRIMARY) + index);
+        visit(book.pegged_buy_levels[index], kind, OrderSide::BUY);
+        visit(book.pegged_sell_levels[index], kind, OrderSide::SELL);
+    }
+    visit(book.stop_buy_levels, ExportLevelKind::STOP, OrderSide::BUY);
+    visit(book.stop_sell_levels, ExportLevelKind::STOP, OrderSide::SELL);
+    visit(book.trailing_stop_buy_levels, ExportLevelKind::TRAILING_STOP, OrderSide::BUY);
+    visit(book.trailing_stop_sell_levels, ExportLevelKind::TRAILING_STOP, OrderSide::SELL);
+}
+
+void PriceLevelOrderBook::exportBinary(ExportBuffer &buffer) const {
+    ExportBookRecord book{last_traded_price, symbol_sequence, orders.size(), symbol_id, 0};
+    size_t book_offset = buffer.append(book);
+    forEachLevelMap(*this, [&](const LevelMap &levels, ExportLevelKind kind, OrderSide side) {
+        for (const auto& [price, level] : levels) {
+            buffer.append(ExportLevelRecord{price, level.getVolume(), static_cast<uint32_t>(level.getOrderCount()), kind, side, 0});
+            for (const RestingOrder &order : level.getOrders()) {
+                buffer.append(toExportRecord(toOrder(order)));
+            }
+        }
+        book.level_count += static_cast<uint32_t>(levels.size());
+    });
+    buffer.patch(book_offset, book);
+    buffer.endBook();
+}
+
+void PriceLevelOrderBook::captureChanges(ExportBuffer &buffer, bool full) {
+    ExportBookRecord book{last_traded_price, symbol_sequence, orders.size(), symbol_id, 0};
+    size_t book_offset = buffer.append(book);
+    forEachLevelMap(*this, [&](LevelMap &levels, ExportLevelKind kind, OrderSide side) {
+        for (auto& [price, level] : levels) {
+            bool changed = full || level.isChanged();
+            buffer.append(ExportLevelRecord{price, level.getVolume(), static_cast<uint32_t>(level.getOrderCount()), kind, side,
+                changed ? uint16_t{0} : EXPORT_LEVEL_UNCHANGED});
+            if (changed) {
+                for (const RestingOrder &order : level.getOrders()) {
+                    buffer.append(toExportRecord(toOrder(order)));
+                }
+            }
+            level.markCaptured();
+        }
+        book.level_count += static_cast<uint32_t>(levels.size());
+    });
+    buffer.patch(book_offset, book);
+    buffer.endBook();
 }
 
 void PriceLevelOrderBook::exportOrderBook(const std::string &path) const {
-    std::ofstream file(path);
-    file << toString();
-    file.close();
+    ExportBuffer buffer;
+    buffer.begin(sequencer != nullptr ? sequencer->getLast() : 0, clock.now());
+    exportBinary(buffer);
+    buffer.writeFile(path);
 }
 
 std::string PriceLevelOrderBook::toString() const {
@@ -539,6 +1400,25 @@ std::string PriceLevelOrderBook::toString() const {
     for (const auto& [price, level] : sell_levels) {
         oss << level.toString();
     }
+    oss << "BUY ALL OR NONE ORDERS\n";
+    for (const auto& [price, level] : aon_buy_levels) {
+        oss << level.toString();
+    }
+    oss << "SELL ALL OR NONE ORDERS\n";
+    for (const auto& [price, level] : aon_sell_levels) {
+        oss << level.toString();
+    }
+    for (size_t index = 0; index < PEG_TYPES; ++index) {
+        // pegged levels are listed by offset
+        oss << "BUY " << PEG_NAMES[index] << " PEGGED ORDERS\n";
+        for (const auto& [offset, level] : pegged_buy_levels[index]) {
+            oss << level.toString();
+        }
+        oss << "SELL " << PEG_NAMES[index] << " PEGGED ORDERS\n";
+        for (const auto& [offset, level] : pegged_sell_levels[index]) {
+            oss << level.toString();
+        }
+    }
     oss << "BUY STOP ORDERS\n";
     for (const auto& [price, level] : stop_buy_levels) {
         oss << level.toString();
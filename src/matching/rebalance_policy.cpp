@@ -0,0 +1,45 @@
+#include <algorithm>
+#include "rebalance_policy.h"
+
+namespace QuantaTrader {
+QueueDepthPolicy::QueueDepthPolicy(double imbalance_ratio, uint64_t min_queue_depth, uint32_t max_migrations)
+    : imbalance_ratio(imbalance_ratio),
+    min_queue_depth(min_queue_depth),
+    max_migrations(max_migrations) {}
+
+std::vector<Migration> QueueDepthPolicy::plan(const std::vector<ShardLoad> &shards, const std::vector<SymbolLoad> &symbols) {
+    std::vector<Migration> migrations;
+    if (shards.size() < 2) {
+        return migrations;
+    }
+    // rank shards by backlog, latency breaks ties
+    auto busier = [](const ShardLoad &a, const ShardLoad &b) {
+        return a.queue_depth != b.queue_depth ? a.queue_depth < b.queue_depth : a.latency_ns < b.latency_ns;
+    };
+    const ShardLoad &busiest = *std::max_element(shards.begin(), shards.end(), busier);
+    const ShardLoad &idlest = *std::min_element(shards.begin(), shards.end(), busier);
+    bool deep = busiest.queue_depth >= min_queue_depth && busiest.queue_depth > imbalance_ratio * idlest.queue_depth;
+    bool slow = busiest.latency_ns > imbalance_ratio * std::max<uint64_t>(idlest.latency_ns, 1);
+    if (busiest.shard_id == idlest.shard_id || busiest.symbols < 2 || !(deep || slow)) {
+        return migrations;
+    }
+
+    std::vector<SymbolLoad> candidates;
+    for (const SymbolLoad &symbol : symbols) {
+        // a symbol carrying more than half the shard's load would just move the hot spot
+        if (symbol.shard_id == busiest.shard_id && symbol.commands > 0 && 2 * symbol.commands <= busiest.commands) {
+            candidates.push_back(symbol);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const SymbolLoad &a, const SymbolLoad &b) {
+        return a.commands > b.commands;
+    });
+    for (const SymbolLoad &symbol : candidates) {
+        if (migrations.size() >= max_migrations) {
+            break;
+        }
+        migrations.push_back(Migration{symbol.symbol_id, idlest.shard_id});
+    }
+    return migrations;
+}
+}
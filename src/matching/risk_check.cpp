@@ -0,0 +1,217 @@
+#include <stdexcept>
+#include "risk_check.h"
+
+namespace QuantaTrader {
+
+PreTradeRisk::PreTradeRisk(uint32_t max_accounts, const RiskLimits &limits, uint32_t collar_bps)
+    : accounts(new Account[max_accounts]), account_count(max_accounts), collar_bps(collar_bps) {
+    for (uint32_t i = 0; i < max_accounts; ++i) {
+        accounts[i].limits = limits;
+    }
+}
+
+void PreTradeRisk::setLimits(uint32_t owner_id, const RiskLimits &limits) {
+    if (owner_id >= account_count) {
+        throw std::runtime_error("Account does not exist");
+    }
+    accounts[owner_id].limits = limits;
+}
+
+uint64_t PreTradeRisk::getOpenQuantity(uint32_t owner_id, OrderSide side) const {
+    const Account &account = accounts[owner_id];
+    return (side == OrderSide::SELL ? account.open_sell_quantity : account.open_buy_quantity).load(std::memory_order_relaxed);
+}
+
+int64_t PreTradeRisk::getPosition(uint32_t owner_id) const {
+    return accounts[owner_id].position.load(std::memory_order_relaxed);
+}
+
+uint64_t PreTradeRisk::referencePrice(const OrderBook &book) {
+    if (book.lastTradedPrice() != 0) {
+        return book.lastTradedPrice();
+    }
+    uint64_t best_buy = book.getBestBuy();
+    uint64_t best_sell = book.getBestSell();
+    if (best_buy == 0 || best_sell == std::numeric_limits<uint64_t>::max()) {
+        return 0;
+    }
+    return best_buy + (best_sell - best_buy) / 2;
+}
+
+bool PreTradeRisk::check(const Order &order, const OrderBook &book, RejectReason &reason) {
+    if (order.getOwnerId() >= account_count) {
+        reason = RejectReason::UNKNOWN_ACCOUNT;
+        return false;
+    }
+    Account &account = accounts[order.getOwnerId()];
+    const RiskLimits &limits = account.limits;
+    uint64_t quantity = order.getQuantity();
+    if (quantity > limits.max_order_quantity) {
+        reason = RejectReason::ORDER_QUANTITY;
+        return false;
+    }
+
+    // the book is only asked for a reference price when a limit needs one
+    bool has_limit_price = order.getType() == OrderType::LIMIT || order.getType() == OrderType::ICEBERG
+        || order.getType() == OrderType::STOP_LIMIT || order.getType() == OrderType::TRAILING_STOP_LIMIT;
+    bool collared = collar_bps != 0 && (order.getType() == OrderType::LIMIT || order.getType() == OrderType::ICEBERG);
+    uint64_t reference = 0;
+    if (collared || (!has_limit_price && limits.max_order_notional != std::numeric_limits<uint64_t>::max())) {
+        reference = referencePrice(book);
+    }
+    uint64_t value_price = has_limit_price ? order.getPrice() : reference;
+    if (value_price != 0 && quantity > limits.max_order_notional / value_price) {
+        reason = RejectReason::ORDER_NOTIONAL;
+        return false;
+    }
+    if (collared && reference != 0) {
+        uint64_t band = reference / 10000 * collar_bps + reference % 10000 * collar_bps / 10000;
+        bool through = order.getSide() == OrderSide::BUY
+            ? order.getPrice() > reference + band
+            : order.getPrice() < (band < reference ? reference - band : 0);
+        if (through) {
+            reason = RejectReason::PRICE_COLLAR;
+            return false;
+        }
+    }
+
+    uint64_t open_buy = account.open_buy_quantity.load(std::memory_order_relaxed);
+    uint64_t open_sell = account.open_sell_quantity.load(std::memory_order_relaxed);
+    if (open_buy + open_sell + quantity > limits.max_open_quantity) {
+        reason = RejectReason::OPEN_QUANTITY;
+        return false;
+    }
+    // worst case, every open order on the order's side fills as well
+    if (limits.max_position != std::numeric_limits<uint64_t>::max()) {
+        int64_t position = account.position.load(std::memory_order_relaxed);
+        int64_t exposure = order.getSide() == OrderSide::BUY
+            ? position + static_cast<int64_t>(open_buy + quantity)
+            : static_cast<int64_t>(open_sell + quantity) - position;
+        if (exposure > 0 && static_cast<uint64_t>(exposure) > limits.max_position) {
+            reason = RejectReason::POSITION;
+            return false;
+        }
+    }
+    return true;
+}
+
+void PreTradeRisk::orderAdded(const Order &order) {
+    if (order.getOwnerId() < account_count) {
+        openQuantity(accounts[order.getOwnerId()], order.getSide()).fetch_add(order.getOpenQuantity(), std::memory_order_relaxed);
+    }
+}
+
+void PreTradeRisk::orderExecuted(const Order &order) {
+    if (order.getOwnerId() >= account_count) {
+        return;
+    }
+    Account &account = accounts[order.getOwnerId()];
+    uint64_t quantity = order.getLastExecutedQuantity();
+    openQuantity(account, order.getSide()).fetch_sub(quantity, std::memory_order_relaxed);
+    int64_t signed_quantity = static_cast<int64_t>(quantity);
+    account.position.fetch_add(order.getSide() == OrderSide::BUY ? signed_quantity : -signed_quantity, std::memory_order_relaxed);
+}
+
+void PreTradeRisk::orderDeleted(const Order &order) {
+    if (order.getOwnerId() < account_count) {
+        openQuantity(accounts[order.getOwnerId()], order.getSide()).fetch_sub(order.getOpenQuantity(), std::memory_order_relaxed);
+    }
+}
+
+void PreTradeRisk::orderResized(const Order &order, uint64_t open_quantity) {
+    if (order.getOwnerId() >= account_count) {
+        return;
+    }
+    std::atomic<uint64_t> &open = openQuantity(accounts[order.getOwnerId()], order.getSide());
+    if (open_quantity > order.getOpenQuantity()) {
+        open.fetch_add(open_quantity - order.getOpenQuantity(), std::memory_order_relaxed);
+    } else {
+        open.fetch_sub(order.getOpenQuantity() - open_quantity, std::memory_order_relaxed);
+    }
+}
+
+void PreTradeRisk::orderReduced(const Order &order, uint64_t quantity) {
+    if (order.getOwnerId() < account_count) {
+        openQuantity(accounts[order.getOwnerId()], order.getSide()).fetch_sub(quantity, std::memory_order_relaxed);
+    }
+}
+
+namespace {
+// a triggered stop is deleted and straight away updated into the market or limit order it becomes, on the
+// thread matching its book. the stop deleted last on this thread, so its update can book it again
+thread_local uint64_t deleted_stop_id = 0;
+
+bool isStop(const Order &order) {
+    return order.getType() == OrderType::STOP || order.getType() == OrderType::STOP_LIMIT
+        || order.getType() == OrderType::TRAILING_STOP || order.getType() == OrderType::TRAILING_STOP_LIMIT;
+}
+}
+
+RiskEventHandler::RiskEventHandler(std::unique_ptr<EventHandler> handler, RiskCheck &risk_check)
+    : handler(std::move(handler)), risk_check(risk_check) {}
+
+void RiskEventHandler::handleOrderAdded(const OrderAdded &event) {
+    deleted_stop_id = 0;
+    risk_check.orderAdded(event.order);
+    handler->handleOrderAdded(event);
+}
+
+void RiskEventHandler::handleOrderDeleted(const OrderDeleted &event) {
+    deleted_stop_id = isStop(event.order) ? event.order.getId() : 0;
+    risk_check.orderDeleted(event.order);
+    handler->handleOrderDeleted(event);
+}
+
+void RiskEventHandler::handleOrderUpdated(const OrderUpdated &event) {
+    if (deleted_stop_id != 0 && deleted_stop_id == event.order.getId() && !isStop(event.order)) {
+        // the stop triggered, its quantity is open again as the order it turned into
+        risk_check.orderAdded(event.order);
+    }
+    deleted_stop_id = 0;
+    handler->handleOrderUpdated(event);
+}
+
+void RiskEventHandler::handleOrderExecuted(const OrderExecuted &event) {
+    risk_check.orderExecuted(event.order);
+    handler->handleOrderExecuted(event);
+}
+
+void RiskEventHandler::handleOrderRejected(const OrderRejected &event) {
+    handler->handleOrderRejected(event);
+}
+
+void RiskEventHandler::handleSelfTradePrevented(const SelfTradePrevented &event) {
+    risk_check.orderReduced(event.order, event.quantity);
+    handler->handleSelfTradePrevented(event);
+}
+
+void RiskEventHandler::handleSymbolAdded(const SymbolAdded &event) {
+    handler->handleSymbolAdded(event);
+}
+
+void RiskEventHandler::handleSymbolDeleted(const SymbolDeleted &event) {
+    handler->handleSymbolDeleted(event);
+}
+
+void RiskEventHandler::handleAuctionUncrossed(const AuctionUncrossed &event) {
+    handler->handleAuctionUncrossed(event);
+}
+
+void RiskEventHandler::handleOrderExecutedBatch(const std::vector<OrderExecuted> &events) {
+    for (const OrderExecuted &event : events) {
+        risk_check.orderExecuted(event.order);
+    }
+    handler->handleOrderExecutedBatch(events);
+}
+
+void RiskEventHandler::handleOrderDeletedBatch(const std::vector<OrderDeleted> &events) {
+    for (const OrderDeleted &event : events) {
+        risk_check.orderDeleted(event.order);
+    }
+    handler->handleOrderDeletedBatch(events);
+}
+
+void RiskEventHandler::handleTrades(const std::vector<Trade> &trades, const std::vector<FillSummary> &summaries) {
+    handler->handleTrades(trades, summaries);
+}
+}
@@ -0,0 +1,439 @@
+#include <stdexcept>
+#include "sharded_engine.h"
+#include "price_level_order_book.h"
+#include "numa.h"
+
+namespace QuantaTrader {
+
+namespace {
+// books that can be moving at the same time, bounds the control queues
+constexpr size_t MAX_MIGRATIONS_IN_FLIGHT = 256;
+constexpr size_t SHARD_BATCH_SIZE = 64;
+}
+
+ShardedEngine::ShardedEngine(std::unique_ptr<EventHandler> event_handler, size_t num_shards, Clock &clock, size_t queue_capacity,
+    RiskCheck *risk_check, const std::vector<int> &shard_cpus, bool route_orders)
+    : event_handler(std::move(event_handler)),
+    clock(clock),
+    risk_check(risk_check),
+    route_orders(route_orders),
+    parked_capacity(queue_capacity),
+    rebalance_interval(0),
+    running(false),
+    stopping(false),
+    migrations_in_flight(0),
+    migrations(0),
+    next_shard(0) {
+    if (num_shards == 0) {
+        throw std::runtime_error("Engine needs at least one shard");
+    }
+    if (!shard_cpus.empty() && shard_cpus.size() != num_shards) {
+        throw std::runtime_error("Engine needs a cpu for every shard");
+    }
+    for (size_t i = 0; i < num_shards; ++i) {
+        int cpu = shard_cpus.empty() ? -1 : shard_cpus[i];
+        int node = numaNodeOfCpu(cpu);
+        // first touched on the shard's cpu, so the queues land on its node
+        runOnCpu(cpu, [&] {
+            arenas.push_back(std::make_unique<HugePageArena>(HUGE_PAGE_SIZE, node));
+            shards.push_back(std::make_unique<Shard>(static_cast<uint16_t>(i), queue_capacity, MAX_MIGRATIONS_IN_FLIGHT, cpu, node));
+        });
+    }
+    if (risk_check != nullptr) {
+        this->event_handler = std::make_unique<RiskEventHandler>(std::move(this->event_handler), *risk_check);
+    }
+}
+
+ShardedEngine::~ShardedEngine() {
+    stop();
+}
+
+void ShardedEngine::addSymbol(uint32_t symbol_id, const std::string &symbol_name) {
+    addSymbol(symbol_id, symbol_name, next_shard);
+    next_shard = (next_shard + 1) % shards.size();
+}
+
+void ShardedEngine::addSymbol(uint32_t symbol_id, const std::string &symbol_name, uint32_t shard_id) {
+    if (running.load(std::memory_order_acquire)) {
+        throw std::runtime_error("Symbols must be added before the engine starts");
+    }
+    if (shard_id >= shards.size()) {
+        throw std::runtime_error("Shard does not exist");
+    }
+    if (routes.count(symbol_id) > 0) {
+        throw std::runtime_error("Symbol already exists in the book");
+    }
+    auto symbol_route = std::make_unique<SymbolRoute>();
+    symbol_route->shard.store(shard_id, std::memory_order_relaxed);
+    symbol_route->home_shard = shard_id;
+    routes[symbol_id] = std::move(symbol_route);
+    Shard &shard = *shards[shard_id];
+    std::unique_ptr<PriceLevelOrderBook> book;
+    runOnCpu(shard.cpu, [&] {
+        book = std::make_unique<PriceLevelOrderBook>(symbol_id, *event_handler, clock, &shard.sequencer, arenas[shard_id].get());
+    });
+    if (route_orders) {
+        book->setRouter(&router);
+    }
+    shard.books.insert({symbol_id, std::move(book)});
+    shard.symbols.fetch_add(1, std::memory_order_relaxed);
+    SymbolAdded symbol_added_event(symbol_id, symbol_name, EventStamp{clock.now(), shard.sequencer.next(), 0, shard.sequencer.getStream()});
+    event_handler->handleSymbolAdded(symbol_added_event);
+}
+
+bool ShardedEngine::hasSymbol(uint32_t symbol_id) const {
+    return routes.count(symbol_id) > 0;
+}
+
+uint32_t ShardedEngine::registerProducer(size_t response_capacity, int producer_cpu) {
+    if (running.load(std::memory_order_acquire)) {
+        throw std::runtime_error("Producers must be registered before the engine starts");
+    }
+    std::unique_ptr<MpscQueue<CommandAck>> response;
+    runOnCpu(producer_cpu, [&] { response = std::make_unique<MpscQueue<CommandAck>>(response_capacity); });
+    responses.push_back(std::move(response));
+    producer_nodes.push_back(numaNodeOfCpu(producer_cpu));
+    return static_cast<uint32_t>(responses.size() - 1);
+}
+
+void ShardedEngine::setRebalancePolicy(std::unique_ptr<RebalancePolicy> new_policy, std::chrono::milliseconds interval) {
+    if (running.load(std::memory_order_acquire)) {
+        throw std::runtime_error("Rebalance policy must be set before the engine starts");
+    }
+    policy = std::move(new_policy);
+    rebalance_interval = interval;
+}
+
+void ShardedEngine::start() {
+    if (running.exchange(true)) {
+        throw std::runtime_error("Engine is already running");
+    }
+    stopping.store(false, std::memory_order_release);
+    for (uint32_t i = 0; i < shards.size(); ++i) {
+        shards[i]->thread = std::thread(&ShardedEngine::run, this, i);
+    }
+    if (policy) {
+        rebalancer = std::thread(&ShardedEngine::runRebalancer, this);
+    }
+}
+
+void ShardedEngine::stop() {
+    if (!running.load(std::memory_order_acquire)) {
+        return;
+    }
+    // no new migrations, then let the ones under way land before the shards go down
+    running.store(false, std::memory_order_release);
+    if (rebalancer.joinable()) {
+        rebalancer.join();
+    }
+    stopping.store(true, std::memory_order_release);
+    for (auto &shard : shards) {
+        shard->thread.join();
+    }
+}
+
+bool ShardedEngine::submit(uint32_t producer_id, Command command) {
+    SymbolRoute &symbol_route = route(command.symbol_id);
+    command.producer_id = producer_id;
+    Message message{MessageType::COMMAND, command.symbol_id, 0, now(), nullptr, command};
+    for (;;) {
+        // fast path: announce ourselves so a migration waits for this push to land
+        symbol_route.inflight.fetch_add(1, std::memory_order_seq_cst);
+        if (!symbol_route.migrating.load(std::memory_order_seq_cst)) {
+            uint32_t shard_id = symbol_route.shard.load(std::memory_order_acquire);
+            bool pushed = shards[shard_id]->ingress.tryPush(message);
+            symbol_route.inflight.fetch_sub(1, std::memory_order_release);
+            return pushed;
+        }
+        symbol_route.inflight.fetch_sub(1, std::memory_order_release);
+
+        // the book is moving, park the command until it lands
+        std::lock_guard<std::mutex> guard(symbol_route.parked_lock);
+        if (symbol_route.migrating.load(std::memory_order_acquire)) {
+            if (symbol_route.parked.size() >= parked_capacity) {
+                return false;
+            }
+            symbol_route.parked.push_back(message);
+            return true;
+        }
+        // the move finished while we waited for the lock, take the fast path again
+    }
+}
+
+bool ShardedEngine::submitById(uint32_t producer_id, Command command) {
+    if (!route_orders) {
+        throw std::runtime_error("Orders are not routed by id in this engine");
+    }
+    if (!router.find(command.order_id, command.symbol_id)) {
+        throw std::runtime_error("Order does not exist in the engine");
+    }
+    return submit(producer_id, command);
+}
+
+bool ShardedEngine::pollAck(uint32_t producer_id, CommandAck &ack) {
+    return responses[producer_id]->tryPop(ack);
+}
+
+size_t ShardedEngine::rebalance() {
+    if (!policy) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(rebalance_lock);
+    std::vector<ShardLoad> shard_loads = getShardLoads();
+    for (size_t i = 0; i < shards.size(); ++i) {
+        uint64_t total = shard_loads[i].commands;
+        shard_loads[i].commands = total - shards[i]->commands_at_last_rebalance;
+        shards[i]->commands_at_last_rebalance = total;
+    }
+    std::vector<SymbolLoad> symbol_loads;
+    symbol_loads.reserve(routes.size());
+    for (auto &[symbol_id, symbol_route] : routes) {
+        uint64_t total = symbol_route->commands.load(std::memory_order_relaxed);
+        symbol_loads.push_back(SymbolLoad{symbol_id, symbol_route->shard.load(std::memory_order_acquire),
+            total - symbol_route->commands_at_last_rebalance});
+        symbol_route->commands_at_last_rebalance = total;
+    }
+    size_t started = 0;
+    for (const Migration &migration : policy->plan(shard_loads, symbol_loads)) {
+        if (migrateSymbol(migration.symbol_id, migration.to_shard)) {
+            ++started;
+        }
+    }
+    return started;
+}
+
+bool ShardedEngine::migrateSymbol(uint32_t symbol_id, uint32_t to_shard) {
+    if (to_shard >= shards.size()) {
+        throw std::runtime_error("Shard does not exist");
+    }
+    SymbolRoute &symbol_route = route(symbol_id);
+    if (symbol_route.shard.load(std::memory_order_acquire) == to_shard) {
+        return false;
+    }
+    if (migrations_in_flight.fetch_add(1, std::memory_order_acq_rel) >= MAX_MIGRATIONS_IN_FLIGHT
+        || symbol_route.migrating.exchange(true, std::memory_order_seq_cst)) {
+        migrations_in_flight.fetch_sub(1, std::memory_order_acq_rel);
+        return false;
+    }
+    // wait for producers already on the fast path, everyone after them parks their commands
+    while (symbol_route.inflight.load(std::memory_order_seq_cst) != 0) {
+    }
+    uint32_t from_shard = symbol_route.shard.load(std::memory_order_acquire);
+    Message message{MessageType::MIGRATE_OUT, symbol_id, to_shard, now(), nullptr, Command{}};
+    // queued behind every command already routed to the old shard, so those are applied first
+    push(shards[from_shard]->ingress, message);
+    return true;
+}
+
+uint32_t ShardedEngine::getShard(uint32_t symbol_id) const {
+    return route(symbol_id).shard.load(std::memory_order_acquire);
+}
+
+uint64_t ShardedEngine::getLastSequence(uint32_t shard_id) const {
+    if (shard_id >= shards.size()) {
+        throw std::runtime_error("Shard does not exist");
+    }
+    return shards[shard_id]->sequencer.getLast();
+}
+
+ArenaStats ShardedEngine::getArenaStats(uint32_t shard_id) const {
+    if (shard_id >= arenas.size()) {
+        throw std::runtime_error("Shard does not exist");
+    }
+    return arenas[shard_id]->getStats();
+}
+
+ShardNumaStats ShardedEngine::getNumaStats(uint32_t shard_id) const {
+    if (shard_id >= shards.size()) {
+        throw std::runtime_error("Shard does not exist");
+    }
+    const Shard &shard = *shards[shard_id];
+    uint32_t remote_books = 0;
+    for (const auto &[symbol_id, symbol_route] : routes) {
+        const Shard &home = *shards[symbol_route->home_shard];
+        if (symbol_route->shard.load(std::memory_order_acquire) == shard_id && home.node != shard.node) {
+            ++remote_books;
+        }
+    }
+    ArenaStats arena_stats = arenas[shard_id]->getStats();
+    return ShardNumaStats{shard.cpu, shard.node, shard.remote_commands.load(std::memory_order_relaxed), remote_books,
+        arena_stats.reserved_bytes, arena_stats.node_bound_bytes};
+}
+
+std::vector<ShardLoad> ShardedEngine::getShardLoads() const {
+    std::vector<ShardLoad> loads;
+    loads.reserve(shards.size());
+    for (uint32_t i = 0; i < shards.size(); ++i) {
+        const Shard &shard = *shards[i];
+        loads.push_back(ShardLoad{i, shard.commands.load(std::memory_order_relaxed), shard.ingress.size(),
+            shard.latency_ns.load(std::memory_order_relaxed), shard.symbols.load(std::memory_order_relaxed)});
+    }
+    return loads;
+}
+
+void ShardedEngine::run(uint32_t shard_id) {
+    Shard &shard = *shards[shard_id];
+    pinCurrentThread(shard.cpu);
+    std::vector<Message> batch(SHARD_BATCH_SIZE);
+    uint32_t idle_spins = 0;
+    for (;;) {
+        // keep going after stop() until the queues are empty and no book is still on its way here
+        bool draining = stopping.load(std::memory_order_acquire);
+        size_t count = shard.control.popBatch(batch.data(), batch.size());
+        count += shard.ingress.popBatch(batch.data() + count, batch.size() - count);
+        for (size_t i = 0; i < count; ++i) {
+            handle(shard_id, batch[i]);
+        }
+        if (count != 0) {
+            idle_spins = 0;
+            continue;
+        }
+        if (draining && migrations_in_flight.load(std::memory_order_acquire) == 0) {
+            break;
+        }
+        if (++idle_spins > 1024) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ShardedEngine::handle(uint32_t shard_id, Message &message) {
+    Shard &shard = *shards[shard_id];
+    switch (message.type) {
+        case MessageType::COMMAND: {
+            auto it = shard.books.find(message.symbol_id);
+            apply(shard_id, *it->second, message);
+            break;
+        }
+        case MessageType::MIGRATE_OUT: {
+            auto it = shard.books.find(message.symbol_id);
+            Message adopt_message{MessageType::ADOPT, message.symbol_id, message.target_shard, message.submit_time,
+                it->second.release(), Command{}};
+            shard.books.erase(it);
+            shard.symbols.fetch_sub(1, std::memory_order_relaxed);
+            push(shards[message.target_shard]->control, adopt_message);
+            break;
+        }
+        case MessageType::ADOPT:
+            adopt(shard_id, message);
+            break;
+    }
+}
+
+void ShardedEngine::adopt(uint32_t shard_id, Message &message) {
+    Shard &shard = *shards[shard_id];
+    auto [it, inserted] = shard.books.emplace(message.symbol_id, std::unique_ptr<OrderBook>(message.book));
+    it->second->setSequencer(&shard.sequencer);
+    shard.symbols.fetch_add(1, std::memory_order_relaxed);
+    SymbolRoute &symbol_route = route(message.symbol_id);
+    // replay what arrived during the move, in the order it was submitted. the lock is not held while replaying,
+    // a producer submitting to the symbol meanwhile parks behind the replay instead of blocking on the lock,
+    // so it can still drain the acks the replay waits to push
+    std::vector<Message> &replaying = shard.replaying;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> guard(symbol_route.parked_lock);
+            if (symbol_route.parked.empty()) {
+                symbol_route.shard.store(shard_id, std::memory_order_release);
+                symbol_route.migrating.store(false, std::memory_order_seq_cst);
+                break;
+            }
+            replaying.swap(symbol_route.parked);
+        }
+        for (const Message &parked : replaying) {
+            apply(shard_id, *it->second, parked);
+        }
+        replaying.clear();
+    }
+    migrations.fetch_add(1, std::memory_order_relaxed);
+    migrations_in_flight.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ShardedEngine::apply(uint32_t shard_id, OrderBook &book, const Message &message) {
+    const Command &command = message.command;
+    CommandAck ack{command.request_id, command.order_id, command.type, CommandStatus::ACCEPTED};
+    try {
+        // the order can fill or be cancelled between a producer routing a command to it and the shard applying it,
+        // the book then throws and the command is rejected
+        switch (command.type) {
+            case CommandType::ADD_ORDER: {
+                RejectReason reason;
+                if (risk_check != nullptr && !risk_check->check(command.order, book, reason)) {
+                    book.rejectOrder(command.order, reason);
+                    ack.status = CommandStatus::REJECTED;
+                } else if (!book.addOrder(command.order)) {
+                    ack.status = CommandStatus::REJECTED;
+                }
+                break;
+            }
+            case CommandType::DELETE_ORDER:
+                book.deleteOrder(command.order_id);
+                break;
+            case CommandType::CANCEL_ORDER:
+                if (risk_check != nullptr) {
+                    risk_check->orderResized(book.getOrder(command.order_id), command.quantity);
+                }
+                book.cancelOrder(command.order_id, command.quantity);
+                break;
+            case CommandType::MODIFY_ORDER:
+                book.modifyOrder(command.order_id, command.new_order_id, command.price);
+                break;
+            case CommandType::EXECUTE_ORDER:
+                book.executeOrder(command.order_id, command.quantity);
+                break;
+            case CommandType::EXECUTE_ORDER_AT_PRICE:
+                book.executeOrder(command.order_id, command.quantity, command.price);
+                break;
+            case CommandType::START_AUCTION:
+                book.startAuction();
+                break;
+            case CommandType::UNCROSS_AUCTION:
+                book.uncross();
+                break;
+        }
+    } catch (const std::exception &) {
+        ack.status = CommandStatus::REJECTED;
+    }
+    responses[command.producer_id]->push(ack);
+
+    Shard &shard = *shards[shard_id];
+    route(message.symbol_id).commands.fetch_add(1, std::memory_order_relaxed);
+    shard.commands.fetch_add(1, std::memory_order_relaxed);
+    int producer_node = producer_nodes[command.producer_id];
+    if (producer_node >= 0 && shard.node >= 0 && producer_node != shard.node) {
+        shard.remote_commands.fetch_add(1, std::memory_order_relaxed);
+    }
+    // moving average over roughly the last 16 commands
+    uint64_t latency = now() - message.submit_time;
+    uint64_t average = shard.latency_ns.load(std::memory_order_relaxed);
+    shard.latency_ns.store(average - average / 16 + latency / 16, std::memory_order_relaxed);
+}
+
+void ShardedEngine::push(MpscQueue<Message> &queue, const Message &message) {
+    queue.push(message);
+}
+
+void ShardedEngine::runRebalancer() {
+    auto next = std::chrono::steady_clock::now() + rebalance_interval;
+    while (running.load(std::memory_order_acquire)) {
+        if (std::chrono::steady_clock::now() < next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        rebalance();
+        next = std::chrono::steady_clock::now() + rebalance_interval;
+    }
+}
+
+ShardedEngine::SymbolRoute &ShardedEngine::route(uint32_t symbol_id) const {
+    auto it = routes.find(symbol_id);
+    if (it == routes.end()) {
+        throw std::runtime_error("Symbol does not exist in the book");
+    }
+    return *it->second;
+}
+
+uint64_t ShardedEngine::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
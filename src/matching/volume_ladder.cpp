@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cassert>
+#include "volume_ladder.h"
+
+namespace QuantaTrader {
+
+namespace {
+constexpr size_t INITIAL_TICKS = 1024;
+}
+
+VolumeLadder::VolumeLadder(uint64_t max_span, HugePageArena *arena)
+    : max_span(std::max<uint64_t>(max_span, INITIAL_TICKS)),
+    base(0),
+    volumes(ArenaAllocator<uint64_t>(arena)),
+    tree(ArenaAllocator<uint64_t>(arena)),
+    rebased(ArenaAllocator<uint64_t>(arena)),
+    window_volume(0),
+    total_volume(0),
+    spill(ArenaAllocator<std::pair<const uint64_t, uint64_t>>(arena)),
+    spill_below(0) {}
+
+void VolumeLadder::add(uint64_t price, uint64_t quantity) {
+    if (quantity == 0) {
+        return;
+    }
+    total_volume += quantity;
+    if (!place(price)) {
+        spill[price] += quantity;
+        if (price < base) {
+            spill_below += quantity;
+        }
+        return;
+    }
+    window_volume += quantity;
+    size_t index = price - base;
+    volumes[index] += quantity;
+    for (size_t i = index + 1; i < tree.size(); i += i & (~i + 1)) {
+        tree[i] += quantity;
+    }
+}
+
+void VolumeLadder::remove(uint64_t price, uint64_t quantity) {
+    if (quantity == 0) {
+        return;
+    }
+    assert(total_volume >= quantity);
+    total_volume -= quantity;
+    if (!covers(price)) {
+        auto spill_it = spill.find(price);
+        assert(spill_it != spill.end() && spill_it->second >= quantity);
+        spill_it->second -= quantity;
+        if (price < base) {
+            spill_below -= quantity;
+        }
+        if (spill_it->second == 0) {
+            spill.erase(spill_it);
+        }
+        return;
+    }
+    window_volume -= quantity;
+    size_t index = price - base;
+    assert(volumes[index] >= quantity);
+    volumes[index] -= quantity;
+    for (size_t i = index + 1; i < tree.size(); i += i & (~i + 1)) {
+        tree[i] -= quantity;
+    }
+}
+
+uint64_t VolumeLadder::volumeAtOrBelow(uint64_t price) const {
+    if (total_volume == 0) {
+        return 0;
+    }
+    if (price < base) {
+        // the spill below the window, less what is spilled between price and the window
+        uint64_t volume = spill_below;
+        for (auto spill_it = spill.lower_bound(base); spill_it != spill.begin();) {
+            --spill_it;
+            if (spill_it->first <= price) {
+                break;
+            }
+            volume -= spill_it->second;
+        }
+        return volume;
+    }
+    if (covers(price)) {
+        return spill_below + prefix(price - base + 1);
+    }
+    // above the window, add what is spilled between the window and price
+    uint64_t volume = spill_below + window_volume;
+    for (auto spill_it = spill.lower_bound(base); spill_it != spill.end() && spill_it->first <= price; ++spill_it) {
+        volume += spill_it->second;
+    }
+    return volume;
+}
+
+uint64_t VolumeLadder::volumeAtOrAbove(uint64_t price) const {
+    return price == 0 ? total_volume : total_volume - volumeAtOrBelow(price - 1);
+}
+
+bool VolumeLadder::place(uint64_t price) {
+    if (covers(price)) {
+        return true;
+    }
+    if (volumes.empty() || window_volume == 0) {
+        // nothing rests in the window, centre a fresh one of the initial size on the price
+        rebase(price >= INITIAL_TICKS / 2 ? price - INITIAL_TICKS / 2 : 0, INITIAL_TICKS);
+        return true;
+    }
+    uint64_t low = std::min(base, price);
+    uint64_t high = std::max(base + volumes.size() - 1, price);
+    // double so a book drifting in one direction rebuilds a logarithmic number of times, but never more
+    // than that in one go, a price further out spills instead
+    size_t size = std::min<uint64_t>(2 * volumes.size(), max_span);
+    if (high - low + 1 > size) {
+        return false;
+    }
+    // grow towards the new price, the headroom goes on that side
+    rebase(price < base ? (high + 1 >= size ? high + 1 - size : 0) : low, size);
+    return true;
+}
+
+void VolumeLadder::rebase(uint64_t new_base, size_t size) {
+    rebased.assign(size, 0);
+    for (size_t i = 0; i < volumes.size(); ++i) {
+        if (volumes[i] != 0) {
+            rebased[base + i - new_base] += volumes[i];
+        }
+    }
+    volumes.swap(rebased);
+    base = new_base;
+    // pull in spilled prices the window now reaches, only the ones inside it are visited
+    for (auto spill_it = spill.lower_bound(base); spill_it != spill.end() && covers(spill_it->first);) {
+        volumes[spill_it->first - base] += spill_it->second;
+        window_volume += spill_it->second;
+        spill_it = spill.erase(spill_it);
+    }
+    spill_below = 0;
+    for (auto spill_it = spill.begin(); spill_it != spill.end() && spill_it->first < base; ++spill_it) {
+        spill_below += spill_it->second;
+    }
+    // linear time fenwick build
+    tree.assign(size + 1, 0);
+    for (size_t i = 1; i <= size; ++i) {
+        tree[i] += volumes[i - 1];
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= size) {
+            tree[parent] += tree[i];
+        }
+    }
+}
+
+uint64_t VolumeLadder::prefix(size_t count) const {
+    uint64_t volume = 0;
+    for (size_t i = count; i > 0; i -= i & (~i + 1)) {
+        volume += tree[i];
+    }
+    return volume;
+}
+}
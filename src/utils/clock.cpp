@@ -0,0 +1,61 @@
+#include "clock.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace QuantaTrader {
+
+namespace {
+Timestamp systemTime() {
+    auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+SystemClock system_clock_instance;
+Clock *default_clock = &system_clock_instance;
+}
+
+Clock &Clock::defaultClock() {
+    return *default_clock;
+}
+
+void Clock::setDefaultClock(Clock &clock) {
+    default_clock = &clock;
+}
+
+Timestamp SystemClock::now() {
+    return systemTime();
+}
+
+uint64_t TscClock::readTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+TscClock::TscClock(std::chrono::microseconds calibration_time) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = readTicks();
+    while (std::chrono::steady_clock::now() - start < calibration_time) {
+        // busy wait so the counter and the steady clock advance together
+    }
+    auto end = std::chrono::steady_clock::now();
+    uint64_t end_ticks = readTicks();
+
+    uint64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    uint64_t elapsed_ticks = end_ticks > start_ticks ? end_ticks - start_ticks : 1;
+    ns_per_tick = static_cast<uint64_t>((static_cast<unsigned __int128>(elapsed_ns) << 32) / elapsed_ticks);
+
+    // anchor the counter to wall clock time
+    base_ticks = readTicks();
+    base_time = systemTime();
+}
+
+CoarseClock::CoarseClock(Clock &source) : source(source), cached_time(source.now()) {}
+}
@@ -0,0 +1,136 @@
+#include <sys/mman.h>
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include "huge_page_arena.h"
+#include "numa.h"
+
+namespace QuantaTrader {
+
+namespace {
+size_t sizeClass(size_t size, size_t alignment) {
+    // a block aligned past ALIGNMENT is made a whole number of cache lines. those are carved on a cache line and
+    // their size classes hold nothing else, so a recycled block is as aligned as a fresh one
+    size_t granule = alignment > HugePageArena::ALIGNMENT ? CACHE_LINE_SIZE : HugePageArena::ALIGNMENT;
+    size_t rounded = (std::max(size, alignment) + granule - 1) / granule * granule;
+    return (rounded + HugePageArena::ALIGNMENT - 1) / HugePageArena::ALIGNMENT;
+}
+
+bool isLarge(size_t size, size_t alignment) {
+    return size > HugePageArena::MAX_CLASS_SIZE || alignment > CACHE_LINE_SIZE;
+}
+}
+
+HugePageArena::HugePageArena(size_t chunk_size, int node)
+    : chunk_size((std::max(chunk_size, HUGE_PAGE_SIZE) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE),
+    node(node),
+    free_blocks(MAX_CLASS_SIZE / ALIGNMENT + 1, nullptr),
+    current(nullptr),
+    chunk_end(nullptr),
+    stats{} {}
+
+HugePageArena::~HugePageArena() {
+    for (auto &[start, length] : chunks) {
+        munmap(start, length);
+    }
+}
+
+void HugePageArena::mapChunk() {
+    void *mapped = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+    flags |= (chunk_size % GIGANTIC_PAGE_SIZE == 0 ? 30 : 21) << MAP_HUGE_SHIFT;
+#endif
+    mapped = mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapped != MAP_FAILED) {
+        chunks.emplace_back(static_cast<char *>(mapped), chunk_size);
+        stats.huge_page_bytes += chunk_size;
+    }
+#endif
+    if (mapped == MAP_FAILED) {
+        // no reserved huge pages, map a huge page more than needed so the chunk can start on a huge page boundary
+        size_t length = chunk_size + HUGE_PAGE_SIZE;
+        mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        char *start = static_cast<char *>(mapped);
+        char *aligned = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(start) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        if (aligned != start) {
+            munmap(start, static_cast<size_t>(aligned - start));
+        }
+        size_t tail = static_cast<size_t>(start + length - (aligned + chunk_size));
+        if (tail != 0) {
+            munmap(aligned + chunk_size, tail);
+        }
+        mapped = aligned;
+        chunks.emplace_back(aligned, chunk_size);
+#ifdef MADV_HUGEPAGE
+        if (madvise(aligned, chunk_size, MADV_HUGEPAGE) == 0) {
+            stats.transparent_bytes += chunk_size;
+        }
+#endif
+    }
+    if (node >= 0 && bindToNode(mapped, chunk_size, node)) {
+        stats.node_bound_bytes += chunk_size;
+    }
+    current = static_cast<char *>(mapped);
+    chunk_end = current + chunk_size;
+    stats.reserved_bytes += chunk_size;
+}
+
+void *HugePageArena::allocate(size_t size, size_t alignment) {
+    if (isLarge(size, alignment)) {
+        void *pointer = ::operator new(size, std::align_val_t(std::max(alignment, ALIGNMENT)));
+        std::lock_guard<SpinLock> guard(lock);
+        stats.large_bytes += size;
+        ++stats.allocations;
+        return pointer;
+    }
+    size_t size_class = sizeClass(size, alignment);
+    size_t block_size = size_class * ALIGNMENT;
+    std::lock_guard<SpinLock> guard(lock);
+    ++stats.allocations;
+    stats.allocated_bytes += block_size;
+    stats.peak_allocated_bytes = std::max(stats.peak_allocated_bytes, stats.allocated_bytes);
+    FreeBlock *block = free_blocks[size_class];
+    if (block != nullptr) {
+        free_blocks[size_class] = block->next;
+        return block;
+    }
+    // blocks of whole cache lines start on one, whatever alignment they were asked for
+    size_t skip = block_size % CACHE_LINE_SIZE == 0 ? (CACHE_LINE_SIZE - reinterpret_cast<uintptr_t>(current) % CACHE_LINE_SIZE) % CACHE_LINE_SIZE : 0;
+    if (static_cast<size_t>(chunk_end - current) < skip + block_size) {
+        // the rest of the chunk is left unused, chunks start on a huge page so they are cache line aligned
+        mapChunk();
+        skip = 0;
+    }
+    current += skip;
+    void *pointer = current;
+    current += block_size;
+    return pointer;
+}
+
+void HugePageArena::deallocate(void *pointer, size_t size, size_t alignment) {
+    if (isLarge(size, alignment)) {
+        ::operator delete(pointer, std::align_val_t(std::max(alignment, ALIGNMENT)));
+        std::lock_guard<SpinLock> guard(lock);
+        stats.large_bytes -= size;
+        ++stats.deallocations;
+        return;
+    }
+    size_t size_class = sizeClass(size, alignment);
+    FreeBlock *block = static_cast<FreeBlock *>(pointer);
+    std::lock_guard<SpinLock> guard(lock);
+    ++stats.deallocations;
+    stats.allocated_bytes -= size_class * ALIGNMENT;
+    block->next = free_blocks[size_class];
+    free_blocks[size_class] = block;
+}
+
+ArenaStats HugePageArena::getStats() const {
+    std::lock_guard<SpinLock> guard(lock);
+    return stats;
+}
+}
@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "numa.h"
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace QuantaTrader {
+
+namespace {
+#ifdef __linux__
+// mbind policy, the same value as MPOL_PREFERRED in numaif.h
+constexpr int PREFERRED_POLICY = 1;
+constexpr size_t MAX_NODES = 1024;
+
+// node of every cpu, from the cpu lists sysfs keeps per node such as "0-3,8-11"
+std::vector<int> loadCpuNodes() {
+    std::vector<int> cpu_nodes;
+    DIR *directory = opendir("/sys/devices/system/node");
+    if (directory == nullptr) {
+        return cpu_nodes;
+    }
+    while (dirent *entry = readdir(directory)) {
+        int node;
+        char rest;
+        if (std::sscanf(entry->d_name, "node%d%c", &node, &rest) != 1) {
+            continue;
+        }
+        std::ifstream cpulist(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+        std::string range;
+        while (std::getline(cpulist, range, ',')) {
+            int first;
+            int last;
+            int fields = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+            if (fields < 1) {
+                continue;
+            }
+            if (fields == 1) {
+                last = first;
+            }
+            if (static_cast<size_t>(last) >= cpu_nodes.size()) {
+                cpu_nodes.resize(static_cast<size_t>(last) + 1, -1);
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpu_nodes[static_cast<size_t>(cpu)] = node;
+            }
+        }
+    }
+    closedir(directory);
+    return cpu_nodes;
+}
+
+const std::vector<int> &cpuNodes() {
+    static const std::vector<int> cpu_nodes = loadCpuNodes();
+    return cpu_nodes;
+}
+#endif
+}
+
+int numaNodeOfCpu(int cpu) {
+#ifdef __linux__
+    const std::vector<int> &cpu_nodes = cpuNodes();
+    return cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes.size() ? cpu_nodes[static_cast<size_t>(cpu)] : -1;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+int currentNumaNode() {
+#ifdef __linux__
+    return numaNodeOfCpu(sched_getcpu());
+#else
+    return -1;
+#endif
+}
+
+bool pinCurrentThread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+void runOnCpu(int cpu, const std::function<void()> &work) {
+    if (cpu < 0) {
+        work();
+        return;
+    }
+    std::exception_ptr error;
+    std::thread worker([&] {
+        pinCurrentThread(cpu);
+        try {
+            work();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    });
+    worker.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+bool bindToNode(void *address, size_t length, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    if (node < 0 || static_cast<size_t>(node) >= MAX_NODES) {
+        return false;
+    }
+    constexpr size_t BITS = 8 * sizeof(unsigned long);
+    unsigned long mask[MAX_NODES / BITS] = {};
+    mask[static_cast<size_t>(node) / BITS] |= 1UL << (static_cast<size_t>(node) % BITS);
+    // the kernel reads one bit less than maxnode
+    return syscall(SYS_mbind, address, length, PREFERRED_POLICY, mask, MAX_NODES + 1, 0) == 0;
+#else
+    (void)address;
+    (void)length;
+    (void)node;
+    return false;
+#endif
+}
+}
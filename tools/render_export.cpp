@@ -0,0 +1,26 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include "book_export.h"
+
+using namespace QuantaTrader;
+
+// prints a binary export written by Engine::exportEngine or OrderBook::exportOrderBook as text
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "usage: render_export <export file>\n";
+        return 1;
+    }
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file) {
+        std::cerr << "could not open " << argv[1] << "\n";
+        return 1;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!renderExport(data.data(), data.size(), std::cout)) {
+        std::cerr << argv[1] << " is not a complete export\n";
+        return 1;
+    }
+    return 0;
+}